@@ -0,0 +1,494 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef APPROXIMATE_H
+#define APPROXIMATE_H
+
+
+// Approximate dimensions from a random sample of tiles
+//
+// The grid squares are split into square tiles, which are drawn at random
+// (without replacement), a batch at a time. Each tile is marched together
+// with a one grid square apron, so that the line segments at its edges have
+// their neighbours, and the curvature of each of its own line segments comes
+// from get_local_curvature(), without a walk. Every line segment, and every
+// box, belongs to exactly one tile, so:
+//
+//   box count  ~ (number of tiles) * (mean box count per tile)
+//   curvature  ~ (sum of the sampled curvatures) / (number of sampled segments)
+//
+// which are exact once every tile has been drawn. The 95% confidence
+// intervals come from resampling the drawn tiles (the bootstrap), scaled by
+// the finite population correction. Sampling stops once both dimensions are
+// known to within the error bound, or the time runs out. A sample with no
+// boxes or line segments, or whose tiles are all alike, has an interval of
+// zero width that says nothing about the tiles not yet drawn, so sampling
+// goes on until it is neither
+//
+// The source is read with image_source::get_window(), so only the windows
+// of the drawn tiles are ever decoded or generated
+
+
+#include "image_source.h"
+#include "primitives.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <string>
+using std::string;
+
+#include <algorithm>
+using std::sort;
+using std::swap;
+
+#include <random>
+#include <thread>
+using std::thread;
+
+#include <chrono>
+#include <cmath>
+
+
+// The sums over one drawn tile
+class tile_sample
+{
+public:
+
+	tile_sample(void)
+	{
+		tile = 0;
+		box_count = 0;
+		num_segments = 0;
+		curvature_sum = 0;
+	}
+
+	size_t tile;
+	size_t box_count;
+	size_t num_segments;
+	double curvature_sum;
+};
+
+
+class approximate_parameters
+{
+public:
+
+	approximate_parameters(void)
+	{
+		tile_size = 64;
+		error_bound = 0.01;
+		max_seconds = 0;
+		min_tiles = 32;
+		num_resamples = 200;
+		seed = 1;
+		num_threads = 0;
+	}
+
+	size_t tile_size;
+
+	// Stop once both 95% confidence intervals are within +/- error_bound
+	double error_bound;
+
+	// Stop after this long, whatever the error (0 = no limit)
+	double max_seconds;
+
+	// The fewest tiles to draw before the error is trusted
+	size_t min_tiles;
+
+	size_t num_resamples;
+	unsigned int seed;
+	size_t num_threads;
+};
+
+
+class approximate_result
+{
+public:
+
+	approximate_result(void)
+	{
+		num_tiles = num_sampled_tiles = 0;
+		curvature_error = box_counting_error = 0;
+		seconds = 0;
+		converged = false;
+	}
+
+	analysis_result result;
+
+	// Half-widths of the 95% confidence intervals of the dimensions
+	double curvature_error;
+	double box_counting_error;
+
+	size_t num_tiles;
+	size_t num_sampled_tiles;
+	double seconds;
+
+	// True if the error bound was met (rather than the time running out)
+	bool converged;
+};
+
+
+template<typename T>
+class tile_sampler_t
+{
+public:
+
+	tile_sampler_t(image_source& src, const grid_parameters& src_gp, const size_t src_tile_size) : s(src)
+	{
+		gp = src_gp;
+		tile_size = (0 == src_tile_size) ? 1 : src_tile_size;
+
+		px = s.get_px();
+		py = s.get_py();
+		pad = gp.virtual_border ? 1 : 0;
+		get_grid_coordinates(gp, px, py, xs, ys);
+
+		// Grid squares
+		sx = (xs.size() < 2) ? 0 : xs.size() - 1;
+		sy = (ys.size() < 2) ? 0 : ys.size() - 1;
+
+		tiles_x = (sx + tile_size - 1) / tile_size;
+		tiles_y = (sy + tile_size - 1) / tile_size;
+	}
+
+	size_t get_num_tiles(void) const
+	{
+		return tiles_x * tiles_y;
+	}
+
+	// Fetch the grid corners of a tile and its apron, border included
+	// Not thread safe, since the source might not be
+	bool fetch(const size_t tile, vector<float>& corners) const
+	{
+		size_t ax0, ay0, ax1, ay1, cx0, cy0, cx1, cy1;
+		get_bounds(tile, ax0, ay0, ax1, ay1, cx0, cy0, cx1, cy1);
+
+		// Corners [ax0, ax1] x [ay0, ay1]
+		const size_t w = ax1 + 1 - ax0;
+		const size_t h = ay1 + 1 - ay0;
+
+		corners.assign(w * h, gp.get_border_value());
+
+		// The pixels among them; corner x is pixel x - pad
+		const size_t x_begin = (ax0 > pad) ? ax0 - pad : 0;
+		const size_t x_end = (ax1 + 1 - pad < px) ? ax1 + 1 - pad : px;
+		const size_t y_begin = (ay0 > pad) ? ay0 - pad : 0;
+		const size_t y_end = (ay1 + 1 - pad < py) ? ay1 + 1 - pad : py;
+
+		if (x_begin >= x_end || y_begin >= y_end)
+			return true;
+
+		window.resize((x_end - x_begin) * (y_end - y_begin));
+
+		if (false == s.get_window(x_begin, y_begin, x_end - x_begin, y_end - y_begin, &window[0]))
+			return false;
+
+		for (size_t y = y_begin; y < y_end; y++)
+			memcpy(&corners[(y + pad - ay0) * w + (x_begin + pad - ax0)], &window[(y - y_begin) * (x_end - x_begin)], (x_end - x_begin) * sizeof(float));
+
+		return true;
+	}
+
+	// March a tile (and its apron) from its corners, and sum up its curvatures
+	void analyse(const size_t tile, const vector<float>& corners, tile_sample& sample) const
+	{
+		size_t ax0, ay0, ax1, ay1, cx0, cy0, cx1, cy1;
+		get_bounds(tile, ax0, ay0, ax1, ay1, cx0, cy0, cx1, cy1);
+
+		const size_t w = ax1 + 1 - ax0;
+		const size_t h = ay1 + 1 - ay0;
+
+		// The corners are already padded, so the march needs no border of its own
+		const vector<T> local_xs(xs.begin() + ax0, xs.begin() + ax1 + 1);
+		const vector<T> local_ys(ys.begin() + ay0, ys.begin() + ay1 + 1);
+		vector<const float*> rows(h);
+
+		for (size_t y = 0; y < h; y++)
+			rows[y] = &corners[y * w];
+
+		// The tile itself, then the apron around it, as four bands
+		const size_t x0 = cx0 - ax0, x1 = cx1 - ax0;
+		const size_t y0 = cy0 - ay0, y1 = cy1 - ay0;
+
+		march_band_t<T> tile_band;
+		march_rectangle(rows, local_xs, local_ys, x0, x1, y0, y1, tile_band);
+
+		// Only the tile's own boxes and line segments are counted
+		const size_t num_tile_segments = tile_band.line_segments.size();
+		const size_t tile_box_count = tile_band.box_count;
+		vector<line_segment_t<T> >& segments = tile_band.line_segments;
+
+		march_rectangle(rows, local_xs, local_ys, 0, w - 1, 0, y0, tile_band);
+		march_rectangle(rows, local_xs, local_ys, 0, w - 1, y1, h - 1, tile_band);
+		march_rectangle(rows, local_xs, local_ys, 0, x0, y0, y1, tile_band);
+		march_rectangle(rows, local_xs, local_ys, x1, w - 1, y0, y1, tile_band);
+
+		// The line segments that end at each vertex
+		map<vertex_2_t<T>, vector<size_t> > vertex_segments;
+
+		for (size_t i = 0; i < segments.size(); i++)
+			for (size_t j = 0; j < 2; j++)
+				vertex_segments[segments[i].vertex[j]].push_back(i);
+
+		sample.tile = tile;
+		sample.box_count = tile_box_count;
+		sample.num_segments = num_tile_segments;
+		sample.curvature_sum = 0;
+
+		for (size_t i = 0; i < num_tile_segments; i++)
+		{
+			const line_segment_t<T>* neighbours[2] = { 0, 0 };
+
+			for (size_t j = 0; j < 2; j++)
+			{
+				const vector<size_t>& refs = vertex_segments.find(segments[i].vertex[j])->second;
+
+				if (2 == refs.size())
+					neighbours[j] = &segments[(refs[0] == i) ? refs[1] : refs[0]];
+			}
+
+			sample.curvature_sum += get_local_curvature(segments[i], neighbours);
+		}
+	}
+
+private:
+
+	// The tile's grid squares [cx0, cx1) x [cy0, cy1), and with the apron
+	// [ax0, ax1) x [ay0, ay1)
+	void get_bounds(const size_t tile, size_t& ax0, size_t& ay0, size_t& ax1, size_t& ay1, size_t& cx0, size_t& cy0, size_t& cx1, size_t& cy1) const
+	{
+		cx0 = (tile % tiles_x) * tile_size;
+		cy0 = (tile / tiles_x) * tile_size;
+		cx1 = (cx0 + tile_size < sx) ? cx0 + tile_size : sx;
+		cy1 = (cy0 + tile_size < sy) ? cy0 + tile_size : sy;
+
+		ax0 = (cx0 > 0) ? cx0 - 1 : 0;
+		ay0 = (cy0 > 0) ? cy0 - 1 : 0;
+		ax1 = (cx1 < sx) ? cx1 + 1 : sx;
+		ay1 = (cy1 < sy) ? cy1 + 1 : sy;
+	}
+
+	// March grid squares [x0, x1) x [y0, y1), appending to band
+	void march_rectangle(const vector<const float*>& rows, const vector<T>& local_xs, const vector<T>& local_ys, const size_t x0, const size_t x1, const size_t y0, const size_t y1, march_band_t<T>& band) const
+	{
+		if (x0 >= x1 || y0 >= y1)
+			return;
+
+		band.x_begin = x0;
+		band.x_end = x1;
+		band.y_begin = y0;
+		band.y_end = y1;
+
+		march_grid_band(rows, 0, local_xs, local_ys, static_cast<T>(gp.isovalue), 0, gp.get_border_value(), band);
+	}
+
+	image_source& s;
+	grid_parameters gp;
+	size_t tile_size;
+	size_t px, py, pad;
+	size_t sx, sy;
+	size_t tiles_x, tiles_y;
+	vector<T> xs, ys;
+	mutable vector<float> window;
+};
+
+
+// The estimates from the sampled tiles, of a population of num_tiles
+// (see the top of the file)
+void get_sampled_result(const vector<tile_sample>& samples, const size_t num_tiles, const grid_parameters& gp, analysis_result& result)
+{
+	double box_sum = 0, curvature_sum = 0;
+	size_t num_segments = 0;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		box_sum += static_cast<double>(samples[i].box_count);
+		curvature_sum += samples[i].curvature_sum;
+		num_segments += samples[i].num_segments;
+	}
+
+	const double box_count = samples.empty() ? 0 : box_sum * static_cast<double>(num_tiles) / static_cast<double>(samples.size());
+
+	result.curvature = (0 < num_segments) ? curvature_sum / static_cast<double>(num_segments) : 0;
+	result.curvature_standard_deviation = 0;
+	result.curvature_dimension = 1.0 + result.curvature;
+	result.box_count = static_cast<size_t>(box_count + 0.5);
+	result.box_counting_dimension = (box_count > 0) ? log(box_count) / log(1.0 / gp.step_size) : 0;
+	result.isovalue = gp.isovalue;
+}
+
+// True if the bootstrap can't be trusted yet: nothing has been found, or
+// every tile drawn so far is the same
+bool is_sample_degenerate(const vector<tile_sample>& samples)
+{
+	size_t box_count = 0, num_segments = 0;
+	bool identical = true;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		box_count += samples[i].box_count;
+		num_segments += samples[i].num_segments;
+
+		if (samples[i].box_count != samples[0].box_count ||
+			samples[i].num_segments != samples[0].num_segments ||
+			samples[i].curvature_sum != samples[0].curvature_sum)
+			identical = false;
+	}
+
+	return 0 == box_count || 0 == num_segments || identical;
+}
+
+// Half-widths of the 95% bootstrap confidence intervals of both dimensions
+void get_sampled_errors(const vector<tile_sample>& samples, const size_t num_tiles, const grid_parameters& gp, const size_t num_resamples, std::mt19937_64& generator, double& curvature_error, double& box_counting_error)
+{
+	curvature_error = box_counting_error = 0;
+
+	// Every tile has been drawn, so the estimates are exact
+	if (samples.size() >= num_tiles || samples.size() < 2 || num_resamples < 2)
+		return;
+
+	std::uniform_int_distribution<size_t> pick(0, samples.size() - 1);
+	vector<tile_sample> resample(samples.size());
+	vector<double> curvature_dimensions(num_resamples);
+	vector<double> box_counting_dimensions(num_resamples);
+
+	for (size_t r = 0; r < num_resamples; r++)
+	{
+		for (size_t i = 0; i < resample.size(); i++)
+			resample[i] = samples[pick(generator)];
+
+		analysis_result result;
+		get_sampled_result(resample, num_tiles, gp, result);
+
+		curvature_dimensions[r] = result.curvature_dimension;
+		box_counting_dimensions[r] = result.box_counting_dimension;
+	}
+
+	sort(curvature_dimensions.begin(), curvature_dimensions.end());
+	sort(box_counting_dimensions.begin(), box_counting_dimensions.end());
+
+	const size_t lo = static_cast<size_t>(0.025 * static_cast<double>(num_resamples - 1) + 0.5);
+	const size_t hi = static_cast<size_t>(0.975 * static_cast<double>(num_resamples - 1) + 0.5);
+
+	// The bootstrap samples with replacement; the tiles were drawn without
+	const double fpc = sqrt(1.0 - static_cast<double>(samples.size()) / static_cast<double>(num_tiles));
+
+	curvature_error = fpc * (curvature_dimensions[hi] - curvature_dimensions[lo]) / 2.0;
+	box_counting_error = fpc * (box_counting_dimensions[hi] - box_counting_dimensions[lo]) / 2.0;
+}
+
+template<typename T>
+void analyse_tile_range(const tile_sampler_t<T>& sampler, const vector<size_t>& tiles, const vector<vector<float> >& corners, const size_t first, const size_t step, vector<tile_sample>& samples)
+{
+	for (size_t i = first; i < tiles.size(); i += step)
+		sampler.analyse(tiles[i], corners[i], samples[i]);
+}
+
+// Draw tiles until the estimates are good enough, the time runs out, or
+// every tile has been drawn
+// Returns false if the source could not be read
+template<typename T>
+bool analyse_approximate(image_source& src, const grid_parameters& gp, const approximate_parameters& ap, approximate_result& ar, pipeline_stats* const stats)
+{
+	stage_timer timer(stats, "approximate");
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	tile_sampler_t<T> sampler(src, gp, ap.tile_size);
+
+	const size_t num_tiles = sampler.get_num_tiles();
+	const size_t n = get_num_threads(ap.num_threads);
+	const size_t min_batch_size = (n > 16) ? n : 16;
+
+	std::mt19937_64 generator(ap.seed);
+
+	// Drawn without replacement: the first m entries are the tiles drawn so far
+	vector<size_t> order(num_tiles);
+
+	for (size_t i = 0; i < num_tiles; i++)
+		order[i] = i;
+
+	vector<tile_sample> samples;
+	vector<size_t> batch;
+	vector<vector<float> > corners;
+	vector<tile_sample> batch_samples;
+
+	ar = approximate_result();
+	ar.num_tiles = num_tiles;
+
+	while (samples.size() < num_tiles)
+	{
+		// The batches grow with the sample, so that the bootstrap after each
+		// one costs a fixed fraction of the time spent sampling
+		const size_t batch_size = (samples.size() / 4 > min_batch_size) ? samples.size() / 4 : min_batch_size;
+
+		// The next batch of tiles, by a partial Fisher-Yates shuffle
+		const size_t count = (num_tiles - samples.size() < batch_size) ? num_tiles - samples.size() : batch_size;
+
+		batch.resize(count);
+		corners.resize(count);
+		batch_samples.assign(count, tile_sample());
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const size_t j = samples.size() + i;
+			std::uniform_int_distribution<size_t> pick(j, num_tiles - 1);
+			swap(order[j], order[pick(generator)]);
+			batch[i] = order[j];
+
+			if (false == sampler.fetch(batch[i], corners[i]))
+				return false;
+		}
+
+		if (1 == n || 1 == count)
+			analyse_tile_range(sampler, batch, corners, 0, 1, batch_samples);
+		else
+		{
+			const size_t num_batch_threads = (n < count) ? n : count;
+			vector<thread> threads;
+
+			for (size_t i = 0; i < num_batch_threads; i++)
+				threads.push_back(thread(analyse_tile_range<T>, std::cref(sampler), std::cref(batch), std::cref(corners), i, num_batch_threads, std::ref(batch_samples)));
+
+			for (size_t i = 0; i < threads.size(); i++)
+				threads[i].join();
+		}
+
+		samples.insert(samples.end(), batch_samples.begin(), batch_samples.end());
+
+		get_sampled_result(samples, num_tiles, gp, ar.result);
+		get_sampled_errors(samples, num_tiles, gp, ap.num_resamples, generator, ar.curvature_error, ar.box_counting_error);
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		ar.seconds = elapsed.count();
+
+		if (samples.size() >= ap.min_tiles && ar.curvature_error <= ap.error_bound && ar.box_counting_error <= ap.error_bound &&
+			false == is_sample_degenerate(samples))
+		{
+			ar.converged = true;
+			break;
+		}
+
+		if (ap.max_seconds > 0 && ar.seconds >= ap.max_seconds)
+			break;
+	}
+
+	if (samples.size() == num_tiles)
+		ar.converged = true;
+
+	ar.num_sampled_tiles = samples.size();
+
+	if (0 != stats)
+		stats->box_count += ar.result.box_count;
+
+	return true;
+}
+
+#endif
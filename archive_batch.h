@@ -0,0 +1,257 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef ARCHIVE_BATCH_H
+#define ARCHIVE_BATCH_H
+
+
+// Analyse every image in a zip archive, several members at a time
+//
+// Each worker inflates one member at a time straight into its own image and
+// line segment buffers, which it keeps from one member to the next (as the
+// daemon's workers do), so the memory in use is bounded by the number of
+// workers and the size of the largest image, whatever the size of the
+// archive. Nothing is extracted to disk
+
+
+#include "image.h"
+#include "image_formats.h"
+#include "isovalue.h"
+#include "zip_archive.h"
+#include "primitives.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <thread>
+using std::thread;
+
+#include <mutex>
+using std::mutex;
+
+#include <chrono>
+#include <cctype>
+
+
+class archive_member_result
+{
+public:
+
+	archive_member_result(void)
+	{
+		index = 0;
+		px = py = 0;
+		seconds = 0;
+		analysed = false;
+	}
+
+	size_t index;
+	size_t px, py;
+	analysis_result result;
+	double seconds;
+	bool analysed;
+};
+
+
+// Whether a member is one of the image files; with raw_format, every file
+// (but not directory) is
+bool is_image_member(const zip_entry& e, const bool raw)
+{
+	if (e.name.empty() || '/' == e.name[e.name.size() - 1])
+		return false;
+
+	if (raw)
+		return true;
+
+	string extension;
+	const size_t dot = e.name.rfind('.');
+
+	if (string::npos != dot)
+		extension = e.name.substr(dot);
+
+	for (size_t i = 0; i < extension.size(); i++)
+		extension[i] = static_cast<char>(tolower(static_cast<unsigned char>(extension[i])));
+
+	return ".tga" == extension || ".pgm" == extension || ".pfm" == extension;
+}
+
+
+class archive_analyser
+{
+public:
+
+	archive_analyser(const zip_archive& src_archive, const pixel_stream_format* const src_raw_format, const isovalue_parameters& src_isovalue_params, const bool src_black_border, const bool src_virtual_border) : archive(src_archive)
+	{
+		raw_format = src_raw_format;
+		isovalue_params = src_isovalue_params;
+		black_border = src_black_border;
+		virtual_border = src_virtual_border;
+		next_member = 0;
+	}
+
+	// Analyse the image members with num_workers threads, each marching one
+	// member at a time on one thread
+	void run(const size_t num_workers, vector<archive_member_result>& src_results, pipeline_stats* const stats)
+	{
+		results.clear();
+
+		for (size_t i = 0; i < archive.get_num_entries(); i++)
+		{
+			if (is_image_member(archive.get_entry(i), 0 != raw_format))
+			{
+				archive_member_result r;
+				r.index = i;
+				results.push_back(r);
+			}
+		}
+
+		size_t n = get_num_threads(num_workers);
+
+		if (n > results.size())
+			n = results.size();
+
+		next_member = 0;
+
+		vector<pipeline_stats> worker_stats(n);
+		vector<thread> workers;
+
+		for (size_t i = 0; i < n; i++)
+			workers.push_back(thread(&archive_analyser::work, this, &worker_stats[i]));
+
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+
+		if (0 != stats)
+			for (size_t i = 0; i < worker_stats.size(); i++)
+				stats->add(worker_stats[i]);
+
+		src_results.swap(results);
+	}
+
+private:
+
+	void work(pipeline_stats* const stats)
+	{
+		tga t;
+		float_grayscale luma;
+		luma_histogram histogram;
+		line_segment_data lsd;
+		lsd.quiet = true;
+		lsd.stats = stats;
+
+		while (true)
+		{
+			size_t i = 0;
+
+			{
+				std::lock_guard<mutex> lock(member_mutex);
+
+				if (next_member == results.size())
+					return;
+
+				i = next_member++;
+			}
+
+			archive_member_result& r = results[i];
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			// The errors of the readers go to cerr, so each line stays whole
+			image_input input;
+			histogram.clear();
+
+			if (false == input.open(archive, r.index, raw_format) || false == read_next_image(input, t, luma, black_border, stats, isovalue_params.is_automatic() ? &histogram : 0))
+				continue;
+
+			r.px = luma.px;
+			r.py = luma.py;
+
+			if (luma.px < 3 || luma.py < 3 || luma.px != luma.py)
+				continue;
+
+			grid_parameters gp;
+			gp.set(luma.px, luma.py, get_isovalue(isovalue_params, histogram));
+			gp.virtual_border = virtual_border;
+
+			r.analysed = analyse_grayscale(luma, gp, lsd, r.result, 1);
+
+			stats->num_segments += lsd.line_segments.size();
+			stats->num_vertices += lsd.vertices.size();
+			stats->num_objects += lsd.num_objects;
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			r.seconds = elapsed.count();
+		}
+	}
+
+	const zip_archive& archive;
+	const pixel_stream_format* raw_format;
+	isovalue_parameters isovalue_params;
+	bool black_border;
+	bool virtual_border;
+
+	vector<archive_member_result> results;
+	mutex member_mutex;
+	size_t next_member;
+};
+
+
+// Analyse the image members of the archive, printing the dimensions of each
+// in the order that they are stored
+// Returns false if the archive, or any of its images, could not be read
+bool run_archive(const char* const filename, const pixel_stream_format* const raw_format, const isovalue_parameters& isovalue_params, const bool black_border, const bool virtual_border, const size_t num_workers, const bool quiet, pipeline_stats* const stats)
+{
+	zip_archive archive;
+
+	if (false == archive.open(filename))
+	{
+		cout << "Error reading " << filename << endl;
+		return false;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	archive_analyser analyser(archive, raw_format, isovalue_params, black_border, virtual_border);
+	vector<archive_member_result> results;
+	analyser.run(num_workers, results, stats);
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	bool all_analysed = true;
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const archive_member_result& r = results[i];
+		const string& name = archive.get_entry(r.index).name;
+
+		if (!r.analysed)
+		{
+			if (0 != r.px && (r.px < 3 || r.py < 3 || r.px != r.py))
+				cout << name << ": template must be square, and at least 3x3 pixels in size." << endl;
+			else
+				cout << name << ": error" << endl;
+
+			all_analysed = false;
+			continue;
+		}
+
+		cout << name << ": " << r.px << " x " << r.py
+			<< ", isovalue " << r.result.isovalue
+			<< ", curvature-based dimension " << r.result.curvature_dimension
+			<< ", box-counting dimension " << r.result.box_counting_dimension
+			<< ", " << r.seconds << " s" << endl;
+	}
+
+	if (!quiet)
+		cout << results.size() << " image(s) in " << elapsed.count() << " s" << endl;
+
+	return all_analysed;
+}
+
+#endif
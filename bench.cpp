@@ -0,0 +1,487 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+// Benchmark for the Marching Squares pipeline
+//
+// Runs each stage separately, and end-to-end, over the images in
+// sample_images.zip (extracted into the --samples directory) and over
+// procedurally generated Mandelbrot, Julia, random disk and Koch images
+//
+// Usage: bench [--samples dir] [--min-size n] [--max-size n]
+//              [--threads n,n,...] [--repeat n] [--json filename]
+//              [--smooth gaussian|box p]
+//
+// With --smooth, every image is also run end-to-end with pre-smoothing (see
+// smoothing.h), to show its effect on the segment count and the run time
+//
+// The stages after the march (weld to normals) are also run on the same line
+// segments in their marched order and in Z-order (see reorder_morton() in
+// primitives.h), with their times and, where the hardware counters can be
+// read, their cache misses
+
+
+#include "pipeline.h"
+#include "synthetic.h"
+#include "stats.h"
+#include "smoothing.h"
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include <fstream>
+using std::ofstream;
+
+#include <sstream>
+using std::istringstream;
+
+#include <iomanip>
+using std::setw;
+
+#include <string>
+using std::string;
+
+#include <chrono>
+
+#include <cstring>
+#include <cstdlib>
+
+
+class bench_options
+{
+public:
+
+	bench_options(void)
+	{
+		samples_dir = ".";
+		min_size = 256;
+		max_size = 4096;
+		repeat = 3;
+		json_filename = 0;
+		smoothing_name = 0;
+	}
+
+	string samples_dir;
+	size_t min_size;
+	size_t max_size;
+	vector<size_t> thread_counts;
+	size_t repeat;
+	const char* json_filename;
+	const char* smoothing_name;
+	smoothing_kernel kernel;
+};
+
+
+// One row of the results table
+class bench_record
+{
+public:
+
+	bench_record(void)
+	{
+		px = 0;
+		generate_seconds = 0;
+		end_to_end_seconds = 0;
+		peak_resident_memory = 0;
+		analysed = false;
+		smoothed_seconds = 0;
+		smoothed = false;
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			post_march_seconds[i] = 0;
+			post_march_cache_misses[i] = 0;
+		}
+
+		cache_misses_available = false;
+	}
+
+	string name;
+	size_t px;
+	double generate_seconds;
+	pipeline_stats stats;
+	vector<pair<size_t, double> > march_seconds; // Thread count, best time
+	double end_to_end_seconds;
+	size_t peak_resident_memory;
+	bool analysed;
+	analysis_result result;
+
+	// End-to-end with --smooth
+	pipeline_stats smoothed_stats;
+	double smoothed_seconds;
+	bool smoothed;
+	analysis_result smoothed_result;
+
+	// Weld to normals, in marched order [0] and in Z-order [1]
+	pipeline_stats post_march_stats[2];
+	double post_march_seconds[2];
+	unsigned long long post_march_cache_misses[2];
+	bool cache_misses_available;
+};
+
+
+double get_seconds_since(const std::chrono::steady_clock::time_point& start)
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+double per_second(const size_t count, const double seconds)
+{
+	if (0 >= seconds)
+		return 0;
+
+	return static_cast<double>(count) / seconds;
+}
+
+
+// Time every stage of the pipeline over one image
+void run_bench(const float_grayscale& luma, const bench_options& opts, bench_record& rec)
+{
+	grid_parameters gp;
+	gp.set(luma.px, luma.py, 0.5);
+
+	// The march, at each thread count (best of opts.repeat)
+	for (size_t i = 0; i < opts.thread_counts.size(); i++)
+	{
+		double best = 0;
+
+		for (size_t r = 0; r < opts.repeat; r++)
+		{
+			vector<line_segment> line_segments;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			march_squares(luma, gp, line_segments, 0, opts.thread_counts[i]);
+			const double seconds = get_seconds_since(start);
+
+			if (0 == r || seconds < best)
+				best = seconds;
+		}
+
+		rec.march_seconds.push_back(pair<size_t, double>(opts.thread_counts[i], best));
+	}
+
+	// End-to-end, with the per-stage breakdown
+	line_segment_data lsd;
+	lsd.quiet = true;
+	lsd.stats = &rec.stats;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	rec.analysed = analyse_grayscale(luma, gp, lsd, rec.result, 0);
+	rec.end_to_end_seconds = get_seconds_since(start);
+	rec.peak_resident_memory = get_peak_resident_memory();
+
+	// Weld to normals, with and without the Z-order renumbering
+	vector<line_segment> line_segments;
+	march_squares(luma, gp, line_segments, 0, 0);
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		line_segment_data ordered_lsd;
+		ordered_lsd.quiet = true;
+		ordered_lsd.stats = &rec.post_march_stats[i];
+		ordered_lsd.morton_order = (1 == i);
+		ordered_lsd.line_segments = line_segments;
+
+		cache_miss_counter counter;
+		rec.cache_misses_available = counter.is_available();
+
+		start = std::chrono::steady_clock::now();
+		counter.start();
+		ordered_lsd.process_line_segments();
+		rec.post_march_cache_misses[i] = counter.stop();
+		rec.post_march_seconds[i] = get_seconds_since(start);
+	}
+
+	if (0 != opts.smoothing_name)
+	{
+		line_segment_data smoothed_lsd;
+		smoothed_lsd.quiet = true;
+		smoothed_lsd.stats = &rec.smoothed_stats;
+
+		float_grayscale_source src(luma);
+		smoothing_source smoothed_src(src, opts.kernel, &rec.smoothed_stats);
+
+		start = std::chrono::steady_clock::now();
+		rec.smoothed = analyse_source(smoothed_src, gp, smoothed_lsd, rec.smoothed_result, 0);
+		rec.smoothed_seconds = get_seconds_since(start);
+	}
+}
+
+void print_record(const bench_record& rec)
+{
+	const pipeline_stats& s = rec.stats;
+	const double post_march = s.get_stage_time("weld") + s.get_stage_time("adjacency") + s.get_stage_time("walk") + s.get_stage_time("normals");
+
+	cout << rec.name << " (" << rec.px << " x " << rec.px << ")" << endl;
+
+	if (0 != rec.generate_seconds)
+		cout << "  input:        " << rec.generate_seconds << " s" << endl;
+
+	for (size_t i = 0; i < s.stage_seconds.size(); i++)
+		cout << "  " << std::left << setw(14) << (s.stage_seconds[i].first + ":") << s.stage_seconds[i].second << " s" << endl;
+
+	for (size_t i = 0; i < rec.march_seconds.size(); i++)
+	{
+		const double seconds = rec.march_seconds[i].second;
+
+		cout << "  march x" << std::left << setw(6) << rec.march_seconds[i].first << seconds << " s, "
+			<< per_second(s.num_cells, seconds) << " cells/s";
+
+		if (0 < i)
+			cout << ", speedup " << rec.march_seconds[0].second / seconds;
+
+		cout << endl;
+	}
+
+	cout << "  end-to-end:   " << rec.end_to_end_seconds << " s, "
+		<< per_second(s.num_cells, rec.end_to_end_seconds) << " cells/s" << endl;
+
+	cout << "  segments:     " << s.num_segments << ", "
+		<< per_second(s.num_segments, post_march) << " segments/s (weld to normals)" << endl;
+
+	if (rec.analysed)
+		cout << "  dimensions:   " << rec.result.curvature_dimension << " (curvature), " << rec.result.box_counting_dimension << " (box-counting)" << endl;
+	else
+		cout << "  dimensions:   n/a" << endl;
+
+	if (rec.smoothed)
+	{
+		const pipeline_stats& ss = rec.smoothed_stats;
+
+		const double percent = (0 == s.num_segments) ? 0 : 100.0 * ss.num_segments / static_cast<double>(s.num_segments);
+
+		cout << "  smoothed:     " << ss.num_segments << " segments (" << percent << "%), "
+			<< rec.smoothed_seconds << " s end-to-end, of which " << ss.get_stage_time("smooth") << " s smoothing" << endl;
+		cout << "  dimensions:   " << rec.smoothed_result.curvature_dimension << " (curvature), " << rec.smoothed_result.box_counting_dimension << " (box-counting), smoothed" << endl;
+	}
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		const pipeline_stats& ps = rec.post_march_stats[i];
+
+		cout << ((0 == i) ? "  row order:    " : "  Z-order:      ") << rec.post_march_seconds[i] << " s (";
+
+		if (1 == i)
+			cout << "reorder " << ps.get_stage_time("reorder") << " s, ";
+
+		cout << "adjacency " << ps.get_stage_time("adjacency") << " s, walk " << ps.get_stage_time("walk") << " s)";
+
+		if (rec.cache_misses_available)
+			cout << ", " << rec.post_march_cache_misses[i] << " cache misses";
+
+		cout << endl;
+	}
+
+	if (rec.cache_misses_available && 0 != rec.post_march_cache_misses[0])
+		cout << "  cache misses: " << 100.0 * (static_cast<double>(rec.post_march_cache_misses[1]) / static_cast<double>(rec.post_march_cache_misses[0]) - 1.0) << "% in Z-order" << endl;
+	else
+		cout << "  cache misses: n/a (no hardware counters)" << endl;
+
+	cout << "  peak memory:  " << rec.peak_resident_memory / (1024.0 * 1024.0) << " MiB" << endl;
+	cout << endl;
+}
+
+void write_json_records(ofstream& out, const vector<bench_record>& records)
+{
+	out << "[" << '\n';
+
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		const bench_record& rec = records[i];
+
+		out << "{\"name\": \"" << rec.name << "\", \"px\": " << rec.px
+			<< ", \"input_seconds\": " << rec.generate_seconds
+			<< ", \"end_to_end_seconds\": " << rec.end_to_end_seconds
+			<< ", \"peak_resident_bytes\": " << rec.peak_resident_memory
+			<< ", \"march_seconds\": {";
+
+		for (size_t j = 0; j < rec.march_seconds.size(); j++)
+		{
+			out << "\"" << rec.march_seconds[j].first << "\": " << rec.march_seconds[j].second;
+
+			if (j + 1 < rec.march_seconds.size())
+				out << ", ";
+		}
+
+		out << "}, \"stats\": ";
+		rec.stats.write_json(out);
+
+		out << ", \"post_march_seconds\": " << rec.post_march_seconds[0]
+			<< ", \"morton_post_march_seconds\": " << rec.post_march_seconds[1]
+			<< ", \"morton_reorder_seconds\": " << rec.post_march_stats[1].get_stage_time("reorder");
+
+		if (rec.cache_misses_available)
+		{
+			out << ", \"post_march_cache_misses\": " << rec.post_march_cache_misses[0]
+				<< ", \"morton_post_march_cache_misses\": " << rec.post_march_cache_misses[1];
+		}
+
+		if (rec.smoothed)
+		{
+			out << ", \"smoothed_seconds\": " << rec.smoothed_seconds << ", \"smoothed_stats\": ";
+			rec.smoothed_stats.write_json(out);
+		}
+
+		out << "}";
+
+		if (i + 1 < records.size())
+			out << ',';
+
+		out << '\n';
+	}
+
+	out << "]" << '\n';
+}
+
+
+int main(int argc, char **argv)
+{
+	bench_options opts;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (0 == strcmp(argv[i], "--samples") && i + 1 < argc)
+			opts.samples_dir = argv[++i];
+		else if (0 == strcmp(argv[i], "--min-size") && i + 1 < argc)
+			opts.min_size = static_cast<size_t>(atoi(argv[++i]));
+		else if (0 == strcmp(argv[i], "--max-size") && i + 1 < argc)
+			opts.max_size = static_cast<size_t>(atoi(argv[++i]));
+		else if (0 == strcmp(argv[i], "--repeat") && i + 1 < argc)
+			opts.repeat = static_cast<size_t>(atoi(argv[++i]));
+		else if (0 == strcmp(argv[i], "--json") && i + 1 < argc)
+			opts.json_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--smooth") && i + 2 < argc)
+		{
+			opts.smoothing_name = argv[++i];
+
+			if (false == opts.kernel.set(opts.smoothing_name, atof(argv[++i])))
+			{
+				cout << "Unknown smoothing filter: " << opts.smoothing_name << endl;
+				return 1;
+			}
+		}
+		else if (0 == strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			istringstream iss(argv[++i]);
+			string token;
+
+			while (std::getline(iss, token, ','))
+				opts.thread_counts.push_back(static_cast<size_t>(atoi(token.c_str())));
+		}
+		else
+		{
+			cout << "Unknown option: " << argv[i] << endl;
+			return 1;
+		}
+	}
+
+	if (0 == opts.repeat)
+		opts.repeat = 1;
+
+	// Default to 1, 2, 4, ... threads, up to the number of cores
+	if (opts.thread_counts.empty())
+	{
+		const size_t num_cores = get_num_threads(0);
+
+		for (size_t n = 1; n < num_cores; n *= 2)
+			opts.thread_counts.push_back(n);
+
+		opts.thread_counts.push_back(num_cores);
+	}
+
+	// Sizes are powers of two; float_grayscale holds at most 65535 x 65535
+	if (opts.max_size > 32768)
+		opts.max_size = 32768;
+
+	vector<bench_record> records;
+
+	// The bundled sample images
+	const char* sample_names[] = { "cat", "figure1", "small_mandelbrot", "smalldot", "threedots" };
+
+	for (size_t i = 0; i < sizeof(sample_names) / sizeof(sample_names[0]); i++)
+	{
+		const string filename = opts.samples_dir + "/" + sample_names[i] + ".tga";
+
+		{
+			ifstream test(filename.c_str(), ios::binary);
+
+			if (!test.is_open())
+			{
+				cout << "Skipping " << filename << " (not found)" << endl;
+				continue;
+			}
+		}
+
+		reset_peak_resident_memory();
+
+		bench_record rec;
+		rec.name = sample_names[i];
+
+		tga t;
+		float_grayscale luma;
+
+		if (false == convert_tga_to_float_grayscale(filename.c_str(), t, luma, false, true, true, &rec.stats))
+			continue;
+
+		rec.px = luma.px;
+
+		// Not needed past this point
+		t.pixel_data.clear();
+		t.pixel_data.shrink_to_fit();
+
+		run_bench(luma, opts, rec);
+		print_record(rec);
+		records.push_back(rec);
+	}
+
+	// Procedurally generated images
+	const char* synthetic_names[] = { "mandelbrot", "julia", "disks", "koch" };
+
+	for (size_t px = opts.min_size; px <= opts.max_size; px *= 2)
+	{
+		for (size_t i = 0; i < sizeof(synthetic_names) / sizeof(synthetic_names[0]); i++)
+		{
+			reset_peak_resident_memory();
+
+			bench_record rec;
+			rec.name = synthetic_names[i];
+			rec.px = px;
+
+			float_grayscale luma;
+			const unsigned short int spx = static_cast<unsigned short int>(px);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			if (0 == i)
+				generate_mandelbrot(luma, spx);
+			else if (1 == i)
+				generate_julia(luma, spx);
+			else if (2 == i)
+				generate_random_disks(luma, spx, 200, 1234);
+			else
+				generate_koch_snowflake(luma, spx, 7);
+
+			rec.generate_seconds = get_seconds_since(start);
+
+			run_bench(luma, opts, rec);
+			print_record(rec);
+			records.push_back(rec);
+		}
+	}
+
+	if (0 != opts.json_filename)
+	{
+		ofstream out(opts.json_filename);
+
+		if (!out.is_open())
+		{
+			cout << "Error writing " << opts.json_filename << endl;
+			return 2;
+		}
+
+		write_json_records(out, records);
+	}
+
+	return 0;
+}
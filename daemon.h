@@ -0,0 +1,606 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+
+// Long-running analysis server, listening on a Unix domain socket
+//
+// Each connection carries one request, as a line of text, and gets one
+// JSON reply, after which the connection is closed:
+//
+//   file filename [isovalue]      analyse a 24-bit TGA file
+//   buffer px py [isovalue]       analyse px*py native-endian 32-bit floats
+//                                 (row-major, top row first), which follow
+//                                 the request line
+//   ping                          check that the server is up
+//   shutdown                      stop the server
+//
+// The isovalue defaults to 0.5; otsu, mean or percentile p choose it from
+// the histogram of the image (see isovalue.h). Requests run on a fixed pool
+// of worker threads, each of which keeps its own image and line segment
+// buffers from one request to the next, so that their memory is only
+// allocated once
+// Connections that arrive while the queue is full are answered with a
+// "busy" error straight away, and buffers larger than max_pixels (or that
+// can't be allocated) are answered with an error instead of taking down the
+// server
+
+
+#include "image.h"
+#include "isovalue.h"
+#include "primitives.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#ifndef _WIN32
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <deque>
+using std::deque;
+
+#include <sstream>
+using std::istringstream;
+using std::ostringstream;
+
+#include <thread>
+using std::thread;
+
+#include <mutex>
+using std::mutex;
+
+#include <condition_variable>
+using std::condition_variable;
+
+#include <new>
+
+#include <chrono>
+
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+// The longest request line that is accepted
+const size_t max_daemon_request_length = 4096;
+
+
+class daemon_parameters
+{
+public:
+
+	size_t num_workers;
+
+	// Connections that are held before the server answers "busy"
+	size_t max_queue;
+
+	// The largest buffer request (px * py) that is accepted
+	size_t max_pixels;
+
+	// As for the command line's --border
+	bool black_border;
+	bool virtual_border;
+
+	daemon_parameters(void)
+	{
+		num_workers = 0;
+		max_queue = 64;
+		max_pixels = 8192 * 8192;
+		black_border = false;
+		virtual_border = true;
+	}
+};
+
+
+// Buffers that a worker reuses from one request to the next
+class daemon_arena
+{
+public:
+
+	daemon_arena(void)
+	{
+		lsd.quiet = true;
+		lsd.stats = &stats;
+	}
+
+	// Free the buffers, after a request that ran out of memory
+	void release(void)
+	{
+		t = tga();
+		luma = float_grayscale();
+		histogram = luma_histogram();
+		lsd = line_segment_data();
+		lsd.quiet = true;
+		lsd.stats = &stats;
+	}
+
+	tga t;
+	float_grayscale luma;
+	luma_histogram histogram;
+	line_segment_data lsd;
+	pipeline_stats stats;
+};
+
+
+// One accepted connection, waiting for a worker
+class daemon_connection
+{
+public:
+
+	int fd;
+	std::chrono::steady_clock::time_point accepted;
+};
+
+
+bool send_all(const int fd, const string& s)
+{
+	size_t sent = 0;
+
+	while (sent < s.size())
+	{
+		const ssize_t n = send(fd, s.c_str() + sent, s.size() - sent, 0);
+
+		if (n <= 0)
+			return false;
+
+		sent += static_cast<size_t>(n);
+	}
+
+	return true;
+}
+
+bool recv_all(const int fd, char* const dst, const size_t count)
+{
+	size_t received = 0;
+
+	while (received < count)
+	{
+		const ssize_t n = recv(fd, dst + received, count - received, 0);
+
+		if (n <= 0)
+			return false;
+
+		received += static_cast<size_t>(n);
+	}
+
+	return true;
+}
+
+// Read up to (but not including) the next newline, one byte at a time, so
+// that nothing past the request line is consumed
+bool recv_line(const int fd, string& line)
+{
+	line.clear();
+
+	char c = 0;
+
+	while (line.size() < max_daemon_request_length)
+	{
+		if (false == recv_all(fd, &c, 1))
+			return false;
+
+		if ('\n' == c)
+			return true;
+
+		if ('\r' != c)
+			line += c;
+	}
+
+	return false;
+}
+
+// Close a connection without reading its request
+// Whatever the client has already sent is discarded first, since closing
+// with unread data resets the connection before the client sees the reply
+void close_unread(const int fd)
+{
+	shutdown(fd, SHUT_WR);
+
+	char buffer[4096];
+
+	while (0 < recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT))
+	{
+	}
+
+	close(fd);
+}
+
+string get_json_string(const string& s)
+{
+	string out = "\"";
+
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		if ('"' == s[i] || '\\' == s[i])
+		{
+			out += '\\';
+			out += s[i];
+		}
+		else if (static_cast<unsigned char>(s[i]) < 0x20)
+		{
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(s[i])));
+			out += buffer;
+		}
+		else
+		{
+			out += s[i];
+		}
+	}
+
+	return out + "\"";
+}
+
+string get_daemon_error(const string& message)
+{
+	return "{\"status\": \"error\", \"message\": " + get_json_string(message) + "}\n";
+}
+
+
+class analysis_daemon
+{
+public:
+
+	analysis_daemon(const daemon_parameters& src_params)
+	{
+		params = src_params;
+		num_workers = get_num_threads(params.num_workers);
+		max_queue = params.max_queue;
+		listen_fd = -1;
+		stopping = false;
+
+		if (0 == max_queue)
+			max_queue = 1;
+	}
+
+	~analysis_daemon(void)
+	{
+		if (-1 != listen_fd)
+		{
+			close(listen_fd);
+			unlink(socket_path.c_str());
+		}
+	}
+
+	// Listen on socket_path, and serve requests until a shutdown request
+	bool run(const char* const src_socket_path)
+	{
+		socket_path = src_socket_path;
+
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+
+		if (socket_path.size() >= sizeof(address.sun_path))
+		{
+			cerr << "Socket path is too long: " << socket_path << endl;
+			return false;
+		}
+
+		strcpy(address.sun_path, socket_path.c_str());
+
+		// A client that goes away mid-reply must not take the server with it
+		signal(SIGPIPE, SIG_IGN);
+
+		listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (-1 == listen_fd)
+		{
+			cerr << "Failed to create socket" << endl;
+			return false;
+		}
+
+		unlink(socket_path.c_str());
+
+		if (0 != bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ||
+			0 != listen(listen_fd, static_cast<int>(max_queue)))
+		{
+			cerr << "Failed to listen on " << socket_path << endl;
+			return false;
+		}
+
+		vector<thread> workers;
+
+		for (size_t i = 0; i < num_workers; i++)
+			workers.push_back(thread(&analysis_daemon::work, this));
+
+		while (true)
+		{
+			const int fd = accept(listen_fd, 0, 0);
+
+			{
+				std::lock_guard<mutex> lock(queue_mutex);
+
+				if (stopping)
+				{
+					if (-1 != fd)
+						close(fd);
+
+					break;
+				}
+			}
+
+			if (-1 == fd)
+				continue;
+
+			// Don't let a stalled client hold on to a worker forever
+			timeval timeout;
+			timeout.tv_sec = 30;
+			timeout.tv_usec = 0;
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+			daemon_connection c;
+			c.fd = fd;
+			c.accepted = std::chrono::steady_clock::now();
+
+			bool queued = false;
+
+			{
+				std::lock_guard<mutex> lock(queue_mutex);
+
+				if (queue.size() < max_queue)
+				{
+					queue.push_back(c);
+					queued = true;
+				}
+			}
+
+			if (queued)
+			{
+				queue_condition.notify_one();
+			}
+			else
+			{
+				// Wait (briefly) for the request line, so that the client
+				// is listening for the reply by the time that it is sent
+				timeout.tv_sec = 1;
+				setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+				string line;
+				recv_line(fd, line);
+
+				send_all(fd, get_daemon_error("busy"));
+				close_unread(fd);
+			}
+		}
+
+		queue_condition.notify_all();
+
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+
+		return true;
+	}
+
+private:
+
+	void work(void)
+	{
+		daemon_arena arena;
+
+		while (true)
+		{
+			daemon_connection c;
+
+			{
+				std::unique_lock<mutex> lock(queue_mutex);
+
+				while (!stopping && queue.empty())
+					queue_condition.wait(lock);
+
+				if (queue.empty())
+					return;
+
+				c = queue.front();
+				queue.pop_front();
+			}
+
+			std::chrono::duration<double> queue_seconds = std::chrono::steady_clock::now() - c.accepted;
+
+			send_all(c.fd, handle_request(c.fd, arena, queue_seconds.count()));
+			close(c.fd);
+		}
+	}
+
+	void stop(void)
+	{
+		{
+			std::lock_guard<mutex> lock(queue_mutex);
+			stopping = true;
+		}
+
+		queue_condition.notify_all();
+
+		// Wake up the accept() in run()
+		const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (-1 != fd)
+		{
+			sockaddr_un address;
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			strcpy(address.sun_path, socket_path.c_str());
+
+			connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+			close(fd);
+		}
+	}
+
+	string handle_request(const int fd, daemon_arena& arena, const double queue_seconds)
+	{
+		try
+		{
+			return analyse_request(fd, arena, queue_seconds);
+		}
+		catch (const std::bad_alloc&)
+		{
+			// Don't hold on to whatever was allocated before the failure
+			arena.release();
+			return get_daemon_error("out of memory");
+		}
+	}
+
+	string analyse_request(const int fd, daemon_arena& arena, const double queue_seconds)
+	{
+		string line;
+
+		if (false == recv_line(fd, line))
+			return get_daemon_error("could not read the request line");
+
+		istringstream iss(line);
+		string command;
+		iss >> command;
+
+		if ("ping" == command)
+			return "{\"status\": \"ok\"}\n";
+
+		if ("shutdown" == command)
+		{
+			stop();
+			return "{\"status\": \"ok\"}\n";
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		arena.stats.clear();
+
+		isovalue_parameters isovalue_params;
+		string filename;
+		size_t px = 0, py = 0;
+
+		if ("file" == command && !(iss >> filename))
+			return get_daemon_error("file requests need a filename");
+
+		if ("buffer" == command && !(iss >> px >> py))
+			return get_daemon_error("buffer requests need px and py");
+
+		string isovalue_name;
+
+		if (iss >> isovalue_name)
+		{
+			if (false == isovalue_params.set(isovalue_name.c_str()))
+				return get_daemon_error("unknown isovalue: " + isovalue_name);
+
+			if (isovalue_parameters::percentile_isovalue == isovalue_params.method && !(iss >> isovalue_params.percentile))
+				return get_daemon_error("percentile isovalues need a percentile");
+		}
+
+		arena.histogram.clear();
+		luma_histogram* const histogram = isovalue_params.is_automatic() ? &arena.histogram : 0;
+
+		if ("file" == command)
+		{
+			if (false == convert_tga_to_float_grayscale(filename.c_str(), arena.t, arena.luma, params.black_border, true, true, &arena.stats, histogram))
+				return get_daemon_error("could not read " + filename);
+		}
+		else if ("buffer" == command)
+		{
+			// Checked before anything is allocated
+			if (px > 65535 || py > 65535 || px * py > params.max_pixels)
+				return get_daemon_error("buffer is too large");
+
+			stage_timer timer(&arena.stats, "load");
+
+			arena.luma.px = static_cast<unsigned short int>(px);
+			arena.luma.py = static_cast<unsigned short int>(py);
+			arena.luma.pixel_data.resize(px * py);
+
+			if (0 != px * py && false == recv_all(fd, reinterpret_cast<char*>(&arena.luma.pixel_data[0]), px * py * sizeof(float)))
+				return get_daemon_error("buffer is short");
+
+			if (params.black_border && 0 != px * py)
+				make_black_border(arena.luma);
+
+			if (0 != histogram && 0 != px * py)
+				histogram->add(&arena.luma.pixel_data[0], px * py);
+		}
+		else
+		{
+			return get_daemon_error("unknown request: " + command);
+		}
+
+		if (arena.luma.px < 3 || arena.luma.py < 3)
+			return get_daemon_error("image must be at least 3x3 pixels in size");
+
+		grid_parameters gp;
+		gp.set(arena.luma.px, arena.luma.py, get_isovalue(isovalue_params, arena.histogram));
+		gp.virtual_border = params.virtual_border;
+
+		analysis_result result;
+
+		// The workers already use every core, so each request marches on one thread
+		if (false == analyse_grayscale(arena.luma, gp, arena.lsd, result, 1))
+			return get_daemon_error("could not calculate the curvatures");
+
+		std::chrono::duration<double> run_seconds = std::chrono::steady_clock::now() - start;
+
+		ostringstream out;
+		out << "{\"status\": \"ok\"";
+
+		if (!filename.empty())
+			out << ", \"file\": " << get_json_string(filename);
+
+		out << ", \"px\": " << arena.luma.px << ", \"py\": " << arena.luma.py
+			<< ", \"isovalue\": " << result.isovalue
+			<< ", \"curvature\": " << result.curvature
+			<< ", \"curvature_standard_deviation\": " << result.curvature_standard_deviation
+			<< ", \"curvature_dimension\": " << result.curvature_dimension
+			<< ", \"box_counting_dimension\": " << result.box_counting_dimension
+			<< ", \"box_count\": " << result.box_count
+			<< ", \"open_contours\": " << arena.lsd.get_num_open_contours()
+			<< ", \"queue_seconds\": " << queue_seconds
+			<< ", \"run_seconds\": " << run_seconds.count()
+			<< ", \"stats\": ";
+
+		arena.stats.peak_resident_memory = get_peak_resident_memory();
+		arena.stats.write_json(out);
+		out << "}" << '\n';
+
+		return out.str();
+	}
+
+	daemon_parameters params;
+	size_t num_workers;
+	size_t max_queue;
+	string socket_path;
+	int listen_fd;
+
+	mutex queue_mutex;
+	condition_variable queue_condition;
+	deque<daemon_connection> queue;
+	bool stopping;
+};
+
+
+bool run_daemon(const char* const socket_path, const daemon_parameters& params)
+{
+	analysis_daemon d(params);
+
+	return d.run(socket_path);
+}
+
+#else
+
+bool run_daemon(const char* const socket_path, const daemon_parameters& params)
+{
+	cerr << "Daemon mode needs Unix domain sockets" << endl;
+	return false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,340 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+
+// The signed distance field of the contours, at the image's resolution
+//
+// Each pixel gets the exact distance, in pixels, from its grid corner to the
+// nearest line segment; it is negative inside of the contours (where the
+// march classes the pixel as at or above the isovalue), and positive outside
+//
+// The pixels are handled a square tile at a time, the tiles being shared
+// among the threads. For a tile of half-diagonal h whose centre is d away from
+// the nearest line segment, no pixel of the tile is more than d + h away from
+// a line segment, so only the line segments within d + 2h of the centre can
+// be the nearest to any of its pixels. Those are fetched once per tile from a
+// segment_grid, and then each pixel only tests them. The previous tile along
+// the row bounds d from both sides, so the fetch only visits the cells of a
+// thin annulus, even far from the contours
+
+
+#include "image.h"
+#include "image_source.h"
+#include "primitives.h"
+#include "pipeline.h"
+#include "spatial_index.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+using std::thread;
+
+#include <algorithm>
+using std::sort;
+
+#include <cfloat>
+#include <cmath>
+
+
+class distance_field_parameters
+{
+public:
+
+	distance_field_parameters(void)
+	{
+		tile_size = 8;
+		cell_size = 8;
+		num_threads = 0;
+	}
+
+	// Pixels per tile side
+	size_t tile_size;
+
+	// Pixels per segment_grid cell side
+	size_t cell_size;
+
+	size_t num_threads;
+};
+
+
+// A line segment near a tile, ready for the per-pixel tests
+class distance_candidate
+{
+public:
+
+	inline bool operator<(const distance_candidate& right) const
+	{
+		return centre_distance < right.centre_distance;
+	}
+
+	// The distance from the tile's centre
+	double centre_distance;
+
+	double x, y;
+	double dx, dy;
+
+	// 1 / (dx * dx + dy * dy), or 0 for a point
+	double inverse_length_squared;
+};
+
+
+// Replace the luma of the tiles in rows [first, first + step, ...) of tiles
+// with the signed distances
+template<typename T>
+void get_distance_field_tiles(const segment_grid_t<T>& grid, const vector<T>& xs, const vector<T>& ys, const size_t pad, const grid_parameters& gp, const size_t tile_size, const size_t first, const size_t step, float_grayscale& field)
+{
+	const size_t tiles_x = (field.px + tile_size - 1) / tile_size;
+	const size_t tiles_y = (field.py + tile_size - 1) / tile_size;
+	const float isovalue = static_cast<float>(gp.isovalue);
+
+	vector<size_t> found;
+	vector<distance_candidate> candidates;
+
+	for (size_t ty = first; ty < tiles_y; ty += step)
+	{
+		// The previous tile's centre and nearest line segment
+		double previous_x = 0, previous_y = 0, previous_d = 0;
+		size_t previous_nearest = 0;
+
+		for (size_t tx = 0; tx < tiles_x; tx++)
+		{
+			const size_t x_begin = tx * tile_size;
+			const size_t y_begin = ty * tile_size;
+			const size_t x_end = (x_begin + tile_size < field.px) ? x_begin + tile_size : field.px;
+			const size_t y_end = (y_begin + tile_size < field.py) ? y_begin + tile_size : field.py;
+
+			// The centre and half-diagonal of the tile's pixel corners
+			const double x0 = xs[x_begin + pad], x1 = xs[x_end - 1 + pad];
+			const double y0 = ys[y_begin + pad], y1 = ys[y_end - 1 + pad];
+			const double cx = (x0 + x1) / 2.0, cy = (y0 + y1) / 2.0;
+			const double h = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0)) / 2.0;
+
+			// The distance d from the centre to the nearest line segment is
+			// at least the previous tile's, less the distance between the
+			// centres, and at most the distance to the previous tile's nearest
+			// line segment, so the line segments within d + 2h are all in an
+			// annulus around the centre
+			double inner = 0, outer = 0;
+
+			if (0 == tx)
+			{
+				inner = grid.get_nearest(cx, cy, previous_nearest);
+
+				if (DBL_MAX == inner)
+					inner = outer = -1;
+				else
+					outer = inner;
+			}
+			else if (DBL_MAX == previous_d)
+			{
+				// The previous tile found no line segments, so neither will this one
+				inner = outer = -1;
+			}
+			else
+			{
+				const double shift = sqrt((cx - previous_x) * (cx - previous_x) + (cy - previous_y) * (cy - previous_y));
+
+				inner = (previous_d > shift) ? previous_d - shift : 0;
+				outer = sqrt(get_segment_distance_squared((*grid.segments)[previous_nearest], cx, cy));
+			}
+
+			found.clear();
+
+			// With a little slack either way, for the rounding
+			if (outer >= 0)
+				grid.get_within(cx, cy, (outer + 2.0 * h) * (1.0 + 1e-9), found, inner * (1.0 - 1e-9));
+
+			candidates.resize(found.size());
+
+			double d = DBL_MAX;
+
+			for (size_t i = 0; i < found.size(); i++)
+			{
+				const line_segment_t<T>& ls = (*grid.segments)[found[i]];
+				distance_candidate& c = candidates[i];
+
+				c.centre_distance = sqrt(get_segment_distance_squared(ls, cx, cy));
+				c.x = ls.vertex[0].x;
+				c.y = ls.vertex[0].y;
+				c.dx = static_cast<double>(ls.vertex[1].x) - c.x;
+				c.dy = static_cast<double>(ls.vertex[1].y) - c.y;
+
+				const double length_squared = c.dx * c.dx + c.dy * c.dy;
+				c.inverse_length_squared = (length_squared > 0) ? 1.0 / length_squared : 0;
+
+				if (c.centre_distance < d)
+				{
+					d = c.centre_distance;
+					previous_nearest = found[i];
+				}
+			}
+
+			previous_x = cx;
+			previous_y = cy;
+			previous_d = d;
+
+			// Keep the ones within d + 2h
+			size_t num_candidates = 0;
+
+			for (size_t i = 0; i < candidates.size(); i++)
+				if (candidates[i].centre_distance <= (d + 2.0 * h) * (1.0 + 1e-9))
+					candidates[num_candidates++] = candidates[i];
+
+			candidates.resize(num_candidates);
+
+			// Nearest to the centre first, so that each pixel can stop as soon
+			// as the rest are too far away: no pixel is closer to a line segment
+			// than the line segment's distance from the centre, less the
+			// pixel's distance from the centre
+			sort(candidates.begin(), candidates.end());
+
+			for (size_t y = y_begin; y < y_end; y++)
+			{
+				float* const row = &field.pixel_data[y * field.px];
+
+				for (size_t x = x_begin; x < x_end; x++)
+				{
+					const double px = xs[x + pad], py = ys[y + pad];
+					const double r = sqrt((px - cx) * (px - cx) + (py - cy) * (py - cy));
+					double best = DBL_MAX;
+					double best_distance = DBL_MAX;
+
+					for (size_t i = 0; i < candidates.size(); i++)
+					{
+						const distance_candidate& c = candidates[i];
+
+						if (c.centre_distance - r > best_distance)
+							break;
+
+						double t = ((px - c.x) * c.dx + (py - c.y) * c.dy) * c.inverse_length_squared;
+						t = (t < 0) ? 0 : ((t > 1) ? 1 : t);
+
+						const double ex = c.x + t * c.dx - px;
+						const double ey = c.y + t * c.dy - py;
+						const double s = ex * ex + ey * ey;
+
+						if (s < best)
+						{
+							best = s;
+							best_distance = sqrt(s);
+						}
+					}
+
+					const float distance = (DBL_MAX == best) ? FLT_MAX : static_cast<float>(best_distance / gp.step_size);
+
+					row[x] = (row[x] >= isovalue) ? -distance : distance;
+				}
+			}
+		}
+	}
+}
+
+// The signed distance field of lsd's line segments, which were marched from
+// src with gp; field has src's size
+// FLT_MAX (with the sign) everywhere if there are no line segments
+// Returns false if the source could not be read
+template<typename T>
+bool get_distance_field(image_source& src, const grid_parameters& gp, const line_segment_data_t<T>& lsd, float_grayscale& field, const distance_field_parameters& dp, pipeline_stats* const stats = 0)
+{
+	// The sign comes from the pixels themselves
+	if (false == read_image_source(src, field))
+		return false;
+
+	if (lsd.line_segments.empty())
+	{
+		const float isovalue = static_cast<float>(gp.isovalue);
+
+		for (size_t i = 0; i < field.pixel_data.size(); i++)
+			field.pixel_data[i] = (field.pixel_data[i] >= isovalue) ? -FLT_MAX : FLT_MAX;
+
+		return true;
+	}
+
+	segment_grid_t<T> grid;
+
+	{
+		stage_timer timer(stats, "index");
+		grid.build(lsd.line_segments, gp.step_size * static_cast<double>(dp.cell_size > 0 ? dp.cell_size : 1), dp.num_threads);
+	}
+
+	stage_timer timer(stats, "distance field");
+
+	vector<T> xs, ys;
+	get_grid_coordinates(gp, field.px, field.py, xs, ys);
+
+	const size_t pad = gp.virtual_border ? 1 : 0;
+	const size_t tile_size = (dp.tile_size > 0) ? dp.tile_size : 1;
+	const size_t tiles_y = (field.py + tile_size - 1) / tile_size;
+	const size_t n = get_num_threads(dp.num_threads);
+
+	if (1 == n || tiles_y < 2)
+	{
+		get_distance_field_tiles(grid, xs, ys, pad, gp, tile_size, 0, 1, field);
+		return true;
+	}
+
+	const size_t num_tile_threads = (n < tiles_y) ? n : tiles_y;
+	vector<thread> threads;
+
+	for (size_t i = 0; i < num_tile_threads; i++)
+		threads.push_back(thread(get_distance_field_tiles<T>, std::cref(grid), std::cref(xs), std::cref(ys), pad, std::cref(gp), tile_size, i, num_tile_threads, std::ref(field)));
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	return true;
+}
+
+// Compare up to num_samples of the field's pixels, spread over the image,
+// against their distances to every one of the line segments
+// Returns true if the magnitudes agree to within the float rounding
+template<typename T>
+bool validate_distance_field(const grid_parameters& gp, const line_segment_data_t<T>& lsd, const float_grayscale& field, const size_t num_samples, double& max_difference)
+{
+	max_difference = 0;
+
+	const size_t num_pixels = field.pixel_data.size();
+
+	if (0 == num_pixels || 0 == num_samples)
+		return true;
+
+	vector<T> xs, ys;
+	get_grid_coordinates(gp, field.px, field.py, xs, ys);
+
+	const size_t pad = gp.virtual_border ? 1 : 0;
+	const size_t stride = (num_pixels > num_samples) ? num_pixels / num_samples : 1;
+	bool valid = true;
+
+	for (size_t i = 0; i < num_pixels; i += stride)
+	{
+		const size_t x = i % field.px, y = i / field.px;
+		double best = DBL_MAX;
+
+		for (size_t j = 0; j < lsd.line_segments.size(); j++)
+		{
+			const double s = get_segment_distance_squared(lsd.line_segments[j], xs[x + pad], ys[y + pad]);
+
+			if (s < best)
+				best = s;
+		}
+
+		const double expected = (DBL_MAX == best) ? FLT_MAX : sqrt(best) / gp.step_size;
+		const double difference = fabs(fabs(field.pixel_data[i]) - expected);
+
+		if (difference > max_difference)
+			max_difference = difference;
+
+		if (difference > 1e-5 * ((expected > 1) ? expected : 1))
+			valid = false;
+	}
+
+	return valid;
+}
+
+#endif
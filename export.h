@@ -0,0 +1,540 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+
+// Geometry exporters
+//
+// write_geometry_file() writes the processed line segment data as a binary
+// file that can be memory mapped and used in place:
+//
+//   geometry_file_header            (64 bytes)
+//   geometry_file_section[n]        (32 bytes each)
+//   section data, each section starting on a 64 byte boundary
+//
+// All values are in the byte order of the machine that wrote the file
+// (geometry_file_header::byte_order_mark tells), and T is float or double
+// as given by geometry_file_header::scalar_size
+//
+// write_svg() and write_csv() are plain text alternatives, for small cases
+
+
+#include "primitives.h"
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+#include <fstream>
+using std::ofstream;
+
+#include <ios>
+using std::ios;
+
+#include <string>
+using std::string;
+
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+
+enum geometry_section_id
+{
+	geometry_vertices = 1,          // T x, y per welded vertex
+	geometry_segments = 2,          // uint32_t vertex index pair per line segment
+	geometry_adjacency = 3,         // uint32_t neighbour pair per line segment, geometry_no_neighbour if none
+	geometry_face_normals = 4,      // T x, y per line segment
+	geometry_curvatures = 5,        // T per line segment
+	geometry_contour_offsets = 6,   // uint64_t per contour, plus one; index into geometry_contour_segments
+	geometry_contour_segments = 7,  // uint32_t line segment index, in walk order
+	geometry_contour_closed = 8     // uint8_t per contour, 1 if closed
+};
+
+const uint32_t geometry_no_neighbour = 0xFFFFFFFFu;
+const uint32_t geometry_file_version = 1;
+const uint64_t geometry_section_alignment = 64;
+
+
+class geometry_file_header
+{
+public:
+
+	char magic[8];              // "MSGEOM\0\0"
+	uint32_t version;
+	uint32_t byte_order_mark;   // 0x01020304
+	uint32_t scalar_size;       // sizeof(T)
+	uint32_t num_sections;
+	uint64_t num_vertices;
+	uint64_t num_segments;
+	uint64_t num_contours;
+	uint64_t reserved[2];
+};
+
+class geometry_file_section
+{
+public:
+
+	uint32_t id;                // geometry_section_id
+	uint32_t element_size;      // Bytes per element
+	uint64_t offset;            // From the start of the file
+	uint64_t count;             // Elements
+	uint64_t size;              // Bytes
+};
+
+
+// Accumulates output in a large buffer, so that the file sees a few large
+// sequential writes rather than one small write per element
+class buffered_writer
+{
+public:
+
+	buffered_writer(ofstream& src_out, const size_t src_capacity = 1 << 20) : out(src_out)
+	{
+		capacity = src_capacity;
+		buffer.reserve(capacity);
+		written = 0;
+	}
+
+	~buffered_writer(void)
+	{
+		flush();
+	}
+
+	void write(const void* const data, const size_t size)
+	{
+		if (buffer.size() + size > capacity)
+			flush();
+
+		// Big blocks go straight through
+		if (size >= capacity)
+		{
+			out.write(static_cast<const char*>(data), size);
+			written += size;
+			return;
+		}
+
+		const char* const p = static_cast<const char*>(data);
+		buffer.insert(buffer.end(), p, p + size);
+		written += size;
+	}
+
+	template<typename V>
+	void write_value(const V& value)
+	{
+		write(&value, sizeof(value));
+	}
+
+	void pad_to(const uint64_t offset)
+	{
+		static const char zeros[geometry_section_alignment] = { 0 };
+
+		while (written < offset)
+		{
+			size_t n = static_cast<size_t>(offset - written);
+
+			if (n > sizeof(zeros))
+				n = sizeof(zeros);
+
+			write(zeros, n);
+		}
+	}
+
+	void flush(void)
+	{
+		if (!buffer.empty())
+			out.write(&buffer[0], buffer.size());
+
+		buffer.clear();
+	}
+
+	uint64_t get_written(void) const
+	{
+		return written;
+	}
+
+private:
+
+	ofstream& out;
+	vector<char> buffer;
+	size_t capacity;
+	uint64_t written;
+};
+
+
+inline uint64_t get_aligned_offset(const uint64_t offset)
+{
+	return (offset + geometry_section_alignment - 1) / geometry_section_alignment * geometry_section_alignment;
+}
+
+
+// Write the line segment data, after process_line_segments(), as a geometry file
+template<typename T>
+bool write_geometry_file(const char* const filename, const line_segment_data_t<T>& lsd)
+{
+	const size_t num_segments = lsd.line_segments.size();
+	const size_t num_contours = lsd.contour_closed.size();
+
+	if (lsd.vertices.size() >= geometry_no_neighbour || num_segments >= geometry_no_neighbour)
+	{
+		cerr << "Too many vertices or line segments for a geometry file" << endl;
+		return false;
+	}
+
+	if (lsd.face_normals.size() != num_segments || lsd.segment_curvatures.size() != num_segments)
+	{
+		cerr << "The line segments have not been processed" << endl;
+		return false;
+	}
+
+	ofstream out(filename, ios::binary);
+
+	if (!out.is_open())
+	{
+		cerr << "Failed to open geometry file: " << filename << endl;
+		return false;
+	}
+
+	// Lay out the sections
+	const uint32_t ids[] = { geometry_vertices, geometry_segments, geometry_adjacency, geometry_face_normals, geometry_curvatures, geometry_contour_offsets, geometry_contour_segments, geometry_contour_closed };
+	const uint32_t element_sizes[] = { 2 * sizeof(T), 2 * sizeof(uint32_t), 2 * sizeof(uint32_t), 2 * sizeof(T), sizeof(T), sizeof(uint64_t), sizeof(uint32_t), sizeof(uint8_t) };
+	const uint64_t counts[] = { lsd.vertices.size(), num_segments, num_segments, num_segments, num_segments, lsd.contour_offsets.size(), lsd.contour_segments.size(), num_contours };
+	const size_t num_sections = sizeof(ids) / sizeof(ids[0]);
+
+	geometry_file_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "MSGEOM\0\0", 8);
+	header.version = geometry_file_version;
+	header.byte_order_mark = 0x01020304;
+	header.scalar_size = sizeof(T);
+	header.num_sections = static_cast<uint32_t>(num_sections);
+	header.num_vertices = lsd.vertices.size();
+	header.num_segments = num_segments;
+	header.num_contours = num_contours;
+
+	vector<geometry_file_section> sections(num_sections);
+	uint64_t offset = sizeof(header) + num_sections * sizeof(geometry_file_section);
+
+	for (size_t i = 0; i < num_sections; i++)
+	{
+		offset = get_aligned_offset(offset);
+
+		sections[i].id = ids[i];
+		sections[i].element_size = element_sizes[i];
+		sections[i].offset = offset;
+		sections[i].count = counts[i];
+		sections[i].size = counts[i] * element_sizes[i];
+
+		offset += sections[i].size;
+	}
+
+	buffered_writer w(out);
+	w.write(&header, sizeof(header));
+	w.write(&sections[0], sections.size() * sizeof(geometry_file_section));
+
+	// Vertices
+	w.pad_to(sections[0].offset);
+
+	for (size_t i = 0; i < lsd.vertices.size(); i++)
+	{
+		w.write_value(lsd.vertices[i].x);
+		w.write_value(lsd.vertices[i].y);
+	}
+
+	// Segments
+	w.pad_to(sections[1].offset);
+
+	for (size_t i = 0; i < num_segments; i++)
+	{
+		w.write_value(static_cast<uint32_t>(lsd.line_segments[i].vertex[0].index));
+		w.write_value(static_cast<uint32_t>(lsd.line_segments[i].vertex[1].index));
+	}
+
+	// Adjacency
+	w.pad_to(sections[2].offset);
+
+	for (typename map<size_t, vector<size_t> >::const_iterator ci = lsd.line_segment_neighbours.begin(); ci != lsd.line_segment_neighbours.end(); ci++)
+	{
+		uint32_t n[2] = { geometry_no_neighbour, geometry_no_neighbour };
+
+		for (size_t j = 0; j < ci->second.size() && j < 2; j++)
+			n[j] = static_cast<uint32_t>(ci->second[j]);
+
+		w.write(n, sizeof(n));
+	}
+
+	// Face normals
+	w.pad_to(sections[3].offset);
+
+	for (size_t i = 0; i < num_segments; i++)
+	{
+		w.write_value(lsd.face_normals[i].x);
+		w.write_value(lsd.face_normals[i].y);
+	}
+
+	// Curvatures, contour offsets; already contiguous
+	w.pad_to(sections[4].offset);
+
+	if (0 != num_segments)
+		w.write(&lsd.segment_curvatures[0], num_segments * sizeof(T));
+
+	w.pad_to(sections[5].offset);
+
+	for (size_t i = 0; i < lsd.contour_offsets.size(); i++)
+		w.write_value(static_cast<uint64_t>(lsd.contour_offsets[i]));
+
+	w.pad_to(sections[6].offset);
+
+	for (size_t i = 0; i < lsd.contour_segments.size(); i++)
+		w.write_value(static_cast<uint32_t>(lsd.contour_segments[i]));
+
+	w.pad_to(sections[7].offset);
+
+	for (size_t i = 0; i < num_contours; i++)
+		w.write_value(static_cast<uint8_t>(lsd.contour_closed[i] ? 1 : 0));
+
+	w.flush();
+
+	if (!out.good())
+	{
+		cerr << "Failed to write geometry file: " << filename << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// A read-only memory mapping of a geometry file
+// The section data is used in place; nothing is copied or parsed
+class geometry_file_view
+{
+public:
+
+	geometry_file_view(void)
+	{
+		data = 0;
+		size = 0;
+	}
+
+	~geometry_file_view(void)
+	{
+		close();
+	}
+
+	bool open(const char* const filename)
+	{
+		close();
+
+#ifdef _WIN32
+		cerr << "Memory mapped geometry files are not supported on this platform" << endl;
+		return false;
+#else
+		const int fd = ::open(filename, O_RDONLY);
+
+		if (-1 == fd)
+			return false;
+
+		struct stat s;
+
+		if (0 != fstat(fd, &s) || static_cast<size_t>(s.st_size) < sizeof(geometry_file_header))
+		{
+			::close(fd);
+			return false;
+		}
+
+		void* const p = mmap(0, static_cast<size_t>(s.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+
+		if (MAP_FAILED == p)
+			return false;
+
+		data = static_cast<const char*>(p);
+		size = static_cast<size_t>(s.st_size);
+
+		const geometry_file_header& h = get_header();
+
+		if (0 != memcmp(h.magic, "MSGEOM\0\0", 8) || geometry_file_version != h.version || 0x01020304 != h.byte_order_mark ||
+			size < sizeof(geometry_file_header) + h.num_sections * sizeof(geometry_file_section))
+		{
+			close();
+			return false;
+		}
+
+		for (uint32_t i = 0; i < h.num_sections; i++)
+		{
+			const geometry_file_section& section = get_sections()[i];
+
+			if (section.offset + section.size > size)
+			{
+				close();
+				return false;
+			}
+		}
+
+		return true;
+#endif
+	}
+
+	void close(void)
+	{
+#ifndef _WIN32
+		if (0 != data)
+			munmap(const_cast<char*>(data), size);
+#endif
+		data = 0;
+		size = 0;
+	}
+
+	const geometry_file_header& get_header(void) const
+	{
+		return *reinterpret_cast<const geometry_file_header*>(data);
+	}
+
+	const geometry_file_section* get_sections(void) const
+	{
+		return reinterpret_cast<const geometry_file_section*>(data + sizeof(geometry_file_header));
+	}
+
+	// The data of a section, or 0 if there is no such section
+	template<typename E>
+	const E* get_section(const uint32_t id, uint64_t& count) const
+	{
+		count = 0;
+
+		for (uint32_t i = 0; 0 != data && i < get_header().num_sections; i++)
+		{
+			const geometry_file_section& section = get_sections()[i];
+
+			if (id == section.id)
+			{
+				count = section.count;
+				return reinterpret_cast<const E*>(data + section.offset);
+			}
+		}
+
+		return 0;
+	}
+
+private:
+
+	const char* data;
+	size_t size;
+};
+
+
+// Write the contours as SVG polylines (closed contours as polygons), in a
+// view box that matches the template
+template<typename T>
+bool write_svg(const char* const filename, const line_segment_data_t<T>& lsd, const double template_width, const double template_height)
+{
+	ofstream out(filename, ios::binary);
+
+	if (!out.is_open())
+	{
+		cerr << "Failed to open SVG file: " << filename << endl;
+		return false;
+	}
+
+	buffered_writer w(out);
+	char line[256];
+	int n = snprintf(line, sizeof(line), "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"%g %g %g %g\">\n<g fill=\"none\" stroke=\"black\" stroke-width=\"%g\">\n",
+		-template_width / 2.0, -template_height / 2.0, template_width, template_height, template_width / 1000.0);
+	w.write(line, static_cast<size_t>(n));
+
+	for (size_t c = 0; c + 1 < lsd.contour_offsets.size(); c++)
+	{
+		const char* const element = lsd.contour_closed[c] ? "<polygon points=\"" : "<polyline points=\"";
+		w.write(element, strlen(element));
+
+		const size_t begin = lsd.contour_offsets[c];
+		const size_t end = lsd.contour_offsets[c + 1];
+
+		for (size_t i = begin; i <= end; i++)
+		{
+			size_t vertex_index = 0;
+
+			if (i < end)
+				vertex_index = lsd.contour_vertices[i];
+			else if (!lsd.contour_closed[c])
+				vertex_index = lsd.get_end_vertex_index(end - 1);
+			else
+				break;
+
+			// SVG's y axis points down
+			const vertex_2_t<T>& v = lsd.vertices[vertex_index];
+			n = snprintf(line, sizeof(line), "%.9g,%.9g ", static_cast<double>(v.x), -static_cast<double>(v.y));
+			w.write(line, static_cast<size_t>(n));
+		}
+
+		w.write("\"/>\n", 4);
+	}
+
+	w.write("</g>\n</svg>\n", 12);
+	w.flush();
+
+	return out.good();
+}
+
+// Write one row per line segment: its end points, face normal, curvature and contour
+template<typename T>
+bool write_csv(const char* const filename, const line_segment_data_t<T>& lsd)
+{
+	ofstream out(filename, ios::binary);
+
+	if (!out.is_open())
+	{
+		cerr << "Failed to open CSV file: " << filename << endl;
+		return false;
+	}
+
+	buffered_writer w(out);
+
+	const char* const heading = "segment,x0,y0,x1,y1,normal_x,normal_y,curvature,contour\n";
+	w.write(heading, strlen(heading));
+
+	vector<size_t> contours(lsd.line_segments.size(), 0);
+
+	for (size_t c = 0; c + 1 < lsd.contour_offsets.size(); c++)
+		for (size_t i = lsd.contour_offsets[c]; i < lsd.contour_offsets[c + 1]; i++)
+			contours[lsd.contour_segments[i]] = c;
+
+	char line[512];
+
+	for (size_t i = 0; i < lsd.line_segments.size(); i++)
+	{
+		const line_segment_t<T>& ls = lsd.line_segments[i];
+
+		const int n = snprintf(line, sizeof(line), "%llu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%llu\n",
+			static_cast<unsigned long long>(i),
+			static_cast<double>(ls.vertex[0].x), static_cast<double>(ls.vertex[0].y),
+			static_cast<double>(ls.vertex[1].x), static_cast<double>(ls.vertex[1].y),
+			static_cast<double>(lsd.face_normals[i].x), static_cast<double>(lsd.face_normals[i].y),
+			static_cast<double>(lsd.segment_curvatures[i]),
+			static_cast<unsigned long long>(contours[i]));
+
+		w.write(line, static_cast<size_t>(n));
+	}
+
+	w.flush();
+
+	return out.good();
+}
+
+#endif
@@ -11,6 +11,10 @@ using std::vector;
 
 #include <fstream>
 using std::ifstream;
+using std::ofstream;
+
+#include <istream>
+using std::istream;
 
 #include <ios>
 using std::ios;
@@ -22,6 +26,9 @@ using std::endl;
 
 #include <cstring>
 
+#include "stats.h"
+#include "input_file.h"
+
 
 // http://www.paulbourke.net/dataformats/tga/
 class tga
@@ -77,6 +84,103 @@ public:
 	vector<float> pixel_data;
 };
 
+// Luma stored as integers, pre-scaled so that 1.0 maps to the largest value
+// of P (255 for unsigned char, 65535 for unsigned short int)
+template<typename P>
+class quantised_grayscale
+{
+public:
+
+    quantised_grayscale(void)
+    {
+        px = py = 0;
+    }
+
+	unsigned short int px;
+	unsigned short int py;
+	vector<P> pixel_data;
+};
+
+typedef quantised_grayscale<unsigned char> uint8_grayscale;
+typedef quantised_grayscale<unsigned short int> uint16_grayscale;
+
+
+// Histogram of the luma, gathered as the pixels are converted so that an
+// isovalue can be chosen without going back over the image (see isovalue.h)
+//
+// The bins cover 0 to 1; values outside of that (from float input) are
+// counted in the end bins, though the sum is exact
+class luma_histogram
+{
+public:
+
+	static const size_t num_bins = 4096;
+
+	luma_histogram(void)
+	{
+		clear();
+	}
+
+	void clear(void)
+	{
+		bins.assign(num_bins, 0);
+		count = 0;
+		sum = 0;
+	}
+
+	void add(const float value)
+	{
+		size_t bin = 0;
+
+		if (value >= 1.0f)
+			bin = num_bins - 1;
+		else if (value > 0.0f)
+			bin = static_cast<size_t>(value * num_bins);
+
+		bins[bin]++;
+		count++;
+		sum += value;
+	}
+
+	void add(const unsigned char value)
+	{
+		add(value / 255.0f);
+	}
+
+	void add(const unsigned short int value)
+	{
+		add(value / 65535.0f);
+	}
+
+	template<typename P>
+	void add(const P* const values, const size_t num_values)
+	{
+		for (size_t i = 0; i < num_values; i++)
+			add(values[i]);
+	}
+
+	vector<size_t> bins;
+	size_t count;
+	double sum;
+};
+
+
+// Overwrite the outermost pixels with black
+void make_black_border(float_grayscale& l)
+{
+	for (size_t x = 0; x < l.px; x++)
+	{
+		l.pixel_data[x] = 0;
+		l.pixel_data[(l.py - 1) * static_cast<size_t>(l.px) + x] = 0;
+	}
+
+	for (size_t y = 0; y < l.py; y++)
+	{
+		l.pixel_data[y * static_cast<size_t>(l.px)] = 0;
+		l.pixel_data[y * static_cast<size_t>(l.px) + l.px - 1] = 0;
+	}
+}
+
 
 float int_rgb_to_float_grayscale(const unsigned char r, const unsigned char g, const unsigned char b)
 {
@@ -86,16 +190,49 @@ float int_rgb_to_float_grayscale(const unsigned char r, const unsigned char g, c
 		+ 0.0722f * (static_cast<float>(b) / 255.0f);
 }
 
-bool convert_tga_to_float_grayscale(const char* const filename, tga& t, float_grayscale& l, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order)
+// The largest quantised luma value
+template<typename P>
+unsigned int get_quantised_max(void);
+
+template<>
+unsigned int get_quantised_max<unsigned char>(void)
 {
-	// http://www.paulbourke.net/dataformats/tga/
-	ifstream in(filename, ios::binary);
+	return 255;
+}
 
-	if (!in.is_open())
-	{
-		cerr << "Failed to open TGA file: " << filename << endl;
-		return false;
-	}
+template<>
+unsigned int get_quantised_max<unsigned short int>(void)
+{
+	return 65535;
+}
+
+// The BT.709 weights in 16-bit fixed point; they sum to exactly 65536
+unsigned int int_rgb_to_fixed_point_grayscale(const unsigned char r, const unsigned char g, const unsigned char b)
+{
+	return 13933u * r + 46871u * g + 4732u * b;
+}
+
+void int_rgb_to_grayscale(const unsigned char r, const unsigned char g, const unsigned char b, float& value)
+{
+	value = int_rgb_to_float_grayscale(r, g, b);
+}
+
+void int_rgb_to_grayscale(const unsigned char r, const unsigned char g, const unsigned char b, unsigned char& value)
+{
+	value = static_cast<unsigned char>((int_rgb_to_fixed_point_grayscale(r, g, b) + 32768u) >> 16);
+}
+
+void int_rgb_to_grayscale(const unsigned char r, const unsigned char g, const unsigned char b, unsigned short int& value)
+{
+	// 65535 / 255 = 257; the largest product (255 * 65536 * 257) fits in 32 bits
+	value = static_cast<unsigned short int>((int_rgb_to_fixed_point_grayscale(r, g, b) * 257u + 32768u) >> 16);
+}
+
+// Read a 24-bit uncompressed TGA image from a stream, leaving the pixels in
+// BGR order
+bool read_tga(istream& in, tga& t, const bool make_black_border, const bool reverse_rows, pipeline_stats* const stats = 0)
+{
+	// http://www.paulbourke.net/dataformats/tga/
 
 	// Read in header, including variable length image descriptor
 	in.read(reinterpret_cast<char*>(&t.idlength), 1);
@@ -133,9 +270,17 @@ bool convert_tga_to_float_grayscale(const char* const filename, tga& t, float_gr
 
 		// Read all pixels at once
 		size_t num_bytes = static_cast<size_t>(t.px)* static_cast<size_t>(t.py) * 3;
+
+		stage_timer timer(stats, "load");
 		t.pixel_data.resize(num_bytes);
 		in.read(reinterpret_cast<char*>(&t.pixel_data[0]), num_bytes);
 
+		if (static_cast<size_t>(in.gcount()) != num_bytes)
+		{
+			cerr << "TGA file is short." << endl;
+			return false;
+		}
+
 		if (true == reverse_rows)
 		{
 			// Reverse row order
@@ -175,28 +320,135 @@ bool convert_tga_to_float_grayscale(const char* const filename, tga& t, float_gr
 				}
 			}
 		}
+	}
 
-		// Fill floating point grayscale image.
-		l.px = t.px;
-		l.py = t.py;
-		l.pixel_data.resize(num_bytes / 3, 0);
+	return true;
+}
 
-		for (size_t index = 0; index < num_bytes; index += 3)
-		{
-			if (reverse_pixel_byte_order)
-			{
-				// Swap red and blue pixels.
-				unsigned char temp = t.pixel_data[index];
-				t.pixel_data[index] = t.pixel_data[index + 2];
-				t.pixel_data[index + 2] = temp;
-			}
+// Read a 24-bit uncompressed TGA file; "-" is standard input, and
+// "archive.zip:member.tga" a member of a zip archive
+bool read_tga(const char* const filename, tga& t, const bool make_black_border, const bool reverse_rows, pipeline_stats* const stats = 0)
+{
+	input_file in;
 
-			// Convert to luma.
-			l.pixel_data[index / 3] = int_rgb_to_float_grayscale(t.pixel_data[index], t.pixel_data[index + 1], t.pixel_data[index + 2]);
+	if (false == in.open(filename))
+	{
+		cerr << "Failed to open TGA file: " << filename << endl;
+		return false;
+	}
+
+	return read_tga(in.get_stream(), t, make_black_border, reverse_rows, stats);
+}
+
+// Read a TGA file into any grayscale image with px, py and pixel_data members
+// If histogram is given, the luma is added to it as it is converted
+template<typename L>
+bool convert_tga_to_grayscale(const char* const filename, tga& t, L& l, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, pipeline_stats* const stats = 0, luma_histogram* const histogram = 0)
+{
+	if (false == read_tga(filename, t, make_black_border, reverse_rows, stats))
+		return false;
+
+	stage_timer timer(stats, "luma");
+
+	const size_t num_bytes = t.pixel_data.size();
+
+	// Fill grayscale image.
+	l.px = t.px;
+	l.py = t.py;
+	l.pixel_data.resize(num_bytes / 3, 0);
+
+	for (size_t index = 0; index < num_bytes; index += 3)
+	{
+		if (reverse_pixel_byte_order)
+		{
+			// Swap red and blue pixels.
+			unsigned char temp = t.pixel_data[index];
+			t.pixel_data[index] = t.pixel_data[index + 2];
+			t.pixel_data[index + 2] = temp;
 		}
+
+		// Convert to luma.
+		int_rgb_to_grayscale(t.pixel_data[index], t.pixel_data[index + 1], t.pixel_data[index + 2], l.pixel_data[index / 3]);
+
+		if (0 != histogram)
+			histogram->add(l.pixel_data[index / 3]);
 	}
 
 	return true;
 }
 
+// Write an uncompressed 24-bit TGA file; pixel_data is BGR, bottom row first
+bool write_tga(const char* const filename, const tga& t)
+{
+	ofstream out(filename, ios::binary);
+
+	if (!out.is_open())
+	{
+		cerr << "Failed to open TGA file: " << filename << endl;
+		return false;
+	}
+
+	const size_t num_bytes = static_cast<size_t>(t.px) * static_cast<size_t>(t.py) * 3;
+
+	if (2 != t.datatypecode || 24 != t.bitsperpixel || t.pixel_data.size() != num_bytes)
+	{
+		cerr << "TGA file must be in uncompressed/non-RLE 24-bit RGB format." << endl;
+		return false;
+	}
+
+	// The header, field by field, since the class has padding
+	out.write(reinterpret_cast<const char*>(&t.idlength), 1);
+	out.write(reinterpret_cast<const char*>(&t.colourmaptype), 1);
+	out.write(reinterpret_cast<const char*>(&t.datatypecode), 1);
+	out.write(reinterpret_cast<const char*>(&t.colourmaporigin), 2);
+	out.write(reinterpret_cast<const char*>(&t.colourmaplength), 2);
+	out.write(reinterpret_cast<const char*>(&t.colourmapdepth), 1);
+	out.write(reinterpret_cast<const char*>(&t.x_origin), 2);
+	out.write(reinterpret_cast<const char*>(&t.y_origin), 2);
+	out.write(reinterpret_cast<const char*>(&t.px), 2);
+	out.write(reinterpret_cast<const char*>(&t.py), 2);
+	out.write(reinterpret_cast<const char*>(&t.bitsperpixel), 1);
+	out.write(reinterpret_cast<const char*>(&t.imagedescriptor), 1);
+
+	if (0 != t.idlength)
+		out.write(&t.idstring[0], t.idlength);
+
+	if (0 != num_bytes)
+		out.write(reinterpret_cast<const char*>(&t.pixel_data[0]), num_bytes);
+
+	return out.good();
+}
+
+// Write a float image as a greyscale Portable Float Map
+// Row 0 is the top row, as in the luma; PFM files start from the bottom row
+bool write_pfm(const char* const filename, const float_grayscale& l)
+{
+	ofstream out(filename, ios::binary);
+
+	if (!out.is_open())
+	{
+		cerr << "Failed to open PFM file: " << filename << endl;
+		return false;
+	}
+
+	// A negative scale means little-endian
+	out << "Pf\n" << l.px << " " << l.py << "\n-1.0\n";
+
+	for (size_t y = l.py; y > 0; y--)
+		out.write(reinterpret_cast<const char*>(&l.pixel_data[(y - 1) * l.px]), l.px * sizeof(float));
+
+	return out.good();
+}
+
+bool convert_tga_to_float_grayscale(const char* const filename, tga& t, float_grayscale& l, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, pipeline_stats* const stats = 0, luma_histogram* const histogram = 0)
+{
+	return convert_tga_to_grayscale(filename, t, l, make_black_border, reverse_rows, reverse_pixel_byte_order, stats, histogram);
+}
+
+template<typename P>
+bool convert_tga_to_quantised_grayscale(const char* const filename, tga& t, quantised_grayscale<P>& l, const bool make_black_border, const bool reverse_rows, const bool reverse_pixel_byte_order, pipeline_stats* const stats = 0, luma_histogram* const histogram = 0)
+{
+	return convert_tga_to_grayscale(filename, t, l, make_black_border, reverse_rows, reverse_pixel_byte_order, stats, histogram);
+}
+
 #endif
@@ -0,0 +1,574 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef IMAGE_FORMATS_H
+#define IMAGE_FORMATS_H
+
+
+// Grayscale images other than 24-bit TGA, from a file, a member of a zip
+// archive ("archive.zip:member") or standard input ("-"):
+//
+//   PGM (P5):     8 or 16 bits per pixel (the 16-bit samples are big-endian),
+//                 scaled to 0 to 1 by the header's maximum value
+//   PFM (Pf, PF): 32-bit floats, bottom row first, used as is; the three
+//                 channels of PF are converted to BT.709 luma
+//   raw:          headerless native-endian float32 or uint16 samples, top
+//                 row first, with the size given by the caller
+//
+// The format is told from the first bytes of the stream, and anything else
+// is taken to be a TGA. Images may follow one another on the same stream,
+// so a producer can pipe in any number of frames (a TGA can only be followed
+// by another image if it has no TGA 2.0 extension area or footer, since
+// those come after the pixels)
+
+
+#include "image.h"
+#include "image_source.h"
+#include "input_file.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <istream>
+using std::istream;
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+
+// The layout of the samples of a PGM, PFM or raw image
+class pixel_stream_format
+{
+public:
+
+	enum sample_type
+	{
+		uint8_samples,
+		uint16_samples,
+		float32_samples
+	};
+
+	pixel_stream_format(void)
+	{
+		type = float32_samples;
+		px = py = 0;
+		channels = 1;
+		big_endian = !is_little_endian_host();
+		bottom_up = false;
+		max_value = 1;
+	}
+
+	size_t get_sample_size(void) const
+	{
+		if (uint8_samples == type)
+			return 1;
+		else if (uint16_samples == type)
+			return 2;
+
+		return 4;
+	}
+
+	size_t get_row_size(void) const
+	{
+		return px * channels * get_sample_size();
+	}
+
+	static bool is_little_endian_host(void)
+	{
+		const unsigned short int one = 1;
+		return 1 == *reinterpret_cast<const unsigned char*>(&one);
+	}
+
+	sample_type type;
+	size_t px, py;
+	size_t channels;
+	bool big_endian;
+	bool bottom_up;
+	double max_value;
+};
+
+
+// The format of a raw image: "float32" or "uint16", native-endian
+bool set_raw_format(const char* const type, const size_t px, const size_t py, pixel_stream_format& f)
+{
+	f = pixel_stream_format();
+	f.px = px;
+	f.py = py;
+
+	if (0 == strcmp(type, "float32"))
+	{
+		f.type = pixel_stream_format::float32_samples;
+	}
+	else if (0 == strcmp(type, "uint16"))
+	{
+		f.type = pixel_stream_format::uint16_samples;
+		f.max_value = 65535;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// The next whitespace-separated token of a PGM or PFM header, skipping
+// comments
+bool read_header_token(istream& in, string& token)
+{
+	token.clear();
+
+	int c = in.get();
+
+	while (EOF != c && (isspace(c) || '#' == c))
+	{
+		if ('#' == c)
+			while (EOF != c && '\n' != c)
+				c = in.get();
+
+		c = in.get();
+	}
+
+	while (EOF != c && !isspace(c))
+	{
+		token += static_cast<char>(c);
+		c = in.get();
+	}
+
+	// The single whitespace character after the token is consumed too,
+	// which is where the samples start after the last field
+	return !token.empty() && EOF != c;
+}
+
+bool read_header_size(istream& in, pixel_stream_format& f)
+{
+	string w, h;
+
+	if (false == read_header_token(in, w) || false == read_header_token(in, h))
+		return false;
+
+	f.px = static_cast<size_t>(strtoull(w.c_str(), 0, 10));
+	f.py = static_cast<size_t>(strtoull(h.c_str(), 0, 10));
+
+	return 0 != f.px && 0 != f.py;
+}
+
+// Whether the size in a PGM or PFM header is one that can be read: no more
+// than 65535 x 65535 pixels, as for a TGA, and, if the stream can seek, no
+// more samples than are left in it
+bool is_header_size_valid(istream& in, const pixel_stream_format& f)
+{
+	if (f.px > 65535 || f.py > 65535)
+		return false;
+
+	const size_t row_size = f.get_row_size();
+
+	if (row_size > static_cast<size_t>(-1) / f.py)
+		return false;
+
+	const std::streampos here = in.tellg();
+
+	// Pipes, and zip members, can't tell how much is left
+	if (std::streampos(-1) == here)
+	{
+		in.clear();
+		return true;
+	}
+
+	in.seekg(0, ios::end);
+	const std::streampos end = in.tellg();
+	in.clear();
+	in.seekg(here);
+
+	if (std::streampos(-1) == end)
+		return true;
+
+	return static_cast<unsigned long long>(end - here) >= static_cast<unsigned long long>(row_size) * f.py;
+}
+
+// The rest of a PGM header, after "P5"
+bool read_pgm_header(istream& in, pixel_stream_format& f)
+{
+	// http://netpbm.sourceforge.net/doc/pgm.html
+	f = pixel_stream_format();
+
+	string max_value;
+
+	if (false == read_header_size(in, f) || false == read_header_token(in, max_value))
+	{
+		cerr << "PGM header is invalid." << endl;
+		return false;
+	}
+
+	f.max_value = atof(max_value.c_str());
+
+	if (f.max_value < 1 || f.max_value > 65535)
+	{
+		cerr << "PGM maximum value must be 1 to 65535." << endl;
+		return false;
+	}
+
+	f.type = (f.max_value < 256) ? pixel_stream_format::uint8_samples : pixel_stream_format::uint16_samples;
+	f.big_endian = true;
+
+	if (false == is_header_size_valid(in, f))
+	{
+		cerr << "PGM header is invalid." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+// The rest of a PFM header, after "Pf" or "PF"
+bool read_pfm_header(istream& in, const bool colour, pixel_stream_format& f)
+{
+	// http://www.pauldebevec.com/Research/HDR/PFM/
+	f = pixel_stream_format();
+
+	string scale;
+
+	if (false == read_header_size(in, f) || false == read_header_token(in, scale))
+	{
+		cerr << "PFM header is invalid." << endl;
+		return false;
+	}
+
+	// A negative scale means little-endian
+	f.type = pixel_stream_format::float32_samples;
+	f.channels = colour ? 3 : 1;
+	f.big_endian = (atof(scale.c_str()) >= 0);
+	f.bottom_up = true;
+
+	if (false == is_header_size_valid(in, f))
+	{
+		cerr << "PFM header is invalid." << endl;
+		return false;
+	}
+
+	return true;
+}
+
+// Convert num_pixels pixels of samples, as they are in the stream, to luma
+void convert_samples(const unsigned char* const src, const size_t num_pixels, const pixel_stream_format& f, float* const dst)
+{
+	const size_t sample_size = f.get_sample_size();
+	const size_t num_samples = num_pixels * f.channels;
+	const bool swap = (f.big_endian == pixel_stream_format::is_little_endian_host());
+	const float scale = static_cast<float>(1.0 / f.max_value);
+
+	float rgb[3] = { 0, 0, 0 };
+
+	for (size_t i = 0; i < num_samples; i++)
+	{
+		unsigned char b[4];
+
+		for (size_t j = 0; j < sample_size; j++)
+			b[j] = src[i * sample_size + (swap ? sample_size - 1 - j : j)];
+
+		float value = 0;
+
+		if (pixel_stream_format::uint8_samples == f.type)
+		{
+			value = b[0] * scale;
+		}
+		else if (pixel_stream_format::uint16_samples == f.type)
+		{
+			unsigned short int v;
+			memcpy(&v, b, 2);
+			value = v * scale;
+		}
+		else
+		{
+			memcpy(&value, b, 4);
+		}
+
+		if (1 == f.channels)
+		{
+			dst[i] = value;
+			continue;
+		}
+
+		rgb[i % 3] = value;
+
+		// http://www.itu.int/rec/R-REC-BT.709/en
+		if (2 == i % 3)
+			dst[i / 3] = 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+	}
+}
+
+
+// The rows of a PGM, PFM or raw image, converted to luma as they are read
+// from a stream, in the order that they are stored
+//
+// Rows can only be asked for in increasing order, since a pipe can't go
+// back; the rows of a bottom-up image come out bottom row first
+// If histogram is given, the rows are added to it as they are converted
+class stream_image_source : public image_source
+{
+public:
+
+	stream_image_source(istream& src, const pixel_stream_format& src_format, pipeline_stats* const src_stats = 0, luma_histogram* const src_histogram = 0) : in(src)
+	{
+		f = src_format;
+		stats = src_stats;
+		histogram = src_histogram;
+		next_row = 0;
+	}
+
+	size_t get_px(void) const
+	{
+		return f.px;
+	}
+
+	size_t get_py(void) const
+	{
+		return f.py;
+	}
+
+	bool get_rows(const size_t y_begin, const size_t count, float* const dst)
+	{
+		if (y_begin + count > f.py || y_begin < next_row)
+			return false;
+
+		if (0 == count || 0 == f.px)
+			return true;
+
+		const size_t row_size = f.get_row_size();
+
+		{
+			stage_timer timer(stats, "load");
+
+			buffer.resize(count * row_size);
+
+			for (; next_row < y_begin; next_row++)
+				if (false == read_bytes(&buffer[0], row_size))
+					return false;
+
+			if (false == read_bytes(&buffer[0], count * row_size))
+				return false;
+
+			next_row += count;
+		}
+
+		stage_timer timer(stats, "luma");
+
+		convert_samples(&buffer[0], count * f.px, f, dst);
+
+		if (0 != histogram)
+			histogram->add(dst, count * f.px);
+
+		return true;
+	}
+
+private:
+
+	bool read_bytes(unsigned char* const dst, const size_t num_bytes)
+	{
+		in.read(reinterpret_cast<char*>(dst), num_bytes);
+
+		if (static_cast<size_t>(in.gcount()) != num_bytes)
+		{
+			cerr << "Image file is short." << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	istream& in;
+	pixel_stream_format f;
+	pipeline_stats* stats;
+	luma_histogram* histogram;
+	size_t next_row;
+	vector<unsigned char> buffer;
+};
+
+
+// A file, or standard input, holding one image after another
+class image_input
+{
+public:
+
+	image_input(void)
+	{
+		in = 0;
+		raw = false;
+		tga_format = false;
+		end = false;
+	}
+
+	// Open filename ("-" for standard input, "archive.zip:member" for a
+	// member of a zip archive); if raw_format is given, the images are raw,
+	// in that format
+	bool open(const char* const src_filename, const pixel_stream_format* const raw_format = 0)
+	{
+		filename = src_filename;
+
+		if (false == file.open(src_filename))
+		{
+			cerr << "Failed to open image file: " << filename << endl;
+			return false;
+		}
+
+		set_stream(raw_format);
+
+		return true;
+	}
+
+	// Open a member of an archive that is already open
+	bool open(const zip_archive& archive, const size_t index, const pixel_stream_format* const raw_format = 0)
+	{
+		filename = archive.get_filename() + ":" + archive.get_entry(index).name;
+
+		if (false == file.open(archive, index))
+			return false;
+
+		set_stream(raw_format);
+
+		return true;
+	}
+
+	// Find the format of the next image, and read its header
+	// Returns false at the end of the stream (see at_end()) or on an error
+	bool read_header(void)
+	{
+		tga_format = false;
+
+		const int c = in->peek();
+
+		if (EOF == c)
+		{
+			end = true;
+			return false;
+		}
+
+		if (raw)
+			return true;
+
+		// A TGA starts with the length of its ID, so the header is left
+		// for read_tga()
+		if ('P' != c)
+		{
+			tga_format = true;
+			return true;
+		}
+
+		in->get();
+		const int m = in->get();
+
+		if ('5' == m)
+			return read_pgm_header(*in, format);
+		else if ('f' == m || 'F' == m)
+			return read_pfm_header(*in, 'F' == m, format);
+
+		cerr << "Unknown image format: " << filename << endl;
+		return false;
+	}
+
+	bool at_end(void) const
+	{
+		return end;
+	}
+
+	// The header of the next image is a TGA's
+	bool is_tga(void) const
+	{
+		return tga_format;
+	}
+
+	// Whether the image can be marched as it is read from the stream
+	bool is_streamable(void) const
+	{
+		return !tga_format && !format.bottom_up;
+	}
+
+	const pixel_stream_format& get_format(void) const
+	{
+		return format;
+	}
+
+	istream& get_stream(void)
+	{
+		return *in;
+	}
+
+	const string& get_filename(void) const
+	{
+		return filename;
+	}
+
+private:
+
+	void set_stream(const pixel_stream_format* const raw_format)
+	{
+		in = &file.get_stream();
+
+		if (0 != raw_format)
+		{
+			raw = true;
+			format = *raw_format;
+		}
+	}
+
+	string filename;
+	input_file file;
+	istream* in;
+	bool raw;
+	bool tga_format;
+	bool end;
+	pixel_stream_format format;
+};
+
+
+// Read the image whose header was just read, as a whole, top row first
+// If histogram is given, the luma is added to it as it is converted
+bool read_image_input(image_input& input, tga& t, float_grayscale& l, const bool make_black_border, pipeline_stats* const stats = 0, luma_histogram* const histogram = 0)
+{
+	if (input.is_tga())
+	{
+		if (false == read_tga(input.get_stream(), t, make_black_border, true, stats))
+			return false;
+
+		tga_luma_source src(t, true, stats, histogram);
+
+		return read_image_source(src, l);
+	}
+
+	const pixel_stream_format& f = input.get_format();
+	stream_image_source src(input.get_stream(), f, stats, histogram);
+
+	if (false == read_image_source(src, l))
+		return false;
+
+	if (f.bottom_up)
+	{
+		for (size_t y = 0; y < l.py / 2; y++)
+			std::swap_ranges(l.pixel_data.begin() + y * l.px, l.pixel_data.begin() + (y + 1) * l.px, l.pixel_data.begin() + (l.py - 1 - y) * l.px);
+	}
+
+	if (make_black_border && l.px > 0 && l.py > 0)
+		::make_black_border(l);
+
+	return true;
+}
+
+// Read the next image from the input
+// Returns false at the end of the input (see image_input::at_end()) or on
+// an error
+bool read_next_image(image_input& input, tga& t, float_grayscale& l, const bool make_black_border, pipeline_stats* const stats = 0, luma_histogram* const histogram = 0)
+{
+	if (false == input.read_header())
+		return false;
+
+	return read_image_input(input, t, l, make_black_border, stats, histogram);
+}
+
+#endif
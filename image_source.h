@@ -0,0 +1,377 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef IMAGE_SOURCE_H
+#define IMAGE_SOURCE_H
+
+
+#include "image.h"
+
+#include <vector>
+using std::vector;
+
+
+// A grayscale image that the march consumes row by row
+//
+// Rows are always requested in increasing order, so a source can
+// generate (or decode) them on the fly instead of holding the whole
+// image in memory
+class image_source
+{
+public:
+
+	virtual ~image_source(void)
+	{
+	}
+
+	virtual size_t get_px(void) const = 0;
+	virtual size_t get_py(void) const = 0;
+
+	// Write rows [y_begin, y_begin + count) into dst, which holds count*px floats
+	virtual bool get_rows(const size_t y_begin, const size_t count, float* const dst) = 0;
+
+	// The address of row y, if the whole image is already in memory
+	// Returns 0 if the rows have to be fetched with get_rows()
+	virtual const float* get_row_pointer(const size_t /* y */) const
+	{
+		return 0;
+	}
+
+	// Write the w x h window at (x, y) into dst, which holds w*h floats
+	//
+	// Unlike rows, windows may be asked for in any order. This fetches whole
+	// rows, so sources that can make part of a row cheaply should override it
+	virtual bool get_window(const size_t x, const size_t y, const size_t w, const size_t h, float* const dst)
+	{
+		const size_t px = get_px();
+
+		if (x + w > px || y + h > get_py())
+			return false;
+
+		if (0 == w || 0 == h)
+			return true;
+
+		if (0 != get_row_pointer(0))
+		{
+			for (size_t i = 0; i < h; i++)
+				memcpy(dst + i * w, get_row_pointer(y + i) + x, w * sizeof(float));
+
+			return true;
+		}
+
+		vector<float> rows(h * px);
+
+		if (false == get_rows(y, h, &rows[0]))
+			return false;
+
+		for (size_t i = 0; i < h; i++)
+			memcpy(dst + i * w, &rows[i * px + x], w * sizeof(float));
+
+		return true;
+	}
+};
+
+
+// Adapts an in-memory float_grayscale image; no rows are copied
+class float_grayscale_source : public image_source
+{
+public:
+
+	float_grayscale_source(const float_grayscale& src) : l(src)
+	{
+	}
+
+	size_t get_px(void) const
+	{
+		return l.px;
+	}
+
+	size_t get_py(void) const
+	{
+		return l.py;
+	}
+
+	bool get_rows(const size_t y_begin, const size_t count, float* const dst)
+	{
+		if (y_begin + count > l.py)
+			return false;
+
+		memcpy(dst, &l.pixel_data[y_begin * l.px], count * l.px * sizeof(float));
+
+		return true;
+	}
+
+	const float* get_row_pointer(const size_t y) const
+	{
+		return &l.pixel_data[y * l.px];
+	}
+
+private:
+
+	const float_grayscale& l;
+};
+
+
+// Converts the rows of a tga to luma as they are requested, so that the
+// whole of the float image never exists; the pixels are as left by read_tga()
+// If histogram is given, the rows (but not the windows) are added to it
+class tga_luma_source : public image_source
+{
+public:
+
+	tga_luma_source(const tga& src, const bool src_reverse_pixel_byte_order, pipeline_stats* const src_stats = 0, luma_histogram* const src_histogram = 0) : t(src)
+	{
+		reverse_pixel_byte_order = src_reverse_pixel_byte_order;
+		stats = src_stats;
+		histogram = src_histogram;
+	}
+
+	size_t get_px(void) const
+	{
+		return t.px;
+	}
+
+	size_t get_py(void) const
+	{
+		return t.py;
+	}
+
+	bool get_rows(const size_t y_begin, const size_t count, float* const dst)
+	{
+		if (y_begin + count > t.py)
+			return false;
+
+		stage_timer timer(stats, "luma");
+
+		convert(&t.pixel_data[y_begin * t.px * 3], count * t.px, dst);
+
+		if (0 != histogram)
+			histogram->add(dst, count * t.px);
+
+		return true;
+	}
+
+	bool get_window(const size_t x, const size_t y, const size_t w, const size_t h, float* const dst)
+	{
+		if (x + w > t.px || y + h > t.py)
+			return false;
+
+		for (size_t i = 0; i < h; i++)
+			convert(&t.pixel_data[((y + i) * t.px + x) * 3], w, dst + i * w);
+
+		return true;
+	}
+
+private:
+
+	void convert(const unsigned char* const p, const size_t num_pixels, float* const dst) const
+	{
+		// The file is BGR
+		const size_t r = reverse_pixel_byte_order ? 2 : 0;
+		const size_t b = 2 - r;
+
+		for (size_t i = 0; i < num_pixels; i++)
+			int_rgb_to_grayscale(p[i * 3 + r], p[i * 3 + 1], p[i * 3 + b], dst[i]);
+	}
+
+	const tga& t;
+	bool reverse_pixel_byte_order;
+	pipeline_stats* stats;
+	luma_histogram* histogram;
+};
+
+
+// A rectangular window onto another source, for tiles and crops
+//
+// Resident sources are windowed in place; the others are fetched at their
+// full width and then cropped
+class crop_source : public image_source
+{
+public:
+
+	crop_source(image_source& src, const size_t src_x, const size_t src_y, const size_t src_px, const size_t src_py) : s(src)
+	{
+		x0 = src_x;
+		y0 = src_y;
+		px = src_px;
+		py = src_py;
+
+		// Clamp the window to the source
+		if (x0 > s.get_px())
+			x0 = s.get_px();
+
+		if (y0 > s.get_py())
+			y0 = s.get_py();
+
+		if (x0 + px > s.get_px())
+			px = s.get_px() - x0;
+
+		if (y0 + py > s.get_py())
+			py = s.get_py() - y0;
+	}
+
+	size_t get_px(void) const
+	{
+		return px;
+	}
+
+	size_t get_py(void) const
+	{
+		return py;
+	}
+
+	bool get_rows(const size_t y_begin, const size_t count, float* const dst)
+	{
+		if (y_begin + count > py)
+			return false;
+
+		if (0 == count || 0 == px)
+			return true;
+
+		if (0 != s.get_row_pointer(0))
+		{
+			for (size_t i = 0; i < count; i++)
+				memcpy(dst + i * px, s.get_row_pointer(y0 + y_begin + i) + x0, px * sizeof(float));
+
+			return true;
+		}
+
+		const size_t src_px = s.get_px();
+		row_buffer.resize(count * src_px);
+
+		if (false == s.get_rows(y0 + y_begin, count, &row_buffer[0]))
+			return false;
+
+		for (size_t i = 0; i < count; i++)
+			memcpy(dst + i * px, &row_buffer[i * src_px + x0], px * sizeof(float));
+
+		return true;
+	}
+
+	const float* get_row_pointer(const size_t y) const
+	{
+		if (y >= py || 0 == px)
+			return 0;
+
+		const float* const row = s.get_row_pointer(y0 + y);
+
+		if (0 == row)
+			return 0;
+
+		return row + x0;
+	}
+
+private:
+
+	image_source& s;
+	size_t x0, y0, px, py;
+	vector<float> row_buffer;
+};
+
+
+// Pixels in a buffer that belongs to someone else, with rows stride bytes
+// apart; nothing is copied up front
+//
+// Float pixels are marched straight from the buffer, if they are aligned;
+// RGB pixels are converted to luma as the rows are asked for
+class pixel_buffer_source : public image_source
+{
+public:
+
+	enum pixel_format
+	{
+		float_pixels,
+		rgb_pixels
+	};
+
+	pixel_buffer_source(const void* const src_pixels, const size_t src_px, const size_t src_py, const size_t src_stride, const pixel_format src_format)
+	{
+		pixels = static_cast<const unsigned char*>(src_pixels);
+		px = src_px;
+		py = src_py;
+		stride = src_stride;
+		format = src_format;
+	}
+
+	size_t get_px(void) const
+	{
+		return px;
+	}
+
+	size_t get_py(void) const
+	{
+		return py;
+	}
+
+	bool get_rows(const size_t y_begin, const size_t count, float* const dst)
+	{
+		return get_window(0, y_begin, px, count, dst);
+	}
+
+	bool get_window(const size_t x, const size_t y, const size_t w, const size_t h, float* const dst)
+	{
+		if (x + w > px || y + h > py)
+			return false;
+
+		for (size_t i = 0; i < h; i++)
+		{
+			const unsigned char* const row = pixels + (y + i) * stride;
+
+			if (float_pixels == format)
+			{
+				memcpy(dst + i * w, row + x * sizeof(float), w * sizeof(float));
+				continue;
+			}
+
+			for (size_t j = 0; j < w; j++)
+			{
+				const unsigned char* const p = row + (x + j) * 3;
+				int_rgb_to_grayscale(p[0], p[1], p[2], dst[i * w + j]);
+			}
+		}
+
+		return true;
+	}
+
+	const float* get_row_pointer(const size_t y) const
+	{
+		if (float_pixels != format || y >= py)
+			return 0;
+
+		// Only whole floats can be read in place
+		if (0 != reinterpret_cast<size_t>(pixels) % sizeof(float) || 0 != stride % sizeof(float))
+			return 0;
+
+		return reinterpret_cast<const float*>(pixels + y * stride);
+	}
+
+private:
+
+	const unsigned char* pixels;
+	size_t px, py;
+	size_t stride;
+	pixel_format format;
+};
+
+
+// Read the whole of a source into a float_grayscale image
+bool read_image_source(image_source& src, float_grayscale& l)
+{
+	if (src.get_px() > 65535 || src.get_py() > 65535)
+	{
+		cerr << "Image is too large for float_grayscale." << endl;
+		return false;
+	}
+
+	l.px = static_cast<unsigned short int>(src.get_px());
+	l.py = static_cast<unsigned short int>(src.get_py());
+	l.pixel_data.resize(static_cast<size_t>(l.px) * l.py);
+
+	if (0 == l.pixel_data.size())
+		return true;
+
+	return src.get_rows(0, l.py, &l.pixel_data[0]);
+}
+
+#endif
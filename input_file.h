@@ -0,0 +1,110 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+
+#include "zip_archive.h"
+
+#include <string>
+using std::string;
+
+#include <fstream>
+using std::ifstream;
+
+#include <istream>
+using std::istream;
+
+#include <iostream>
+
+#ifdef _WIN32
+	#include <io.h>
+	#include <fcntl.h>
+#endif
+
+
+// Standard input, switched to binary where that matters
+istream& get_binary_stdin(void)
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+	return std::cin;
+}
+
+
+// A file that an image is read from: "-" is standard input, and
+// "archive.zip:member" is a member of a zip archive, inflated as it is read
+class input_file
+{
+public:
+
+	input_file(void)
+	{
+		in = 0;
+	}
+
+	bool open(const char* const filename)
+	{
+		string archive_filename, member_name;
+
+		if (0 == strcmp(filename, "-"))
+		{
+			in = &get_binary_stdin();
+		}
+		else if (split_zip_member_path(filename, archive_filename, member_name))
+		{
+			zip_archive archive;
+			size_t index = 0;
+
+			if (false == archive.open(archive_filename.c_str()))
+				return false;
+
+			if (false == archive.find(member_name, index))
+			{
+				cerr << "No member " << member_name << " in " << archive_filename << endl;
+				return false;
+			}
+
+			return open(archive, index);
+		}
+		else
+		{
+			file.open(filename, ios::binary);
+
+			if (!file.is_open())
+				return false;
+
+			in = &file;
+		}
+
+		return true;
+	}
+
+	// Open a member of an archive that is already open
+	bool open(const zip_archive& archive, const size_t index)
+	{
+		if (false == member.open(archive, index))
+			return false;
+
+		in = &member;
+
+		return true;
+	}
+
+	istream& get_stream(void)
+	{
+		return *in;
+	}
+
+private:
+
+	ifstream file;
+	zip_member_stream member;
+	istream* in;
+};
+
+#endif
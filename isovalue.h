@@ -0,0 +1,175 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef ISOVALUE_H
+#define ISOVALUE_H
+
+
+// Choosing the isovalue from the histogram of the luma, which is gathered as
+// the image is converted (see luma_histogram in image.h):
+//
+//   otsu:         the threshold that maximises the variance between the
+//                 pixels below it and those above it
+//   mean:         the mean luma
+//   percentile p: the value below which p% of the pixels lie
+//
+// Thresholds from the bins are taken at the edges of the bins, between the
+// luma values, rather than at a value that pixels have
+
+
+#include "image.h"
+
+#include <cstring>
+#include <cstdlib>
+
+
+class isovalue_parameters
+{
+public:
+
+	enum isovalue_method
+	{
+		fixed_isovalue,
+		otsu_isovalue,
+		mean_isovalue,
+		percentile_isovalue
+	};
+
+	isovalue_parameters(void)
+	{
+		method = fixed_isovalue;
+		value = 0.5;
+		percentile = 50;
+	}
+
+	// "otsu", "mean", "percentile" (which uses the percentile member) or a
+	// number, for a fixed isovalue
+	bool set(const char* const name)
+	{
+		char* end = 0;
+		const double v = strtod(name, &end);
+
+		if (0 == strcmp(name, "otsu"))
+			method = otsu_isovalue;
+		else if (0 == strcmp(name, "mean"))
+			method = mean_isovalue;
+		else if (0 == strcmp(name, "percentile"))
+			method = percentile_isovalue;
+		else if (end != name && '\0' == *end)
+		{
+			method = fixed_isovalue;
+			value = v;
+		}
+		else
+			return false;
+
+		return true;
+	}
+
+	bool is_automatic(void) const
+	{
+		return fixed_isovalue != method;
+	}
+
+	const char* get_name(void) const
+	{
+		if (otsu_isovalue == method)
+			return "otsu";
+		else if (mean_isovalue == method)
+			return "mean";
+		else if (percentile_isovalue == method)
+			return "percentile";
+
+		return "fixed";
+	}
+
+	isovalue_method method;
+	double value;
+	double percentile;
+};
+
+
+double get_otsu_isovalue(const luma_histogram& h)
+{
+	// https://en.wikipedia.org/wiki/Otsu%27s_method
+	const size_t n = h.bins.size();
+	const double total = static_cast<double>(h.count);
+
+	double total_sum = 0;
+
+	for (size_t i = 0; i < n; i++)
+		total_sum += h.bins[i] * ((i + 0.5) / n);
+
+	double w0 = 0, sum0 = 0;
+	double best_variance = -1;
+	size_t first_best = 0, last_best = 0;
+
+	for (size_t k = 0; k + 1 < n; k++)
+	{
+		w0 += h.bins[k];
+		sum0 += h.bins[k] * ((k + 0.5) / n);
+
+		const double w1 = total - w0;
+
+		if (0 == w0)
+			continue;
+
+		if (0 == w1)
+			break;
+
+		const double d = sum0 / w0 - (total_sum - sum0) / w1;
+		const double variance = w0 * w1 * d * d;
+
+		// Empty bins between the classes give the same variance, so the
+		// threshold goes in the middle of the gap
+		if (variance > best_variance * (1 + 1e-12))
+		{
+			best_variance = variance;
+			first_best = last_best = k;
+		}
+		else if (variance >= best_variance * (1 - 1e-12))
+		{
+			last_best = k;
+		}
+	}
+
+	return (first_best + last_best + 2) * 0.5 / n;
+}
+
+double get_percentile_isovalue(const luma_histogram& h, const double percentile)
+{
+	const size_t n = h.bins.size();
+	const double target = static_cast<double>(h.count) * percentile / 100.0;
+
+	double below = 0;
+
+	for (size_t k = 0; k < n; k++)
+	{
+		below += h.bins[k];
+
+		if (below >= target)
+			return static_cast<double>(k + 1) / n;
+	}
+
+	return 1.0;
+}
+
+// The isovalue for the image that the histogram was gathered from
+double get_isovalue(const isovalue_parameters& p, const luma_histogram& h)
+{
+	if (!p.is_automatic())
+		return p.value;
+
+	if (0 == h.count)
+		return 0.5;
+
+	if (isovalue_parameters::otsu_isovalue == p.method)
+		return get_otsu_isovalue(h);
+	else if (isovalue_parameters::mean_isovalue == p.method)
+		return h.sum / static_cast<double>(h.count);
+
+	return get_percentile_isovalue(h, p.percentile);
+}
+
+#endif
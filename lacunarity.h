@@ -0,0 +1,333 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef LACUNARITY_H
+#define LACUNARITY_H
+
+
+// Lacunarity and the generalised dimensions D(q), from the grid squares that
+// the march found the contours in (the boxes of the box count)
+//
+// The march marks those grid squares in an occupancy_table, which is then
+// turned into a summed-area table in place, so that the mass of any box (the
+// number of occupied grid squares in it) is four lookups. One pass over the
+// table, a band of box positions at a time across the threads, then gives
+// every box size r = 1, 2, 4, ... at once:
+//
+//   lacunarity:  L(r) = E[M^2] / E[M]^2, over the boxes of side r at every
+//                position (the gliding box), where M is the mass of a box
+//   D(q):        from the boxes of side r that tile the grid, with
+//                p = M / (the mass of all of them), the slope of
+//                log(sum p^q) / (q - 1) against log(r * step_size); for q = 1
+//                it is the slope of sum p log p
+//
+// D(0) is the box-counting dimension, fitted over the box sizes rather than
+// taken from the grid squares alone, D(1) the information dimension and D(2)
+// the correlation dimension. The boxes that tile the grid stop short of the
+// last (grid squares % r) columns and rows
+//
+// The table is 4 bytes per grid square. Its sums wrap around past 2^32, but
+// the mass of a box is still exact, since it is at most r * r
+
+
+#include "pipeline.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+using std::thread;
+
+#include <cmath>
+
+
+// The moments of the box masses at each box size, from one thread's bands
+class box_mass_sums
+{
+public:
+
+	void reset(const size_t num_sizes, const size_t num_q)
+	{
+		gliding_count.assign(num_sizes, 0);
+		gliding_sum.assign(num_sizes, 0);
+		gliding_square_sum.assign(num_sizes, 0);
+		tiled_sum.assign(num_sizes, 0);
+		tiled_entropy_sum.assign(num_sizes, 0);
+		tiled_occupied.assign(num_sizes, 0);
+		tiled_moment_sums.assign(num_sizes, vector<double>(num_q, 0));
+	}
+
+	void add(const box_mass_sums& s)
+	{
+		for (size_t i = 0; i < gliding_sum.size(); i++)
+		{
+			gliding_count[i] += s.gliding_count[i];
+			gliding_sum[i] += s.gliding_sum[i];
+			gliding_square_sum[i] += s.gliding_square_sum[i];
+			tiled_sum[i] += s.tiled_sum[i];
+			tiled_entropy_sum[i] += s.tiled_entropy_sum[i];
+			tiled_occupied[i] += s.tiled_occupied[i];
+
+			for (size_t j = 0; j < tiled_moment_sums[i].size(); j++)
+				tiled_moment_sums[i][j] += s.tiled_moment_sums[i][j];
+		}
+	}
+
+	// Every position: the count, sum M and sum M^2
+	vector<double> gliding_count;
+	vector<double> gliding_sum;
+	vector<double> gliding_square_sum;
+
+	// The boxes that tile the grid: sum M, sum M log M, the number with
+	// M > 0, and sum M^q for each q (over M > 0)
+	vector<double> tiled_sum;
+	vector<double> tiled_entropy_sum;
+	vector<double> tiled_occupied;
+	vector<vector<double> > tiled_moment_sums;
+};
+
+
+class lacunarity_parameters
+{
+public:
+
+	lacunarity_parameters(void)
+	{
+		band_rows = 64;
+		num_threads = 0;
+
+		for (int q = -2; q <= 4; q++)
+			q_values.push_back(q);
+	}
+
+	vector<double> q_values;
+
+	// Box positions per band; the bands are shared among the threads
+	size_t band_rows;
+
+	// 0 for all cores
+	size_t num_threads;
+};
+
+
+// The statistics of one box size
+class box_size_result
+{
+public:
+
+	box_size_result(void)
+	{
+		box_size = 0;
+		scale = 0;
+		lacunarity = 0;
+		num_occupied_boxes = 0;
+	}
+
+	// Grid squares per box side
+	size_t box_size;
+
+	// The box side, in the units of step_size
+	double scale;
+
+	double lacunarity;
+
+	// Of the boxes that tile the grid
+	size_t num_occupied_boxes;
+};
+
+
+class lacunarity_result
+{
+public:
+
+	vector<box_size_result> sizes;
+
+	// D(q) for each of the q values
+	vector<double> q_values;
+	vector<double> generalised_dimensions;
+};
+
+
+// The box sizes: powers of two, while at least 4 x 4 boxes tile the grid
+void get_box_sizes(const occupancy_table& table, vector<size_t>& box_sizes)
+{
+	box_sizes.clear();
+
+	const size_t side = (table.px < table.py) ? table.px : table.py;
+
+	for (size_t r = 1; r * 4 <= side; r *= 2)
+		box_sizes.push_back(r);
+}
+
+// Accumulate the box masses at positions (x, y) with y in the bands
+// [first, first + step, ...) of band_rows rows each
+void get_box_mass_sums(const occupancy_table& table, const vector<size_t>& box_sizes, const vector<double>& q_values, const size_t band_rows, const size_t first, const size_t step, box_mass_sums& s)
+{
+	s.reset(box_sizes.size(), q_values.size());
+
+	const size_t num_bands = (table.py + band_rows - 1) / band_rows;
+
+	for (size_t b = first; b < num_bands; b += step)
+	{
+		const size_t y_begin = b * band_rows;
+		const size_t y_end = (y_begin + band_rows < table.py) ? y_begin + band_rows : table.py;
+
+		for (size_t i = 0; i < box_sizes.size(); i++)
+		{
+			const size_t r = box_sizes[i];
+			const size_t x_count = table.px - r + 1;
+			double sum = 0, square_sum = 0;
+
+			for (size_t y = y_begin; y < y_end && y + r <= table.py; y++)
+			{
+				for (size_t x = 0; x < x_count; x++)
+				{
+					const double m = table.get_mass(x, y, r);
+
+					sum += m;
+					square_sum += m * m;
+				}
+
+				s.gliding_count[i] += static_cast<double>(x_count);
+
+				// The boxes that tile the grid
+				if (0 != y % r)
+					continue;
+
+				for (size_t x = 0; x + r <= table.px; x += r)
+				{
+					const unsigned int mass = table.get_mass(x, y, r);
+
+					if (0 == mass)
+						continue;
+
+					const double m = mass;
+
+					s.tiled_sum[i] += m;
+					s.tiled_entropy_sum[i] += m * log(m);
+					s.tiled_occupied[i]++;
+
+					for (size_t j = 0; j < q_values.size(); j++)
+						s.tiled_moment_sums[i][j] += pow(m, q_values[j]);
+				}
+			}
+
+			s.gliding_sum[i] += sum;
+			s.gliding_square_sum[i] += square_sum;
+		}
+	}
+}
+
+// The least squares slope of y against x
+double get_slope(const vector<double>& x, const vector<double>& y)
+{
+	const double n = static_cast<double>(x.size());
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+	for (size_t i = 0; i < x.size(); i++)
+	{
+		sx += x[i];
+		sy += y[i];
+		sxx += x[i] * x[i];
+		sxy += x[i] * y[i];
+	}
+
+	const double d = n * sxx - sx * sx;
+
+	if (0 == d)
+		return 0;
+
+	return (n * sxy - sx * sy) / d;
+}
+
+// Get the lacunarity at each box size, and D(q), from the occupancy that the
+// march marked, which is integrated first
+// With no occupied grid squares, or fewer than two box sizes, there are no
+// generalised dimensions to fit, and they are 0
+void get_lacunarity(occupancy_table& table, const grid_parameters& gp, const lacunarity_parameters& lp, lacunarity_result& result, pipeline_stats* const stats)
+{
+	stage_timer timer(stats, "lacunarity");
+
+	table.integrate(lp.num_threads);
+
+	vector<size_t> box_sizes;
+	get_box_sizes(table, box_sizes);
+
+	const size_t band_rows = (lp.band_rows > 0) ? lp.band_rows : 1;
+	const size_t num_bands = (table.py + band_rows - 1) / band_rows;
+	size_t n = get_num_threads(lp.num_threads);
+
+	if (n > num_bands)
+		n = num_bands;
+
+	if (0 == n)
+		n = 1;
+
+	vector<box_mass_sums> thread_sums(n);
+
+	if (1 == n)
+	{
+		get_box_mass_sums(table, box_sizes, lp.q_values, band_rows, 0, 1, thread_sums[0]);
+	}
+	else
+	{
+		vector<thread> threads;
+
+		for (size_t i = 0; i < n; i++)
+			threads.push_back(thread(get_box_mass_sums, std::cref(table), std::cref(box_sizes), std::cref(lp.q_values), band_rows, i, n, std::ref(thread_sums[i])));
+
+		for (size_t i = 0; i < n; i++)
+			threads[i].join();
+	}
+
+	box_mass_sums s = thread_sums[0];
+
+	for (size_t i = 1; i < n; i++)
+		s.add(thread_sums[i]);
+
+	result.sizes.resize(box_sizes.size());
+	result.q_values = lp.q_values;
+	result.generalised_dimensions.assign(lp.q_values.size(), 0);
+
+	vector<double> log_scales;
+
+	for (size_t i = 0; i < box_sizes.size(); i++)
+	{
+		box_size_result& b = result.sizes[i];
+
+		b.box_size = box_sizes[i];
+		b.scale = gp.step_size * static_cast<double>(box_sizes[i]);
+		b.num_occupied_boxes = static_cast<size_t>(s.tiled_occupied[i]);
+
+		if (s.gliding_sum[i] > 0)
+			b.lacunarity = s.gliding_count[i] * s.gliding_square_sum[i] / (s.gliding_sum[i] * s.gliding_sum[i]);
+
+		log_scales.push_back(log(b.scale));
+	}
+
+	if (box_sizes.size() < 2 || 0 == s.tiled_sum[0])
+		return;
+
+	for (size_t j = 0; j < lp.q_values.size(); j++)
+	{
+		const double q = lp.q_values[j];
+		vector<double> y;
+
+		// sum p^q = sum M^q / total^q, and sum p log p = sum M log M / total - log total
+		for (size_t i = 0; i < box_sizes.size(); i++)
+		{
+			const double log_total = log(s.tiled_sum[i]);
+
+			if (1 == q)
+				y.push_back(s.tiled_entropy_sum[i] / s.tiled_sum[i] - log_total);
+			else
+				y.push_back((log(s.tiled_moment_sums[i][j]) - q * log_total) / (q - 1));
+		}
+
+		result.generalised_dimensions[j] = get_slope(log_scales, y);
+	}
+}
+
+#endif
@@ -7,33 +7,551 @@
 
 int main(int argc, char **argv)
 {
+	// Command line options
+	// -q, --quiet:       suppress progress output
+	// --report filename: write the stage timings and counters as JSON
+	// --threads n:       number of threads used by the march (0 = all cores)
+	// --input filename:  the image to analyse (default figure1.tga), or - for
+	//                    standard input, or archive.zip:member for a member of
+	//                    a zip archive; a 24-bit TGA, or a binary PGM or PFM
+	//                    (see image_formats.h)
+	// --archive filename: analyse every image in a zip archive, --threads
+	//                    members at a time (see archive_batch.h)
+	// --raw type px py:  the input is headerless px x py float32 or uint16
+	//                    samples (native-endian, top row first)
+	// --mandelbrot n:    march an n x n Mandelbrot set, generated in-process,
+	//                    instead of reading the input
+	// --julia n:         likewise, for a Julia set
+	// --validate-precision: also run float and double pipelines, and report
+	//                    the difference between their dimensions
+	// --validate-normals: compare the SIMD normals and curvatures against
+	//                    the original one-segment-at-a-time calculation
+	// --border mode:     virtual (default): the march pads the image with a
+	//                    one pixel border, without touching the pixels
+	//                    black: overwrite the outermost pixels with black
+	//                    none: no border; contours may be open
+	// --crop x y n:      analyse only the n x n window at (x, y)
+	// --isovalue v:      the isovalue (default 0.5), or otsu, mean or
+	//                    percentile p, to choose it from the histogram of the
+	//                    luma, gathered as the image is converted (see
+	//                    isovalue.h)
+	// --luma type:       float (default), uint16 or uint8; the integer types
+	//                    store a TGA's luma in 2 or 1 byte(s) per pixel
+	// --validate-luma:   also run the uint16 and uint8 pipelines, and check
+	//                    their dimensions against the float pipeline's
+	// --daemon path:     serve analysis requests on a Unix domain socket
+	//                    (see daemon.h), with --threads workers
+	// --max-queue n:     connections that the daemon holds before it
+	//                    answers "busy" (default 64)
+	// --max-pixels n:    the largest buffer request (px * py) that the
+	//                    daemon accepts (default 8192 * 8192)
+	// --cache dir:       reuse the results of earlier runs on the same pixels
+	//                    and parameters (see result_cache.h)
+	// --cache-max-mb n:  size limit of the cache (default 256)
+	// --cache-geometry:  also cache the line segments and face normals
+	// --export filename: write the processed geometry as a binary file that
+	//                    can be memory mapped (see export.h)
+	// --svg filename:    write the contours as SVG
+	// --csv filename:    write the line segments as CSV
+	// --preview filename: where to write the TGA preview of the contours and
+	//                    normals (default preview.tga; see raster.h)
+	// --preview-size n:  width and height of the preview (default 800)
+	// --no-preview:      don't write the preview
+	// --smooth filter p: smooth the luma before the march, with a gaussian
+	//                    (p is sigma) or box (p is the radius) filter (see
+	//                    smoothing.h); float luma only
+	// --radii r,r,...:   also report the curvature-based dimension with the
+	//                    curvature taken r line segments away along the
+	//                    contours, for each r (see multi_radius.h)
+	// --lacunarity:      also report the gliding-box lacunarity at each box
+	//                    size, and the generalised dimensions D(q), from the
+	//                    grid squares of the box count (see lacunarity.h)
+	// --dq q,q,...:      the q values of D(q) (default -2,-1,0,1,2,3,4);
+	//                    implies --lacunarity
+	// --pyramid n:       analyse n levels of a resolution pyramid at once,
+	//                    halving the size at each level (see pyramid.h)
+	// --sdf filename:    write the signed distance field of the contours, in
+	//                    pixels, as a PFM (see distance_field.h); float luma only
+	// --validate-sdf:    with --sdf, check a sample of the distances against
+	//                    the distances to every line segment
+	// --morton:          renumber the vertices and line segments along a
+	//                    Z-order curve after the weld, for cache locality
+	// --queries filename: answer the nearest line segment and window queries
+	//                    in the file (see spatial_index.h)
+	// --approx e:        estimate the dimensions from a random sample of tiles,
+	//                    until both are known to within +/- e (95% confidence)
+	//                    (see approximate.h)
+	// --approx-seconds s: stop sampling after s seconds, whatever the error
+	// --tile-size n:     grid squares per tile side in sequence and approximate
+	//                    modes (default 64)
+	// --sequence file...: analyse the given frames in order, marching again
+	//                    only the tiles that changed (see sequence.h); the
+	//                    rest of the command line is the list of frames, and
+	//                    - reads frames from standard input until it ends
+	// --volume file...:  analyse a stack of slices (the rest of the command
+	//                    line, top slice first) as a volume, with marching
+	//                    cubes (see marching_cubes.h)
+	// --volume-julia n:  likewise, for an n x n x n quaternion Julia set,
+	//                    generated in-process
+	bool quiet = false;
+	bool validate_precision = false;
+	bool validate_soa_normals = false;
+	const char* report_filename = 0;
+	const char* input_filename = "figure1.tga";
+	const char* archive_filename = 0;
+	bool raw_input = false;
+	pixel_stream_format raw_format;
+	size_t num_threads = 0;
+	const char* procedural_name = 0;
+	size_t procedural_px = 0;
+	const char* border_mode = "virtual";
+	isovalue_parameters isovalue_params;
+	bool crop = false;
+	const char* luma_type = "float";
+	bool validate_luma = false;
+	const char* daemon_path = 0;
+	daemon_parameters daemon_params;
+	const char* cache_dir = 0;
+	size_t cache_max_mb = 256;
+	bool cache_geometry = false;
+	const char* export_filename = 0;
+	const char* svg_filename = 0;
+	const char* csv_filename = 0;
+	const char* sdf_filename = 0;
+	bool validate_sdf = false;
+	const char* queries_filename = 0;
+	bool morton_order = false;
+	const char* preview_filename = "preview.tga";
+	preview_parameters preview;
+	vector<string> sequence_filenames;
+	vector<string> volume_filenames;
+	size_t volume_julia_px = 0;
+	const char* smoothing_name = 0;
+	smoothing_kernel kernel;
+	vector<size_t> radii;
+	bool lacunarity = false;
+	lacunarity_parameters lacunarity_params;
+	size_t pyramid_levels = 0;
+	size_t tile_size = 64;
+	bool approximate = false;
+	approximate_parameters approximate_params;
+	size_t crop_x = 0, crop_y = 0, crop_px = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (0 == strcmp(argv[i], "-q") || 0 == strcmp(argv[i], "--quiet"))
+			quiet = true;
+		else if (0 == strcmp(argv[i], "--report") && i + 1 < argc)
+			report_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--validate-precision"))
+			validate_precision = true;
+		else if (0 == strcmp(argv[i], "--validate-normals"))
+			validate_soa_normals = true;
+		else if (0 == strcmp(argv[i], "--input") && i + 1 < argc)
+			input_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--archive") && i + 1 < argc)
+			archive_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--raw") && i + 3 < argc)
+		{
+			const char* const type = argv[++i];
+			const size_t raw_px = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+			const size_t raw_py = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+
+			if (false == set_raw_format(type, raw_px, raw_py, raw_format))
+			{
+				cout << "Unknown raw sample type: " << type << endl;
+				return 1;
+			}
+
+			raw_input = true;
+		}
+		else if (0 == strcmp(argv[i], "--threads") && i + 1 < argc)
+			num_threads = static_cast<size_t>(atoi(argv[++i]));
+		else if ((0 == strcmp(argv[i], "--mandelbrot") || 0 == strcmp(argv[i], "--julia")) && i + 1 < argc)
+		{
+			procedural_name = argv[i] + 2;
+			procedural_px = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+		}
+		else if (0 == strcmp(argv[i], "--isovalue") && i + 1 < argc)
+		{
+			if (false == isovalue_params.set(argv[++i]))
+			{
+				cout << "Unknown isovalue: " << argv[i] << endl;
+				return 1;
+			}
+
+			if (isovalue_parameters::percentile_isovalue == isovalue_params.method && i + 1 < argc)
+				isovalue_params.percentile = atof(argv[++i]);
+		}
+		else if (0 == strcmp(argv[i], "--luma") && i + 1 < argc)
+			luma_type = argv[++i];
+		else if (0 == strcmp(argv[i], "--daemon") && i + 1 < argc)
+			daemon_path = argv[++i];
+		else if (0 == strcmp(argv[i], "--max-queue") && i + 1 < argc)
+			daemon_params.max_queue = static_cast<size_t>(atoi(argv[++i]));
+		else if (0 == strcmp(argv[i], "--max-pixels") && i + 1 < argc)
+			daemon_params.max_pixels = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+		else if (0 == strcmp(argv[i], "--cache") && i + 1 < argc)
+			cache_dir = argv[++i];
+		else if (0 == strcmp(argv[i], "--cache-max-mb") && i + 1 < argc)
+			cache_max_mb = static_cast<size_t>(atoi(argv[++i]));
+		else if (0 == strcmp(argv[i], "--export") && i + 1 < argc)
+			export_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--svg") && i + 1 < argc)
+			svg_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--csv") && i + 1 < argc)
+			csv_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--morton"))
+			morton_order = true;
+		else if (0 == strcmp(argv[i], "--queries") && i + 1 < argc)
+			queries_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--sdf") && i + 1 < argc)
+			sdf_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--validate-sdf"))
+			validate_sdf = true;
+		else if (0 == strcmp(argv[i], "--preview") && i + 1 < argc)
+			preview_filename = argv[++i];
+		else if (0 == strcmp(argv[i], "--preview-size") && i + 1 < argc)
+			preview.px = preview.py = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+		else if (0 == strcmp(argv[i], "--no-preview"))
+			preview_filename = 0;
+		else if (0 == strcmp(argv[i], "--smooth") && i + 2 < argc)
+		{
+			smoothing_name = argv[++i];
+
+			if (false == kernel.set(smoothing_name, atof(argv[++i])))
+			{
+				cout << "Unknown smoothing filter: " << smoothing_name << endl;
+				return 1;
+			}
+		}
+		else if (0 == strcmp(argv[i], "--radii") && i + 1 < argc)
+		{
+			istringstream iss(argv[++i]);
+			string token;
+
+			while (std::getline(iss, token, ','))
+			{
+				char* end = 0;
+				const unsigned long long r = strtoull(token.c_str(), &end, 10);
+
+				// strtoull() would take -1 as the largest radius
+				if (token.empty() || !isdigit(static_cast<unsigned char>(token[0])) || '\0' != *end || 0 == r)
+				{
+					cout << "Unknown radius: " << token << endl;
+					return 1;
+				}
+
+				radii.push_back(static_cast<size_t>(r));
+			}
+		}
+		else if (0 == strcmp(argv[i], "--lacunarity"))
+			lacunarity = true;
+		else if (0 == strcmp(argv[i], "--dq") && i + 1 < argc)
+		{
+			istringstream iss(argv[++i]);
+			string token;
+
+			lacunarity = true;
+			lacunarity_params.q_values.clear();
+
+			while (std::getline(iss, token, ','))
+			{
+				char* end = 0;
+				const double q = strtod(token.c_str(), &end);
+
+				if (end == token.c_str() || '\0' != *end)
+				{
+					cout << "Unknown q value: " << token << endl;
+					return 1;
+				}
+
+				lacunarity_params.q_values.push_back(q);
+			}
+		}
+		else if (0 == strcmp(argv[i], "--pyramid") && i + 1 < argc)
+			pyramid_levels = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+		else if (0 == strcmp(argv[i], "--approx") && i + 1 < argc)
+		{
+			approximate = true;
+			approximate_params.error_bound = atof(argv[++i]);
+		}
+		else if (0 == strcmp(argv[i], "--approx-seconds") && i + 1 < argc)
+		{
+			approximate = true;
+			approximate_params.max_seconds = atof(argv[++i]);
+		}
+		else if (0 == strcmp(argv[i], "--tile-size") && i + 1 < argc)
+			tile_size = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+		else if (0 == strcmp(argv[i], "--sequence"))
+		{
+			sequence_filenames.assign(argv + i + 1, argv + argc);
+			break;
+		}
+		else if (0 == strcmp(argv[i], "--volume"))
+		{
+			volume_filenames.assign(argv + i + 1, argv + argc);
+			break;
+		}
+		else if (0 == strcmp(argv[i], "--volume-julia") && i + 1 < argc)
+			volume_julia_px = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+		else if (0 == strcmp(argv[i], "--cache-geometry"))
+			cache_geometry = true;
+		else if (0 == strcmp(argv[i], "--validate-luma"))
+			validate_luma = true;
+		else if (0 == strcmp(argv[i], "--border") && i + 1 < argc)
+			border_mode = argv[++i];
+		else if (0 == strcmp(argv[i], "--crop") && i + 3 < argc)
+		{
+			crop = true;
+			crop_x = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+			crop_y = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+			crop_px = static_cast<size_t>(strtoull(argv[++i], 0, 10));
+		}
+	}
+
+	const bool black_border = (0 == strcmp(border_mode, "black"));
+
+	if (false == black_border && 0 != strcmp(border_mode, "virtual") && 0 != strcmp(border_mode, "none"))
+	{
+		cout << "Unknown border mode: " << border_mode << endl;
+		return 1;
+	}
+
+	if (0 != daemon_path)
+	{
+		cout << "Listening on " << daemon_path << endl;
+
+		daemon_params.num_workers = num_threads;
+		daemon_params.black_border = black_border;
+		daemon_params.virtual_border = (0 == strcmp(border_mode, "virtual"));
+
+		if (false == run_daemon(daemon_path, daemon_params))
+			return 1;
+
+		return 0;
+	}
+
+	if (0 != cache_dir && false == create_cache_directory(cache_dir))
+	{
+		cout << "Could not create the cache directory " << cache_dir << endl;
+		return 1;
+	}
+
+	const bool luma_uint8 = (0 == strcmp(luma_type, "uint8"));
+	const bool luma_uint16 = (0 == strcmp(luma_type, "uint16"));
+
+	if (false == luma_uint8 && false == luma_uint16 && 0 != strcmp(luma_type, "float"))
+	{
+		cout << "Unknown luma type: " << luma_type << endl;
+		return 1;
+	}
+
+	if ((luma_uint8 || luma_uint16) && (0 != procedural_name || crop || 0 != smoothing_name || 0 != pyramid_levels || approximate || 0 != sdf_filename))
+	{
+		cout << "--luma " << luma_type << " only applies to TGA input, without --crop, --smooth, --pyramid, --approx or --sdf" << endl;
+		return 1;
+	}
+
+	// The occupancy is of one whole march
+	if (lacunarity && (0 != archive_filename || !sequence_filenames.empty() || !volume_filenames.empty() || 0 != volume_julia_px || 0 != pyramid_levels || approximate))
+	{
+		cout << "--lacunarity does not apply to --archive, --sequence, --volume, --pyramid or --approx" << endl;
+		return 1;
+	}
+
+	if (0 != archive_filename)
+	{
+		if (false == run_archive(archive_filename, raw_input ? &raw_format : 0, isovalue_params, black_border, 0 == strcmp(border_mode, "virtual"), num_threads, quiet, &stats))
+			return 1;
+
+		if (0 != report_filename && false == write_report(report_filename))
+			return 5;
+
+		return 0;
+	}
+
+	// The histogram is of one image that is read as a whole, so the
+	// generated images, the frames (whose unchanged tiles are kept) and the
+	// volumes take a fixed isovalue
+	if (isovalue_params.is_automatic() && (0 != procedural_name || !sequence_filenames.empty() || !volume_filenames.empty() || 0 != volume_julia_px))
+	{
+		cout << "--isovalue " << isovalue_params.get_name() << " does not apply to --mandelbrot, --julia, --sequence or --volume" << endl;
+		return 1;
+	}
+
+	if (!sequence_filenames.empty())
+	{
+		if (false == run_sequence(sequence_filenames, raw_input ? &raw_format : 0, isovalue_params.value, black_border, 0 == strcmp(border_mode, "virtual"), tile_size, num_threads, quiet, &stats))
+			return 1;
+
+		if (0 != report_filename && false == write_report(report_filename))
+			return 5;
+
+		return 0;
+	}
+
+	if (!volume_filenames.empty() || 0 != volume_julia_px)
+	{
+		if (black_border)
+		{
+			cout << "--border black does not apply to volumes" << endl;
+			return 1;
+		}
+
+		tga_stack_source stack(volume_filenames);
+		quaternion_julia_source julia(volume_julia_px, quaternion_julia_parameters());
+		volume_source* src = &julia;
+
+		if (!volume_filenames.empty())
+		{
+			if (false == stack.open())
+				return 1;
+
+			src = &stack;
+		}
+
+		if (false == run_volume(*src, isovalue_params.value, 0 == strcmp(border_mode, "virtual"), num_threads, quiet, &stats))
+			return 1;
+
+		if (0 != report_filename && false == write_report(report_filename))
+			return 5;
+
+		return 0;
+	}
+
+	lsd.quiet = quiet;
+	lsd.stats = &stats;
+	lsd.morton_order = morton_order;
+
 	// Image objects
 	tga tga_texture;
 	float_grayscale luma;
+	uint8_grayscale luma_8;
+	uint16_grayscale luma_16;
+	luma_histogram histogram;
+	luma_histogram* const histogram_ptr = isovalue_params.is_automatic() ? &histogram : 0;
+	image_input input;
+	std::unique_ptr<image_source> src;
+	std::unique_ptr<image_source> uncropped_src;
+	std::unique_ptr<image_source> unsmoothed_src;
 
-	// Read a 24-bit uncompressed/non-RLE Targa file, and then convert it to a 
-	// floating point grayscale image
-	cout << "Reading figure1.tga" << endl;
-	cout << endl;
+	if (0 != procedural_name)
+	{
+		// The rows are generated as the march consumes them
+		cout << "Generating " << procedural_px << " x " << procedural_px << " " << procedural_name << " set" << endl;
+		cout << endl;
+
+		escape_time_parameters p;
 
-	// Make absolutely sure that the make_black_border parameter is set to true
-	// This ensures that the line segment mesh(es) are closed, and so 
-	// there are exactly two line segment neighbours per line segment
-	if (false == convert_tga_to_float_grayscale("figure1.tga", tga_texture, luma, true, true, true))
+		if (0 == strcmp(procedural_name, "julia"))
+			p = get_julia_parameters();
+
+		src.reset(new escape_time_source(procedural_px, procedural_px, p, black_border, num_threads));
+	}
+	else
 	{
-		cout << "Error reading figure1.tga" << endl;
-		return 1;
+		cout << "Reading " << input_filename << endl;
+		cout << endl;
+
+		if (false == input.open(input_filename, raw_input ? &raw_format : 0) || false == input.read_header())
+		{
+			cout << "Error reading " << input_filename << endl;
+			return 1;
+		}
+
+		if ((luma_uint8 || luma_uint16) && !input.is_tga())
+		{
+			cout << "--luma " << luma_type << " only applies to TGA input" << endl;
+			return 1;
+		}
+
+		// The image is read three more times over
+		if (validate_luma && (!input.is_tga() || 0 == strcmp(input_filename, "-")))
+		{
+			cout << "--validate-luma only applies to TGA files" << endl;
+			return 1;
+		}
+
+		// The line segment mesh(es) are closed by the march's virtual border,
+		// unless the black border is asked for (or there is no border at all)
+		bool read = false;
+
+		// The options that go back over the pixels (or fetch them out of
+		// order) need the whole image, as does choosing the isovalue;
+		// otherwise a PGM or raw image is converted as the march consumes
+		// its rows, and so is a TGA that is smoothed or sampled
+		const bool streamed = !input.is_tga() && input.is_streamable() && !black_border && 0 == cache_dir && 0 == sdf_filename &&
+			0 == pyramid_levels && !approximate && !validate_precision && 0 == histogram_ptr;
+		const bool tga_rows = input.is_tga() && (0 != smoothing_name || approximate) && 0 == histogram_ptr;
+
+		if (streamed)
+			read = true;
+		else if (!input.is_tga())
+			read = read_image_input(input, tga_texture, luma, black_border, &stats, histogram_ptr);
+		else if (luma_uint8)
+			read = convert_tga_to_quantised_grayscale(input_filename, tga_texture, luma_8, black_border, true, true, &stats, histogram_ptr);
+		else if (luma_uint16)
+			read = convert_tga_to_quantised_grayscale(input_filename, tga_texture, luma_16, black_border, true, true, &stats, histogram_ptr);
+		else if (tga_rows)
+			read = read_tga(input_filename, tga_texture, black_border, true, &stats);
+		else
+			read = convert_tga_to_float_grayscale(input_filename, tga_texture, luma, black_border, true, true, &stats, histogram_ptr);
+
+		if (false == read)
+		{
+			cout << "Error reading " << input_filename << endl;
+			return 1;
+		}
+
+		// The luma of the smoothed image is converted as the rows are smoothed,
+		// and that of the sampled tiles as they are drawn
+		if (streamed)
+			src.reset(new stream_image_source(input.get_stream(), input.get_format(), &stats));
+		else if (tga_rows)
+			src.reset(new tga_luma_source(tga_texture, true, &stats));
+		else
+			src.reset(new float_grayscale_source(luma));
+	}
+
+	if (0 != smoothing_name)
+	{
+		cout << "Smoothing: " << smoothing_name << ", radius " << kernel.get_radius() << " pixel(s)" << endl;
+		cout << endl;
+
+		unsmoothed_src = std::move(src);
+		src.reset(new smoothing_source(*unsmoothed_src, kernel, &stats));
+	}
+
+	if (crop)
+	{
+		uncropped_src = std::move(src);
+		src.reset(new crop_source(*uncropped_src, crop_x, crop_y, crop_px, crop_px));
+	}
+
+	size_t px = src->get_px();
+	size_t py = src->get_py();
+
+	if (luma_uint8)
+	{
+		px = luma_8.px;
+		py = luma_8.py;
+	}
+	else if (luma_uint16)
+	{
+		px = luma_16.px;
+		py = luma_16.py;
 	}
 
 	// Too small
-	if(luma.px < 3 || luma.py < 3)
+	if(px < 3 || py < 3)
 	{
 		cout << "Template must be at least 3x3 pixels in size." << endl;
 		return 2;
 	}
 
 	// Not square
-	if (luma.px != luma.py)
+	if (px != py)
 	{
 		cout << "Template must be square." << endl;
 		return 3;
@@ -41,110 +559,470 @@ int main(int argc, char **argv)
 
 
 	// Marching Squares parameters
-	template_width = 1.0;
-	step_size = template_width/static_cast<double>(luma.px - 1);
-	template_height = step_size*(luma.py - 1); // Assumes square pixels.
-	isovalue = 0.5;
-	grid_x_min = -template_width / 2.0;
-	grid_y_max = template_height / 2.0;
+	gp.set(px, py, get_isovalue(isovalue_params, histogram));
+	gp.virtual_border = (0 == strcmp(border_mode, "virtual"));
+	template_width = gp.template_width;
+	step_size = gp.step_size;
+	template_height = gp.template_height;
+	isovalue = gp.isovalue;
+	grid_x_min = gp.grid_x_min;
+	grid_y_max = gp.grid_y_max;
 
 
 	// Print basic data
 	cout << "Template info: " << endl;
-	cout << luma.px << " x " << luma.py << " pixels" << endl;
+	cout << px << " x " << py << " pixels" << endl;
 	cout << template_width << " x " << template_height << " metres" << endl;
 	cout << endl;	
 	cout << "Grid info: " << endl;
-	cout << luma.px - 1 << " x " << luma.py - 1 << " grid squares" << endl;
+
+	if (gp.virtual_border)
+		cout << px + 1 << " x " << py + 1 << " grid squares (virtual border)" << endl;
+	else
+		cout << px - 1 << " x " << py - 1 << " grid squares" << endl;
+
 	cout << "x min (-x max): " << grid_x_min << endl;
 	cout << "y min (-y max): " << -grid_y_max << endl;
-	cout << "Isovalue: " << isovalue << endl;
+	cout << "Isovalue: " << isovalue;
+
+	if (isovalue_params.is_automatic())
+		cout << " (" << isovalue_params.get_name() << ")";
+
+	cout << endl;
 	cout << endl;
 	cout << "Generating geometric primitives..." << endl;
 	cout << endl;
 
+	if (approximate)
+	{
+		approximate_params.tile_size = tile_size;
+		approximate_params.num_threads = num_threads;
+
+		approximate_result ar;
+
+		if (false == analyse_approximate<real_type>(*src, gp, approximate_params, ar, &stats))
+		{
+			cout << "Error reading the image" << endl;
+			return 4;
+		}
+
+		cout << "Tiles sampled: " << ar.num_sampled_tiles << " of " << ar.num_tiles
+			<< " (" << 100.0 * static_cast<double>(ar.num_sampled_tiles) / static_cast<double>(ar.num_tiles > 0 ? ar.num_tiles : 1) << "% of the area), "
+			<< ar.seconds << " s" << endl;
+
+		if (ar.num_sampled_tiles == ar.num_tiles)
+			cout << "Every tile was sampled; the estimates are exact" << endl;
+		else if (ar.converged)
+			cout << "Stopped: error bound of " << approximate_params.error_bound << " met" << endl;
+		else
+			cout << "Stopped: time limit of " << approximate_params.max_seconds << " s reached" << endl;
 
-	double grid_x_pos = grid_x_min; // Start at minimum x
-	double grid_y_pos = grid_y_max; // Start at maximum y
+		cout << endl;
+		cout << "Curvature: " << ar.result.curvature << endl;
+		cout << "Curvature-based dimension: " << ar.result.curvature_dimension << " +/- " << ar.curvature_error << endl;
+		cout << "Box count: " << ar.result.box_count << endl;
+		cout << "Box-counting dimension: " << ar.result.box_counting_dimension << " +/- " << ar.box_counting_error << endl;
 
-	size_t box_count = 0;
+		if (0 != report_filename && false == write_report(report_filename))
+			return 5;
 
-	// Begin march over the plane
-	for(size_t y = 0; y < luma.py - 1; y++, grid_y_pos -= step_size, grid_x_pos = grid_x_min)
+		return 0;
+	}
+
+	if (0 != pyramid_levels)
 	{
-		for(size_t x = 0; x < luma.px - 1; x++, grid_x_pos += step_size)
+		vector<float_grayscale> levels(1);
+
+		// The base level is the image as it is marched
+		if (0 == smoothing_name && 0 == procedural_name && !crop)
 		{
-			// Corner vertex order: 03
-			//                      12
+			levels[0].px = luma.px;
+			levels[0].py = luma.py;
+			levels[0].pixel_data.swap(luma.pixel_data);
+		}
+		else if (false == read_image_source(*src, levels[0]))
+		{
+			cout << "Error reading the image" << endl;
+			return 1;
+		}
 
-			grid_square g;
+		vector<pyramid_level_result> levels_results;
+		analyse_pyramid(levels, pyramid_levels, gp.isovalue, gp.virtual_border, num_threads, levels_results, &stats);
 
-			g.vertex[0] = vertex_2(grid_x_pos, grid_y_pos);
-			g.vertex[1] = vertex_2(grid_x_pos, grid_y_pos - step_size);
-			g.vertex[2] = vertex_2(grid_x_pos + step_size, grid_y_pos - step_size);
-			g.vertex[3] = vertex_2(grid_x_pos + step_size, grid_y_pos);
+		cout << "Level  Size         Segments    Curvature-based  Box-counting  Seconds" << endl;
+
+		for (size_t i = 0; i < levels_results.size(); i++)
+		{
+			const pyramid_level_result& l = levels_results[i];
 
-			g.value[0] = luma.pixel_data[y*luma.px + x];
-			g.value[1] = luma.pixel_data[(y + 1)*luma.px + x];
-			g.value[2] = luma.pixel_data[(y + 1)*luma.px + (x + 1)];
-			g.value[3] = luma.pixel_data[y*luma.px + (x + 1)];
+			if (!l.analysed)
+			{
+				cout << "Error" << endl;
+				return 4;
+			}
 
-			// Add line segment primitives to line segment vector
-			//
-			// Box-counting dimension is very simple to calculate
-			// when using Marching Squares -- if primitives were added,
-			// then the boundary is covered by this particular 
-			// grid_square (box)
-			if (0 < g.generate_primitives(lsd.line_segments, isovalue))
-				box_count++;
+			cout << std::left << setw(7) << i
+				<< setw(13) << (std::to_string(l.px) + " x " + std::to_string(l.py))
+				<< setw(12) << l.num_segments
+				<< setw(17) << l.result.curvature_dimension
+				<< setw(14) << l.result.box_counting_dimension
+				<< l.seconds << endl;
 		}
+
+		cout << "Pyramid: " << stats.get_stage_time("pyramid") << " s, levels: " << stats.get_stage_time("levels") << " s" << endl;
+
+		stats.num_segments = levels_results[0].num_segments;
+
+		if (0 != report_filename && false == write_report(report_filename))
+			return 5;
+
+		return 0;
 	}
 
 
-	// Ultimately, this enumerates the line segment neighbour data,
-	// and uses that to calculate the face normal data
-	lsd.process_line_segments();
+	// The validation, export and query options need the whole of the line
+	// segment data (the cache holds no contours), and generated or smoothed
+	// images are never decoded as a whole, so none of them is cached
+	std::unique_ptr<result_cache> cache;
+	cache_key key;
+	cache_entry_t<real_type> entry;
+	bool cached = false;
+	const bool exporting = (0 != export_filename || 0 != svg_filename || 0 != csv_filename);
 
+	if (0 != cache_dir && 0 == procedural_name && 0 == smoothing_name && !validate_soa_normals && !validate_precision && !validate_luma && !exporting && !lacunarity && 0 == queries_filename)
+	{
+		stage_timer timer(&stats, "cache");
+
+		cache.reset(new result_cache(cache_dir, cache_max_mb * 1024 * 1024));
+
+		if (luma_uint8)
+			key.set_pixels(&luma_8.pixel_data[0], luma_8.pixel_data.size() * sizeof(luma_8.pixel_data[0]));
+		else if (luma_uint16)
+			key.set_pixels(&luma_16.pixel_data[0], luma_16.pixel_data.size() * sizeof(luma_16.pixel_data[0]));
+		else
+			key.set_pixels(&luma.pixel_data[0], luma.pixel_data.size() * sizeof(luma.pixel_data[0]));
+
+		key.px = px;
+		key.py = py;
+		key.isovalue = gp.isovalue;
+		key.black_border = black_border;
+		key.virtual_border = gp.virtual_border;
+		key.reverse_rows = key.reverse_pixel_byte_order = true;
+		key.morton_order = morton_order;
+		key.pixel_size = luma_uint8 ? 1 : (luma_uint16 ? 2 : 4);
+		key.scalar_size = sizeof(real_type);
+
+		if (crop)
+		{
+			key.crop_x = crop_x;
+			key.crop_y = crop_y;
+			key.crop_px = crop_px;
+		}
+
+		// A hit without geometry is no use when the geometry is wanted
+		cached = cache->load(key, entry) && (!cache_geometry || 0 == entry.num_segments || !entry.line_segments.empty());
+	}
 
-	// Calculate curvature-based dimension now that we have the face normals
-	vector<double> k;
+	analysis_result result;
+	occupancy_table occupancy;
+	occupancy_table* const occupancy_ptr = lacunarity ? &occupancy : 0;
 
-	for (size_t i = 0; i < lsd.line_segments.size(); i++)
+	if (cached)
 	{
-		if (lsd.line_segment_neighbours[i].size() != 2)
+		cout << "Found in cache" << endl;
+
+		result = entry.result;
+		entry.get_stats(stats);
+		lsd.line_segments.swap(entry.line_segments);
+		lsd.face_normals.swap(entry.face_normals);
+	}
+	else
+	{
+		// Begin march over the plane
+		size_t box_count = 0;
+
+		if (luma_uint8)
+			box_count = march_squares(luma_8, gp, lsd.line_segments, &stats, num_threads, occupancy_ptr);
+		else if (luma_uint16)
+			box_count = march_squares(luma_16, gp, lsd.line_segments, &stats, num_threads, occupancy_ptr);
+		else
+			box_count = march_squares(*src, gp, lsd.line_segments, &stats, num_threads, occupancy_ptr);
+
+		// A stream that ends early stops the march short
+		if (!input.is_tga() && 0 == procedural_name && input.get_stream().fail())
+		{
+			cout << "Error reading " << input_filename << endl;
+			return 1;
+		}
+
+
+		// Ultimately, this enumerates the line segment neighbour data,
+		// and uses that to calculate the face normal data
+		lsd.process_line_segments();
+
+
+		// Calculate curvature-based dimension now that we have the face normals
+		vector<real_type> k;
+
+		if (false == get_curvatures(lsd, k))
 		{
 			cout << "Error" << endl;
 			return 4;
 		}
 
-		size_t neighbour_0_index = lsd.line_segment_neighbours[i][0];
-		size_t neighbour_1_index = lsd.line_segment_neighbours[i][1];
+		if (false == lsd.closed)
+			cout << "Open contours: " << lsd.get_num_open_contours() << " (one-sided curvature at their ends)" << endl;
+
+		get_dimensions(k, box_count, gp, result);
+
+		stats.num_segments = lsd.line_segments.size();
+		stats.num_vertices = lsd.vertices.size();
+		stats.num_objects = lsd.num_objects;
+
+		if (cache)
+		{
+			stage_timer timer(&stats, "cache");
+
+			entry.result = result;
+			entry.set_stats(stats);
+
+			if (cache_geometry)
+			{
+				entry.line_segments = lsd.line_segments;
+				entry.face_normals = lsd.face_normals;
+			}
+
+			if (false == cache->store(key, entry))
+				cout << "Error writing to the cache in " << cache_dir << endl;
+		}
+	}
+
+	if (0 == result.box_count)
+		cout << "No contours at isovalue " << result.isovalue << endl;
+
+	cout << "Curvature:                 " << result.curvature << " +/- " << result.curvature_standard_deviation << endl;
+	cout << "Curvature-based dimension: " << result.curvature_dimension << endl;
+	cout << "Box-counting dimension:    " << result.box_counting_dimension << endl;
+
+	if (0 != export_filename)
+	{
+		stage_timer timer(&stats, "export");
+
+		if (false == write_geometry_file(export_filename, lsd))
+			return 5;
+	}
+
+	if (0 != svg_filename && false == write_svg(svg_filename, lsd, template_width, template_height))
+	{
+		cout << "Error writing " << svg_filename << endl;
+		return 5;
+	}
+
+	if (0 != csv_filename && false == write_csv(csv_filename, lsd))
+	{
+		cout << "Error writing " << csv_filename << endl;
+		return 5;
+	}
+
+	if (0 != sdf_filename && cached && lsd.line_segments.empty() && 0 != stats.num_segments)
+	{
+		cout << "--sdf needs the line segments, which are not in the cache" << endl;
+	}
+	else if (0 != sdf_filename)
+	{
+		distance_field_parameters dp;
+		dp.num_threads = num_threads;
+
+		float_grayscale field;
+
+		if (false == get_distance_field(*src, gp, lsd, field, dp, &stats))
+		{
+			cout << "Error reading the image" << endl;
+			return 4;
+		}
+
+		if (false == write_pfm(sdf_filename, field))
+		{
+			cout << "Error writing " << sdf_filename << endl;
+			return 5;
+		}
+
+		if (validate_sdf)
+		{
+			double difference = 0;
+			const bool valid = validate_distance_field(gp, lsd, field, 4096, difference);
+
+			cout << endl;
+			cout << "Max. distance difference:  " << difference << (valid ? " (passed)" : " (FAILED)") << endl;
+
+			if (!valid)
+				return 6;
+		}
+	}
+
+	if (0 != queries_filename)
+	{
+		cout << endl;
+
+		if (false == run_segment_queries(queries_filename, lsd, gp, num_threads, &stats))
+			return 5;
+	}
+
+	// The walk is needed, so this only runs on a cache miss
+	if (!radii.empty() && !cached)
+	{
+		vector<radius_result> radius_results;
+		get_multi_radius_dimensions(lsd, radii, radius_results);
+
+		cout << endl;
+		cout << "Radius  Scale        Curvature    Curvature-based dimension" << endl;
+
+		for (size_t i = 0; i < radius_results.size(); i++)
+		{
+			cout << std::left << setw(8) << radius_results[i].radius
+				<< setw(13) << radius_results[i].scale
+				<< setw(13) << radius_results[i].curvature
+				<< radius_results[i].curvature_dimension << endl;
+		}
+	}
+	else if (!radii.empty())
+	{
+		cout << "--radii needs the line segments, which are not in the cache" << endl;
+	}
+
+	if (lacunarity)
+	{
+		lacunarity_params.num_threads = num_threads;
+
+		lacunarity_result lr;
+		get_lacunarity(occupancy, gp, lacunarity_params, lr, &stats);
+
+		cout << endl;
+		cout << "Box size  Scale        Occupied boxes  Lacunarity" << endl;
+
+		for (size_t i = 0; i < lr.sizes.size(); i++)
+		{
+			cout << std::left << setw(10) << lr.sizes[i].box_size
+				<< setw(13) << lr.sizes[i].scale
+				<< setw(16) << lr.sizes[i].num_occupied_boxes
+				<< lr.sizes[i].lacunarity << endl;
+		}
+
+		cout << endl;
+		cout << "q       D(q)" << endl;
+
+		for (size_t i = 0; i < lr.q_values.size(); i++)
+			cout << std::left << setw(8) << lr.q_values[i] << lr.generalised_dimensions[i] << endl;
+	}
+
+	// A cache hit without geometry has nothing to draw
+	if (0 != preview_filename && !(cached && lsd.line_segments.empty() && 0 != stats.num_segments))
+	{
+		tga preview_image;
+
+		{
+			stage_timer timer(&stats, "preview");
+			render_preview(preview_image, lsd, gp, preview, num_threads);
+		}
+
+		if (false == write_tga(preview_filename, preview_image))
+		{
+			cout << "Error writing " << preview_filename << endl;
+			return 5;
+		}
+	}
 
-		vertex_2 this_normal = lsd.face_normals[i];
-		vertex_2 neighbour_0_normal = lsd.face_normals[neighbour_0_index];
-		vertex_2 neighbour_1_normal = lsd.face_normals[neighbour_1_index];
+	if (validate_soa_normals)
+	{
+		double normal_difference = 0, curvature_difference = 0;
+		const bool valid = validate_normals(lsd, normal_difference, curvature_difference);
 
-		// Get the average dot product
-		double d_i = this_normal.dot(neighbour_0_normal) + this_normal.dot(neighbour_1_normal);
-		d_i /= 2.0;
+		cout << endl;
+		cout << "Max. normal difference:    " << normal_difference << endl;
+		cout << "Max. curvature difference: " << curvature_difference << endl;
+		cout << "Tolerance:                 " << get_soa_normal_tolerance<real_type>() << (valid ? " (passed)" : " (FAILED)") << endl;
 
-		// Normalize the average dot product to get the curvature
-		double k_i = (1.0 - d_i) / 2.0;
+		if (!valid)
+			return 6;
+	}
+
+	if (validate_precision && (luma_uint8 || luma_uint16))
+	{
+		cout << endl;
+		cout << "--validate-precision only applies to float luma" << endl;
+	}
+	else if (validate_precision)
+	{
+		cout << endl;
+		cout << "Validating precision..." << endl;
+
+		line_segment_data_t<float> lsd_float;
+		line_segment_data_t<double> lsd_double;
+		lsd_float.quiet = lsd_double.quiet = true;
+
+		analysis_result result_float, result_double;
+
+		if (false == analyse_source(*src, gp, lsd_float, result_float, num_threads) ||
+			false == analyse_source(*src, gp, lsd_double, result_double, num_threads))
+		{
+			cout << "Error" << endl;
+			return 4;
+		}
 
-		k.push_back(k_i);
+		cout << "float:  " << lsd_float.line_segments.size() << " segments, " << result_float.curvature_dimension << " (curvature), " << result_float.box_counting_dimension << " (box-counting)" << endl;
+		cout << "double: " << lsd_double.line_segments.size() << " segments, " << result_double.curvature_dimension << " (curvature), " << result_double.box_counting_dimension << " (box-counting)" << endl;
+		cout << "Curvature-based dimension difference: " << fabs(result_float.curvature_dimension - result_double.curvature_dimension) << endl;
+		cout << "Box-counting dimension difference:    " << fabs(result_float.box_counting_dimension - result_double.box_counting_dimension) << endl;
 	}
 
-	double K = 0;
+	if (validate_luma)
+	{
+		cout << endl;
+		cout << "Validating quantised luma..." << endl;
+
+		tga t;
+		float_grayscale l_float;
+		uint16_grayscale l_16;
+		uint8_grayscale l_8;
+
+		if (false == convert_tga_to_float_grayscale(input_filename, t, l_float, black_border, true, true) ||
+			false == convert_tga_to_quantised_grayscale(input_filename, t, l_16, black_border, true, true) ||
+			false == convert_tga_to_quantised_grayscale(input_filename, t, l_8, black_border, true, true))
+		{
+			cout << "Error reading " << input_filename << endl;
+			return 1;
+		}
+
+		line_segment_data lsd_float, lsd_16, lsd_8;
+		lsd_float.quiet = lsd_16.quiet = lsd_8.quiet = true;
 
-	for (size_t i = 0; i < k.size(); i++)
-		K += k[i];
+		analysis_result result_float, result_16, result_8;
 
-	// Get the average normalized curvature
-	K /= static_cast<double>(k.size());
+		if (false == analyse_grayscale(l_float, gp, lsd_float, result_float, num_threads) ||
+			false == analyse_quantised(l_16, gp, lsd_16, result_16, num_threads) ||
+			false == analyse_quantised(l_8, gp, lsd_8, result_8, num_threads))
+		{
+			cout << "Error" << endl;
+			return 4;
+		}
+
+		const double diff_16 = fmax(fabs(result_16.curvature_dimension - result_float.curvature_dimension), fabs(result_16.box_counting_dimension - result_float.box_counting_dimension));
+		const double diff_8 = fmax(fabs(result_8.curvature_dimension - result_float.curvature_dimension), fabs(result_8.box_counting_dimension - result_float.box_counting_dimension));
+		const bool valid_16 = diff_16 <= get_quantised_dimension_tolerance<unsigned short int>();
+		const bool valid_8 = diff_8 <= get_quantised_dimension_tolerance<unsigned char>();
+
+		cout << "float:  " << result_float.curvature_dimension << " (curvature), " << result_float.box_counting_dimension << " (box-counting)" << endl;
+		cout << "uint16: " << result_16.curvature_dimension << " (curvature), " << result_16.box_counting_dimension << " (box-counting), max. difference " << diff_16
+			<< ", tolerance " << get_quantised_dimension_tolerance<unsigned short int>() << (valid_16 ? " (passed)" : " (FAILED)") << endl;
+		cout << "uint8:  " << result_8.curvature_dimension << " (curvature), " << result_8.box_counting_dimension << " (box-counting), max. difference " << diff_8
+			<< ", tolerance " << get_quantised_dimension_tolerance<unsigned char>() << (valid_8 ? " (passed)" : " (FAILED)") << endl;
+
+		if (!valid_16 || !valid_8)
+			return 7;
+	}
 
-	cout << "Curvature:                 " << K << " +/- " << standard_deviation(k) << endl;
-	cout << "Curvature-based dimension: " << 1.0 + K << endl;
-	cout << "Box-counting dimension:    " << log(static_cast<double>(box_count)) / log(1.0 / step_size) << endl;
+	if (0 != report_filename && false == write_report(report_filename))
+		return 5;
 
 
 #ifdef USE_OPENGL
@@ -7,14 +7,49 @@
 
 
 #include "image.h"
+#include "image_formats.h"
+#include "isovalue.h"
+#include "archive_batch.h"
 #include "primitives.h"
 #include "marching_squares.h"
+#include "pipeline.h"
+#include "image_source.h"
+#include "synthetic.h"
+#include "daemon.h"
+#include "result_cache.h"
+#include "export.h"
+#include "raster.h"
+#include "sequence.h"
+#include "smoothing.h"
+#include "multi_radius.h"
+#include "lacunarity.h"
+#include "pyramid.h"
+#include "approximate.h"
+#include "spatial_index.h"
+#include "distance_field.h"
+#include "volume_source.h"
+#include "marching_cubes.h"
 
 
 #include <iostream>
 using std::cout;
 using std::endl;
 
+#include <fstream>
+using std::ofstream;
+
+#include <sstream>
+using std::istringstream;
+
+#include <iomanip>
+using std::setw;
+
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+#include <memory>
+
 
 double template_width = 0;
 double step_size = 0;
@@ -23,30 +58,27 @@ double isovalue = 0;
 double grid_x_min = 0;
 double grid_y_max = 0;
 
+grid_parameters gp;
 line_segment_data lsd;
+pipeline_stats stats;
 
 
-double standard_deviation(const vector<double>& src)
+// Write the stats as JSON
+bool write_report(const char* const filename)
 {
-    double mean = 0;
-    double size = static_cast<double>(src.size());
-
-    for (size_t i = 0; i < src.size(); i++)
-        mean += src[i];
-
-    mean /= size;
+	stats.peak_resident_memory = get_peak_resident_memory();
 
-    double sq_diff = 0;
+	ofstream report(filename);
 
-    for (size_t i = 0; i < src.size(); i++)
-    {
-        double diff = src[i] - mean;
-        sq_diff += diff * diff;
-    }
+	if (!report.is_open())
+	{
+		cout << "Error writing " << filename << endl;
+		return false;
+	}
 
-    sq_diff /= size;
+	stats.write_json(report);
 
-    return sqrt(sq_diff);
+	return true;
 }
 
 
@@ -161,4 +193,4 @@ void render_image(int& argc, char**& argv)
 #endif // USE_OPENGL
 
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,957 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef MARCHING_CUBES_H
+#define MARCHING_CUBES_H
+
+
+#include "primitives.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "volume_source.h"
+
+#include <cmath>
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+using std::thread;
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// The 3D counterparts of the Marching Squares primitives: the march turns a
+// stack of slices into a triangle mesh, whose face normals give a curvature
+// per triangle, and whose crossed cubes give the box count
+
+template<typename T>
+class vertex_3_t
+{
+public:
+	T x;
+	T y;
+	T z;
+
+	vertex_3_t(const T src_x = 0, const T src_y = 0, const T src_z = 0)
+	{
+		x = src_x;
+		y = src_y;
+		z = src_z;
+	}
+
+	inline vertex_3_t operator-(const vertex_3_t& right) const
+	{
+		return vertex_3_t(x - right.x, y - right.y, z - right.z);
+	}
+
+	inline T dot(const vertex_3_t& right) const
+	{
+		return x*right.x + y*right.y + z*right.z;
+	}
+
+	inline vertex_3_t cross(const vertex_3_t& right) const
+	{
+		return vertex_3_t(y*right.z - z*right.y, z*right.x - x*right.z, x*right.y - y*right.x);
+	}
+
+	inline T length(void) const
+	{
+		return sqrt(dot(*this));
+	}
+
+	inline void normalize(void)
+	{
+		T len = length();
+
+		if (0.0 != len)
+		{
+			x /= len;
+			y /= len;
+			z /= len;
+		}
+	}
+};
+
+// A triangle of the surface, by vertex index
+class indexed_triangle
+{
+public:
+
+	size_t vertex[3];
+
+	indexed_triangle(void)
+	{
+		vertex[0] = vertex[1] = vertex[2] = 0;
+	}
+};
+
+
+// The triangles of each of the 256 cube cases, generated instead of typed in
+//
+// Corner c of a cube is (c & 1, (c >> 1) & 1, (c >> 2) & 1) grid steps from
+// its first corner, and bit c of the case mask is set if corner c is inside
+// of the surface (at or above the isovalue), as in grid_square_t. Edge
+// 4*a + j runs along axis a, from the j-th of the corners that are at 0 on
+// that axis.
+//
+// Each face of the cube is a grid square: its contour cuts each run of
+// inside corners around the face away from the rest, so the two inside
+// corners of an ambiguous face are kept apart, as grid_square_t keeps them.
+// The two cubes that share a face decide it from the same four values, so
+// the surface has no cracks. The face contours are oriented with the
+// inside on their left, seen from outside of the cube, which chains them
+// into closed loops around the cube; each loop is a fan of triangles,
+// wound so that their normals point away from the inside
+class marching_cubes_table
+{
+public:
+
+	marching_cubes_table(void)
+	{
+		size_t edge_index[8][8];
+
+		for (size_t a = 0; a < 3; a++)
+		{
+			size_t j = 0;
+
+			for (size_t c = 0; c < 8; c++)
+			{
+				if (0 != ((c >> a) & 1))
+					continue;
+
+				const size_t e = 4 * a + j++;
+				const size_t d = c | (static_cast<size_t>(1) << a);
+
+				edge_corner[e] = c;
+				edge_axis[e] = a;
+				edge_index[c][d] = edge_index[d][c] = e;
+			}
+		}
+
+		// The corners of each face, counter-clockwise seen from outside
+		size_t faces[6][4];
+		const size_t square[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+		for (size_t a = 0; a < 3; a++)
+		{
+			// Counter-clockwise seen from +a, since u x v = a
+			const size_t u = (a + 1) % 3;
+			const size_t v = (a + 2) % 3;
+
+			for (size_t s = 0; s < 2; s++)
+				for (size_t k = 0; k < 4; k++)
+					faces[2 * a + s][(1 == s) ? k : 3 - k] = (s << a) | (square[k][0] << u) | (square[k][1] << v);
+		}
+
+		for (size_t mask = 0; mask < 256; mask++)
+		{
+			// The edge that the contour goes on to, from each crossed edge
+			size_t next[12];
+
+			for (size_t e = 0; e < 12; e++)
+				next[e] = 12;
+
+			for (size_t f = 0; f < 6; f++)
+			{
+				bool inside[4];
+
+				for (size_t k = 0; k < 4; k++)
+					inside[k] = 0 != ((mask >> faces[f][k]) & 1);
+
+				// Each run of inside corners starts after an outside corner
+				for (size_t k = 0; k < 4; k++)
+				{
+					if (!inside[k] || inside[(k + 3) % 4])
+						continue;
+
+					size_t last = k;
+
+					while (inside[(last + 1) % 4])
+						last = (last + 1) % 4;
+
+					const size_t entering = edge_index[faces[f][(k + 3) % 4]][faces[f][k]];
+					const size_t leaving = edge_index[faces[f][last]][faces[f][(last + 1) % 4]];
+
+					next[leaving] = entering;
+				}
+			}
+
+			bool used[12] = { false };
+
+			for (size_t e = 0; e < 12; e++)
+			{
+				if (12 == next[e] || used[e])
+					continue;
+
+				vector<size_t> loop;
+
+				for (size_t i = e; !used[i]; i = next[i])
+				{
+					used[i] = true;
+					loop.push_back(i);
+				}
+
+				// A fan diagonal between two edges of the same face would
+				// lie in that face, where the cube next to it may put the same
+				// diagonal; fan out from an edge that has no such diagonal
+				const size_t l = loop.size();
+				size_t first = 0;
+				size_t fewest = l;
+
+				for (size_t i = 0; i < l; i++)
+				{
+					size_t count = 0;
+
+					for (size_t j = 2; j + 1 < l; j++)
+						if (share_face(loop[i], loop[(i + j) % l]))
+							count++;
+
+					if (count < fewest)
+					{
+						fewest = count;
+						first = i;
+					}
+				}
+
+				for (size_t i = 1; i + 1 < l; i++)
+				{
+					triangles[mask].push_back(static_cast<unsigned char>(loop[first]));
+					triangles[mask].push_back(static_cast<unsigned char>(loop[(first + i + 1) % l]));
+					triangles[mask].push_back(static_cast<unsigned char>(loop[(first + i) % l]));
+				}
+			}
+		}
+	}
+
+	// Whether two edges are on the same face of the cube
+	bool share_face(const size_t e0, const size_t e1) const
+	{
+		// Some axis, other than their own, that both edges are at the same
+		// side of the cube on
+		for (size_t a = 0; a < 3; a++)
+		{
+			const size_t bit = static_cast<size_t>(1) << a;
+
+			if (a != edge_axis[e0] && a != edge_axis[e1] && (edge_corner[e0] & bit) == (edge_corner[e1] & bit))
+				return true;
+		}
+
+		return false;
+	}
+
+	// The first corner and the axis of each edge
+	size_t edge_corner[12];
+	size_t edge_axis[12];
+
+	// Three edges per triangle
+	vector<unsigned char> triangles[256];
+};
+
+const marching_cubes_table& get_marching_cubes_table(void)
+{
+	static const marching_cubes_table table;
+
+	return table;
+}
+
+
+// Output of one slab of layers of the cube march, where layer z is the
+// cubes between (padded) slices z and z + 1
+//
+// The slab makes the vertices on the edges of its first slice as well, so
+// that its triangles are complete; those first_plane_end vertices repeat
+// the top plane vertices [top_plane_begin, top_plane_end) of the slab
+// before it, in the same order, and are dropped when the slabs are merged
+template<typename T>
+class march_slab_t
+{
+public:
+
+	march_slab_t(void)
+	{
+		layer_begin = layer_end = 0;
+		first_plane_end = top_plane_begin = top_plane_end = 0;
+		box_count = num_cubes = 0;
+		ok = true;
+	}
+
+	size_t layer_begin, layer_end;
+
+	vector<vertex_3_t<T> > vertices;
+	vector<indexed_triangle> triangles;
+	vector<vertex_3_t<T> > face_normals;
+
+	size_t first_plane_end;
+	size_t top_plane_begin, top_plane_end;
+
+	size_t box_count;
+	size_t num_cubes;
+
+	// False if a slice could not be read
+	bool ok;
+};
+
+// Slice z of the padded volume, with pad slices and columns of border_value
+// around the source's slices; pixels holds one source slice
+bool get_padded_slice(volume_source& src, const size_t z, const size_t pad, const float border_value, vector<float>& pixels, vector<float>& slice)
+{
+	const size_t px = src.get_px();
+	const size_t py = src.get_py();
+	const size_t gx = px + 2 * pad;
+
+	if (0 != pad && (0 == z || src.get_pz() + 1 == z))
+	{
+		for (size_t i = 0; i < slice.size(); i++)
+			slice[i] = border_value;
+
+		return true;
+	}
+
+	if (false == src.get_slice(z - pad, &pixels[0]))
+		return false;
+
+	if (0 == pad)
+	{
+		slice = pixels;
+		return true;
+	}
+
+	for (size_t i = 0; i < slice.size(); i++)
+		slice[i] = border_value;
+
+	for (size_t y = 0; y < py; y++)
+		memcpy(&slice[(y + 1) * gx + 1], &pixels[y * px], px * sizeof(float));
+
+	return true;
+}
+
+// Make the vertices where the contour crosses the grid edges of a slice,
+// and note their indices in edges (the x edges, then the y edges)
+template<typename T>
+void add_plane_vertices(const vector<float>& slice, const vector<T>& xs, const vector<T>& ys, const T z, const T isovalue, vector<vertex_3_t<T> >& vertices, vector<size_t>& edges)
+{
+	const size_t gx = xs.size();
+	const size_t gy = ys.size();
+	const size_t plane = gx * gy;
+
+	for (size_t y = 0; y < gy; y++)
+	{
+		for (size_t x = 0; x + 1 < gx; x++)
+		{
+			const T v1 = slice[y * gx + x];
+			const T v2 = slice[y * gx + x + 1];
+
+			if ((v1 >= isovalue) == (v2 >= isovalue))
+				continue;
+
+			edges[y * gx + x] = vertices.size();
+			vertices.push_back(vertex_3_t<T>(xs[x] + (isovalue - v1) / (v2 - v1) * (xs[x + 1] - xs[x]), ys[y], z));
+		}
+	}
+
+	for (size_t y = 0; y + 1 < gy; y++)
+	{
+		for (size_t x = 0; x < gx; x++)
+		{
+			const T v1 = slice[y * gx + x];
+			const T v2 = slice[(y + 1) * gx + x];
+
+			if ((v1 >= isovalue) == (v2 >= isovalue))
+				continue;
+
+			edges[plane + y * gx + x] = vertices.size();
+			vertices.push_back(vertex_3_t<T>(xs[x], ys[y] + (isovalue - v1) / (v2 - v1) * (ys[y + 1] - ys[y]), z));
+		}
+	}
+}
+
+// March over the layers of one slab, holding two slices at a time
+//
+// Every crossed grid edge gets one vertex, whose index is kept by edge (per
+// slice, and between the two slices), so the triangles of neighbouring
+// cubes share their vertices without a weld
+template<typename T>
+void march_cube_slab(volume_source& src, const vector<T>& xs, const vector<T>& ys, const vector<T>& zs, const T isovalue, const size_t pad, const float border_value, const marching_cubes_table& table, march_slab_t<T>& slab)
+{
+	const size_t gx = xs.size();
+	const size_t gy = ys.size();
+	const size_t plane = gx * gy;
+
+	vector<float> pixels(src.get_px() * src.get_py());
+	vector<float> lower(plane), upper(plane);
+
+	// The vertex of each crossed edge, for the edges that the table marks
+	vector<size_t> lower_edges(2 * plane), upper_edges(2 * plane), vertical_edges(plane);
+
+	if (false == get_padded_slice(src, slab.layer_begin, pad, border_value, pixels, lower))
+	{
+		slab.ok = false;
+		return;
+	}
+
+	add_plane_vertices(lower, xs, ys, zs[slab.layer_begin], isovalue, slab.vertices, lower_edges);
+	slab.first_plane_end = slab.vertices.size();
+
+	for (size_t z = slab.layer_begin; z < slab.layer_end; z++)
+	{
+		if (false == get_padded_slice(src, z + 1, pad, border_value, pixels, upper))
+		{
+			slab.ok = false;
+			return;
+		}
+
+		slab.top_plane_begin = slab.vertices.size();
+		add_plane_vertices(upper, xs, ys, zs[z + 1], isovalue, slab.vertices, upper_edges);
+		slab.top_plane_end = slab.vertices.size();
+
+		for (size_t i = 0; i < plane; i++)
+		{
+			const T v1 = lower[i];
+			const T v2 = upper[i];
+
+			if ((v1 >= isovalue) == (v2 >= isovalue))
+				continue;
+
+			vertical_edges[i] = slab.vertices.size();
+			slab.vertices.push_back(vertex_3_t<T>(xs[i % gx], ys[i / gx], zs[z] + (isovalue - v1) / (v2 - v1) * (zs[z + 1] - zs[z])));
+		}
+
+		const vector<size_t>* const plane_edges[2] = { &lower_edges, &upper_edges };
+
+		for (size_t y = 0; y + 1 < gy; y++)
+		{
+			for (size_t x = 0; x + 1 < gx; x++)
+			{
+				const size_t i = y * gx + x;
+				unsigned int mask = 0;
+
+				if (static_cast<T>(lower[i]) >= isovalue)
+					mask |= 1;
+
+				if (static_cast<T>(lower[i + 1]) >= isovalue)
+					mask |= 2;
+
+				if (static_cast<T>(lower[i + gx]) >= isovalue)
+					mask |= 4;
+
+				if (static_cast<T>(lower[i + gx + 1]) >= isovalue)
+					mask |= 8;
+
+				if (static_cast<T>(upper[i]) >= isovalue)
+					mask |= 16;
+
+				if (static_cast<T>(upper[i + 1]) >= isovalue)
+					mask |= 32;
+
+				if (static_cast<T>(upper[i + gx]) >= isovalue)
+					mask |= 64;
+
+				if (static_cast<T>(upper[i + gx + 1]) >= isovalue)
+					mask |= 128;
+
+				// As with the grid squares, a cube that the surface
+				// crosses is a box that covers it
+				if (0 == mask || 255 == mask)
+					continue;
+
+				slab.box_count++;
+
+				const vector<unsigned char>& edges = table.triangles[mask];
+
+				for (size_t t = 0; t < edges.size(); t += 3)
+				{
+					indexed_triangle tri;
+
+					for (size_t k = 0; k < 3; k++)
+					{
+						const size_t e = edges[t + k];
+						const size_t c = table.edge_corner[e];
+						const size_t j = i + (c & 1) + ((c >> 1) & 1) * gx;
+
+						if (2 == table.edge_axis[e])
+							tri.vertex[k] = vertical_edges[j];
+						else
+							tri.vertex[k] = (*plane_edges[c >> 2])[table.edge_axis[e] * plane + j];
+					}
+
+					slab.triangles.push_back(tri);
+				}
+			}
+		}
+
+		slab.num_cubes += (gx - 1) * (gy - 1);
+
+		lower.swap(upper);
+		lower_edges.swap(upper_edges);
+	}
+
+	slab.face_normals.resize(slab.triangles.size());
+
+	for (size_t t = 0; t < slab.triangles.size(); t++)
+	{
+		const vertex_3_t<T>& v0 = slab.vertices[slab.triangles[t].vertex[0]];
+		const vertex_3_t<T>& v1 = slab.vertices[slab.triangles[t].vertex[1]];
+		const vertex_3_t<T>& v2 = slab.vertices[slab.triangles[t].vertex[2]];
+
+		slab.face_normals[t] = (v1 - v0).cross(v2 - v0);
+		slab.face_normals[t].normalize();
+	}
+}
+
+
+// Marching cubes-related geometric primitives
+template<typename T>
+class surface_data_t
+{
+public:
+	vector<vertex_3_t<T> > vertices;
+	vector<indexed_triangle> triangles;
+	vector<vertex_3_t<T> > face_normals;
+
+	// The triangle across edge i (vertex[i] to vertex[(i + 1) % 3]) of
+	// triangle t is triangle_neighbours[3*t + i], or no_neighbour if no
+	// triangle (or more than one) shares that edge
+	vector<size_t> triangle_neighbours;
+
+	// Per triangle curvature, from the face normals of its neighbours
+	vector<T> triangle_curvatures;
+
+	// True if every triangle has three neighbours
+	bool closed;
+
+	// Suppresses all progress output
+	bool quiet;
+
+	// Optional; receives the merge, adjacency and curvature stage timings
+	pipeline_stats* stats;
+
+	static const size_t no_neighbour = static_cast<size_t>(-1);
+
+	surface_data_t(void)
+	{
+		closed = false;
+		quiet = false;
+		stats = 0;
+		num_threads = 1;
+	}
+
+	void clear(void)
+	{
+		vertices.clear();
+		triangles.clear();
+		face_normals.clear();
+		triangle_neighbours.clear();
+		triangle_curvatures.clear();
+		closed = false;
+	}
+
+	// Join the slabs into one mesh, one thread per slab, dropping the
+	// vertices that each slab repeats from the slab before it
+	// Returns false if the slabs do not match up
+	bool merge_slabs(vector<march_slab_t<T> >& slabs)
+	{
+		stage_timer timer(stats, "merge");
+
+		clear();
+
+		vector<size_t> vertex_base(slabs.size() + 1, 0), triangle_base(slabs.size() + 1, 0);
+
+		for (size_t s = 0; s < slabs.size(); s++)
+		{
+			const size_t repeated = (0 == s) ? 0 : slabs[s].first_plane_end;
+
+			if (0 != s && repeated != slabs[s - 1].top_plane_end - slabs[s - 1].top_plane_begin)
+				return false;
+
+			vertex_base[s + 1] = vertex_base[s] + slabs[s].vertices.size() - repeated;
+			triangle_base[s + 1] = triangle_base[s] + slabs[s].triangles.size();
+		}
+
+		vertices.resize(vertex_base.back());
+		triangles.resize(triangle_base.back());
+		face_normals.resize(triangle_base.back());
+
+		if (1 == slabs.size())
+		{
+			merge_slab(slabs, vertex_base, triangle_base, 0);
+		}
+		else
+		{
+			vector<thread> threads;
+
+			for (size_t s = 0; s < slabs.size(); s++)
+				threads.push_back(thread(&surface_data_t<T>::merge_slab, this, std::ref(slabs), std::cref(vertex_base), std::cref(triangle_base), s));
+
+			for (size_t s = 0; s < slabs.size(); s++)
+				threads[s].join();
+		}
+
+		return true;
+	}
+
+	// Find the neighbours of the triangles, then their curvatures
+	void process_triangles(const size_t src_num_threads)
+	{
+		num_threads = (0 == src_num_threads) ? 1 : src_num_threads;
+
+		triangle_neighbours.clear();
+		triangle_curvatures.clear();
+		closed = true;
+
+		if (triangles.empty())
+			return;
+
+		{
+			stage_timer timer(stats, "adjacency");
+			get_all_triangle_neighbours();
+		}
+
+		for (size_t i = 0; i < triangle_neighbours.size(); i++)
+		{
+			if (no_neighbour == triangle_neighbours[i])
+			{
+				closed = false;
+				break;
+			}
+		}
+
+		{
+			stage_timer timer(stats, "curvature");
+
+			triangle_curvatures.resize(triangles.size());
+			run_ranges(&surface_data_t<T>::get_curvature_range);
+		}
+	}
+
+protected:
+
+	void merge_slab(vector<march_slab_t<T> >& slabs, const vector<size_t>& vertex_base, const vector<size_t>& triangle_base, const size_t s)
+	{
+		march_slab_t<T>& slab = slabs[s];
+		const size_t repeated = (0 == s) ? 0 : slab.first_plane_end;
+
+		// The repeated vertices are the previous slab's top plane
+		size_t previous_top = 0;
+
+		if (0 != s)
+		{
+			const size_t previous_repeated = (1 == s) ? 0 : slabs[s - 1].first_plane_end;
+			previous_top = vertex_base[s - 1] + slabs[s - 1].top_plane_begin - previous_repeated;
+		}
+
+		for (size_t i = repeated; i < slab.vertices.size(); i++)
+			vertices[vertex_base[s] + i - repeated] = slab.vertices[i];
+
+		for (size_t t = 0; t < slab.triangles.size(); t++)
+		{
+			indexed_triangle& tri = triangles[triangle_base[s] + t];
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				const size_t v = slab.triangles[t].vertex[k];
+				tri.vertex[k] = (v < repeated) ? previous_top + v : vertex_base[s] + v - repeated;
+			}
+
+			face_normals[triangle_base[s] + t] = slab.face_normals[t];
+		}
+
+		// The top plane size is still needed by the next slab
+		vector<vertex_3_t<T> >().swap(slab.vertices);
+		vector<indexed_triangle>().swap(slab.triangles);
+		vector<vertex_3_t<T> >().swap(slab.face_normals);
+	}
+
+	// Runs function(begin, end) over num_threads ranges of the triangles
+	void run_ranges(void (surface_data_t<T>::*function)(const size_t, const size_t))
+	{
+		size_t n = num_threads;
+
+		if (n > triangles.size())
+			n = triangles.size();
+
+		if (1 >= n)
+		{
+			(this->*function)(0, triangles.size());
+			return;
+		}
+
+		vector<thread> threads;
+
+		for (size_t i = 0; i < n; i++)
+			threads.push_back(thread(function, this, triangles.size() * i / n, triangles.size() * (i + 1) / n));
+
+		for (size_t i = 0; i < n; i++)
+			threads[i].join();
+	}
+
+	// Every triangle edge joins two vertices; the triangles around each
+	// vertex are listed (in a counting sort by vertex), and the neighbour
+	// across an edge is the one other triangle around its first vertex that
+	// also has its second vertex
+	void get_all_triangle_neighbours(void)
+	{
+		vertex_offsets.assign(vertices.size() + 1, 0);
+
+		for (size_t t = 0; t < triangles.size(); t++)
+			for (size_t k = 0; k < 3; k++)
+				vertex_offsets[triangles[t].vertex[k] + 1]++;
+
+		for (size_t i = 0; i < vertices.size(); i++)
+			vertex_offsets[i + 1] += vertex_offsets[i];
+
+		vertex_triangles.resize(vertex_offsets.back());
+
+		vector<size_t> fill(vertex_offsets.begin(), vertex_offsets.end() - 1);
+
+		for (size_t t = 0; t < triangles.size(); t++)
+			for (size_t k = 0; k < 3; k++)
+				vertex_triangles[fill[triangles[t].vertex[k]]++] = t;
+
+		triangle_neighbours.resize(3 * triangles.size());
+		run_ranges(&surface_data_t<T>::get_neighbour_range);
+
+		vector<size_t>().swap(vertex_offsets);
+		vector<size_t>().swap(vertex_triangles);
+	}
+
+	void get_neighbour_range(const size_t begin, const size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				const size_t a = triangles[t].vertex[k];
+				const size_t b = triangles[t].vertex[(k + 1) % 3];
+				size_t neighbour = no_neighbour;
+				size_t count = 0;
+
+				for (size_t i = vertex_offsets[a]; i < vertex_offsets[a + 1]; i++)
+				{
+					const indexed_triangle& other = triangles[vertex_triangles[i]];
+
+					if (vertex_triangles[i] != t && (b == other.vertex[0] || b == other.vertex[1] || b == other.vertex[2]))
+					{
+						neighbour = vertex_triangles[i];
+						count++;
+					}
+				}
+
+				triangle_neighbours[3 * t + k] = (1 == count) ? neighbour : no_neighbour;
+			}
+		}
+	}
+
+	// As with the line segments: the mean of (1 - cos(angle)) / 2 between
+	// the face normal and those of the neighbours
+	void get_curvature_range(const size_t begin, const size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			T d = 0;
+			size_t num_neighbours = 0;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				const size_t n = triangle_neighbours[3 * t + k];
+
+				if (no_neighbour == n)
+					continue;
+
+				d += face_normals[t].dot(face_normals[n]);
+				num_neighbours++;
+			}
+
+			// A lone triangle has no curvature
+			if (0 == num_neighbours)
+				triangle_curvatures[t] = 0;
+			else
+				triangle_curvatures[t] = (1 - d / num_neighbours) / 2;
+		}
+	}
+
+	size_t num_threads;
+
+	// The triangles around each vertex, while the neighbours are found
+	vector<size_t> vertex_offsets;
+	vector<size_t> vertex_triangles;
+};
+
+template<typename T>
+const size_t surface_data_t<T>::no_neighbour;
+
+typedef vertex_3_t<real_type> vertex_3;
+typedef surface_data_t<real_type> surface_data;
+
+
+// The slice positions, including the virtual border if there is one
+//
+// Slice 0 is at the top (the largest z), as row 0 of an image is, so that
+// the volume is the right way around for a right-handed frame
+template<typename T>
+void get_slice_coordinates(const grid_parameters& gp, const size_t pz, vector<T>& zs)
+{
+	const size_t pad = gp.virtual_border ? 1 : 0;
+	const double z_max = gp.step_size * (static_cast<double>(pz) - 1.0) / 2.0;
+
+	zs.resize(pz + 2 * pad);
+
+	for (size_t z = 0; z < zs.size(); z++)
+		zs[z] = static_cast<T>(z_max - gp.step_size * (static_cast<double>(z) - static_cast<double>(pad)));
+}
+
+// March over the whole volume, splitting its layers into one slab per thread
+//
+// Each thread fetches the slices of its slab in order, and only holds two
+// of them at a time; the slabs are merged into sd in order, so the output is
+// the same for any number of threads. With gp.virtual_border, the volume is
+// one voxel larger on every side, and the surfaces are closed
+// Returns false if a slice could not be read
+template<typename T>
+bool march_cubes(volume_source& src, const grid_parameters& gp, surface_data_t<T>& sd, size_t& box_count, const size_t num_threads)
+{
+	const marching_cubes_table& table = get_marching_cubes_table();
+	const size_t pad = gp.virtual_border ? 1 : 0;
+
+	vector<T> xs, ys, zs;
+	get_grid_coordinates(gp, src.get_px(), src.get_py(), xs, ys);
+	get_slice_coordinates(gp, src.get_pz(), zs);
+
+	const size_t num_layers = zs.size() - 1;
+	size_t n = get_num_threads(num_threads);
+
+	if (n > num_layers)
+		n = num_layers;
+
+	vector<march_slab_t<T> > slabs(n);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		slabs[i].layer_begin = num_layers * i / n;
+		slabs[i].layer_end = num_layers * (i + 1) / n;
+	}
+
+	if (!sd.quiet)
+		cout << "Marching cubes" << endl;
+
+	{
+		stage_timer timer(sd.stats, "march");
+
+		if (1 == n)
+		{
+			march_cube_slab(src, xs, ys, zs, static_cast<T>(gp.isovalue), pad, gp.get_border_value(), table, slabs[0]);
+		}
+		else
+		{
+			vector<thread> threads;
+
+			for (size_t i = 0; i < n; i++)
+				threads.push_back(thread(march_cube_slab<T>, std::ref(src), std::cref(xs), std::cref(ys), std::cref(zs), static_cast<T>(gp.isovalue), pad, gp.get_border_value(), std::cref(table), std::ref(slabs[i])));
+
+			for (size_t i = 0; i < n; i++)
+				threads[i].join();
+		}
+	}
+
+	box_count = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (false == slabs[i].ok)
+			return false;
+
+		box_count += slabs[i].box_count;
+
+		if (0 != sd.stats)
+			sd.stats->num_cells += slabs[i].num_cubes;
+	}
+
+	if (false == sd.merge_slabs(slabs))
+		return false;
+
+	if (0 != sd.stats)
+	{
+		sd.stats->box_count += box_count;
+		sd.stats->num_vertices += sd.vertices.size();
+	}
+
+	if (!sd.quiet)
+	{
+		cout << "Vertices: " << sd.vertices.size() << endl;
+		cout << "Triangles: " << sd.triangles.size() << endl;
+	}
+
+	return true;
+}
+
+// Fill in the surface dimensions from the curvatures and the box count
+//
+// For a surface, the curvature-based dimension is 2 plus the mean curvature,
+// as it is 1 plus the mean curvature for a curve
+template<typename T>
+void get_surface_dimensions(const vector<T>& k, const size_t box_count, const grid_parameters& gp, analysis_result& result)
+{
+	get_dimensions(k, box_count, gp, result);
+
+	result.curvature_dimension += 1.0;
+}
+
+// Run the whole pipeline on a volume
+// Returns false if a slice could not be read
+template<typename T>
+bool analyse_volume(volume_source& src, const grid_parameters& gp, surface_data_t<T>& sd, analysis_result& result, const size_t num_threads)
+{
+	size_t box_count = 0;
+
+	if (false == march_cubes(src, gp, sd, box_count, num_threads))
+		return false;
+
+	sd.process_triangles(get_num_threads(num_threads));
+
+	get_surface_dimensions(sd.triangle_curvatures, box_count, gp, result);
+
+	return true;
+}
+
+// Analyse a volume, and print its dimensions
+bool run_volume(volume_source& src, const double isovalue, const bool virtual_border, const size_t num_threads, const bool quiet, pipeline_stats* const stats)
+{
+	if (src.get_px() < 3 || src.get_py() < 3 || src.get_px() != src.get_py() || src.get_pz() < 2)
+	{
+		cout << "The slices must be square, and at least 3x3 pixels in size, and there must be at least 2 of them." << endl;
+		return false;
+	}
+
+	grid_parameters gp;
+	gp.set(src.get_px(), src.get_py(), isovalue);
+	gp.virtual_border = virtual_border;
+
+	surface_data sd;
+	sd.quiet = quiet;
+	sd.stats = stats;
+
+	analysis_result result;
+
+	if (false == analyse_volume(src, gp, sd, result, num_threads))
+	{
+		cout << "Error reading the volume" << endl;
+		return false;
+	}
+
+	cout << src.get_px() << " x " << src.get_py() << " x " << src.get_pz() << " voxels" << endl;
+	cout << "Triangles: " << sd.triangles.size() << ", vertices: " << sd.vertices.size() << endl;
+
+	if (!sd.closed)
+		cout << "Open surfaces: some triangle edges have no neighbour" << endl;
+
+	cout << "Curvature:                 " << result.curvature << " +/- " << result.curvature_standard_deviation << endl;
+	cout << "Curvature-based dimension: " << result.curvature_dimension << endl;
+	cout << "Box-counting dimension:    " << result.box_counting_dimension << endl;
+
+	return true;
+}
+
+#endif
@@ -10,33 +10,38 @@ using std::vector;
 
 #include "primitives.h"
 
-class grid_square
+template<typename T>
+class grid_square_t
 {
 public:
-	vertex_2 vertex[4];
-	double value[4];
+	vertex_2_t<T> vertex[4];
+	T value[4];
 
-	grid_square(void)
+	// Case mask of the last call to generate_primitives()
+	unsigned short int mask;
+
+	grid_square_t(void)
 	{
 		value[0] = value[1] = value[2] = value[3] = 0;
+		mask = 0;
 	}
 
-	inline vertex_2 vertex_interp(vertex_2 p1, vertex_2 p2, double v1, double v2, const double isovalue)
+	inline vertex_2_t<T> vertex_interp(vertex_2_t<T> p1, vertex_2_t<T> p2, T v1, T v2, const T isovalue)
 	{
 		// Sort the vertices to avoid cracks in the mesh
 		if (p2 < p1)
 		{
-			vertex_2 tv = p1;
+			vertex_2_t<T> tv = p1;
 			p1 = p2;
 			p2 = tv;
 
-			double td = v1;
+			T td = v1;
 			v1 = v2;
 			v2 = td;
 		}
 
-		static vertex_2 temp;
-		static double mu;
+		vertex_2_t<T> temp;
+		T mu;
 
 		// http://paulbourke.net/geometry/polygonise/
 		mu = (isovalue - v1)/(v2 - v1);
@@ -46,7 +51,7 @@ public:
 		return temp;
 	}
 
-	inline short unsigned int generate_primitives(vector<line_segment> &line_segments, const double isovalue)
+	inline short unsigned int generate_primitives(vector<line_segment_t<T> > &line_segments, const T isovalue)
 	{
 		// Identify which of the 4 corners of the square are within the isosurface
 		//
@@ -55,7 +60,7 @@ public:
 		// Corner vertex order: 03
 		//                      12
 
-		unsigned short int mask = 0;
+		mask = 0;
 
 		if(value[0] >= isovalue) 
 			mask |= 1;
@@ -70,10 +75,10 @@ public:
 			mask |= 8;
 
 		// Max 6 vertices per grid cube
-		static vertex_2 a, b, c, d, e, f;
+		vertex_2_t<T> a, b, c, d, e, f;
 		
 		// Max two line segments per grid cube
-		static line_segment ls;
+		line_segment_t<T> ls;
 
 		// Handle the 16 cases manually
 		switch(mask)
@@ -334,4 +339,6 @@ public:
 	}
 };
 
+typedef grid_square_t<real_type> grid_square;
+
 #endif
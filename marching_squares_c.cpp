@@ -0,0 +1,241 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+// The shared library behind marching_squares_c.h:
+//
+// g++ -std=c++11 -O3 -pthread -shared -fPIC -fvisibility=hidden marching_squares_c.cpp -o libmarching_squares.so
+//
+// Only the ms_ functions are exported; the rest of the code is hidden, so
+// that it cannot clash with the caller's own symbols
+
+
+#include "marching_squares_c.h"
+#include "pipeline.h"
+
+#include <chrono>
+#include <new>
+#include <cstring>
+#include <cstddef>
+
+
+// The sizes of the structs in version 1 of the interface: the smallest
+// struct_size that is accepted. Larger structs, from callers built against
+// a later version, have their extra fields ignored, and smaller ones (from
+// an earlier version) have theirs defaulted (or not written)
+static const size_t ms_options_v1_size = offsetof(ms_options, morton_order) + sizeof(int);
+static const size_t ms_result_v1_size = offsetof(ms_result, seconds) + sizeof(double);
+static const size_t ms_geometry_v1_size = offsetof(ms_geometry, contour_capacity) + sizeof(size_t);
+
+static size_t get_min_size(const size_t a, const size_t b)
+{
+	return (a < b) ? a : b;
+}
+
+
+int ms_get_api_version(void)
+{
+	return MS_API_VERSION;
+}
+
+void ms_get_default_options(ms_options* options)
+{
+	if (0 == options)
+		return;
+
+	options->struct_size = sizeof(ms_options);
+	options->isovalue = 0.5;
+	options->border = MS_BORDER_VIRTUAL;
+	options->num_threads = 0;
+	options->morton_order = 0;
+}
+
+const char* ms_get_status_string(int status)
+{
+	switch (status)
+	{
+	case MS_OK:
+		return "ok";
+	case MS_ERROR_ARGUMENT:
+		return "invalid argument";
+	case MS_ERROR_IMAGE_SIZE:
+		return "image must be at least 3x3 pixels in size";
+	case MS_ERROR_GEOMETRY_CAPACITY:
+		return "geometry arrays are too small";
+	case MS_ERROR_ANALYSIS:
+		return "could not calculate the curvatures";
+	case MS_ERROR_OUT_OF_MEMORY:
+		return "out of memory";
+	default:
+		return "unknown status";
+	}
+}
+
+// Copy the geometry into the caller's arrays
+// Returns false if any of them is too small
+static bool copy_geometry(const line_segment_data& lsd, ms_geometry& g)
+{
+	const size_t num_vertices = lsd.vertices.size();
+	const size_t num_segments = lsd.line_segments.size();
+	const size_t num_contours = lsd.get_num_contours();
+
+	if (0 != g.vertices && g.vertex_capacity < num_vertices)
+		return false;
+
+	if ((0 != g.segments || 0 != g.face_normals || 0 != g.curvatures || 0 != g.contour_segments) && g.segment_capacity < num_segments)
+		return false;
+
+	if (0 != g.contour_offsets && g.contour_capacity < num_contours)
+		return false;
+
+	if (0 != g.vertices)
+	{
+		for (size_t i = 0; i < num_vertices; i++)
+		{
+			g.vertices[2 * i] = lsd.vertices[i].x;
+			g.vertices[2 * i + 1] = lsd.vertices[i].y;
+		}
+	}
+
+	for (size_t i = 0; i < num_segments; i++)
+	{
+		if (0 != g.segments)
+		{
+			g.segments[2 * i] = lsd.line_segments[i].vertex[0].index;
+			g.segments[2 * i + 1] = lsd.line_segments[i].vertex[1].index;
+		}
+
+		if (0 != g.face_normals)
+		{
+			g.face_normals[2 * i] = lsd.face_normals[i].x;
+			g.face_normals[2 * i + 1] = lsd.face_normals[i].y;
+		}
+
+		if (0 != g.curvatures)
+			g.curvatures[i] = lsd.segment_curvatures[i];
+	}
+
+	if (0 != g.contour_offsets)
+		for (size_t i = 0; i < lsd.contour_offsets.size(); i++)
+			g.contour_offsets[i] = lsd.contour_offsets[i];
+
+	if (0 != g.contour_segments)
+		for (size_t i = 0; i < lsd.contour_segments.size(); i++)
+			g.contour_segments[i] = lsd.contour_segments[i];
+
+	return true;
+}
+
+int ms_analyse(const ms_image* image, const ms_options* options, ms_result* result, ms_geometry* geometry)
+{
+	if (0 == image || 0 == image->pixels || 0 == result || result->struct_size < ms_result_v1_size)
+		return MS_ERROR_ARGUMENT;
+
+	if (0 != geometry && geometry->struct_size < ms_geometry_v1_size)
+		return MS_ERROR_ARGUMENT;
+
+	ms_options o;
+	ms_get_default_options(&o);
+
+	if (0 != options)
+	{
+		if (options->struct_size < ms_options_v1_size)
+			return MS_ERROR_ARGUMENT;
+
+		// Only the fields that the caller knows of replace the defaults
+		memcpy(&o, options, get_min_size(options->struct_size, sizeof(ms_options)));
+		o.struct_size = sizeof(ms_options);
+	}
+
+	// Any fields that the caller's geometry struct lacks are null
+	ms_geometry g;
+	memset(&g, 0, sizeof(g));
+
+	if (0 != geometry)
+		memcpy(&g, geometry, get_min_size(geometry->struct_size, sizeof(ms_geometry)));
+
+	if (MS_BORDER_VIRTUAL != o.border && MS_BORDER_NONE != o.border)
+		return MS_ERROR_ARGUMENT;
+
+	size_t pixel_size = 0;
+
+	if (MS_PIXEL_U8_GRAY == image->format)
+		pixel_size = 1;
+	else if (MS_PIXEL_RGB24 == image->format)
+		pixel_size = 3;
+	else if (MS_PIXEL_FLOAT32 == image->format)
+		pixel_size = sizeof(float);
+	else
+		return MS_ERROR_ARGUMENT;
+
+	if (image->width < 3 || image->height < 3)
+		return MS_ERROR_IMAGE_SIZE;
+
+	if (image->stride < image->width * pixel_size)
+		return MS_ERROR_ARGUMENT;
+
+	try
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		grid_parameters gp;
+		gp.set(image->width, image->height, o.isovalue);
+		gp.virtual_border = (MS_BORDER_VIRTUAL == o.border);
+
+		line_segment_data lsd;
+		lsd.quiet = true;
+		lsd.morton_order = (0 != o.morton_order);
+
+		analysis_result r;
+		bool analysed = false;
+
+		if (MS_PIXEL_U8_GRAY == image->format)
+		{
+			// Already quantised luma, so it is classified as it is
+			const size_t box_count = march_squares(static_cast<const unsigned char*>(image->pixels), image->width, image->height, image->stride, gp, lsd.line_segments, 0, o.num_threads);
+			analysed = analyse_line_segments(lsd, box_count, gp, r);
+		}
+		else
+		{
+			pixel_buffer_source src(image->pixels, image->width, image->height, image->stride, (MS_PIXEL_RGB24 == image->format) ? pixel_buffer_source::rgb_pixels : pixel_buffer_source::float_pixels);
+			analysed = analyse_source(src, gp, lsd, r, o.num_threads);
+		}
+
+		if (false == analysed)
+			return MS_ERROR_ANALYSIS;
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		ms_result out;
+		out.struct_size = result->struct_size;
+		out.curvature = r.curvature;
+		out.curvature_standard_deviation = r.curvature_standard_deviation;
+		out.curvature_dimension = r.curvature_dimension;
+		out.box_counting_dimension = r.box_counting_dimension;
+		out.box_count = r.box_count;
+		out.num_vertices = lsd.vertices.size();
+		out.num_segments = lsd.line_segments.size();
+		out.num_contours = lsd.get_num_contours();
+		out.num_open_contours = lsd.get_num_open_contours();
+		out.x_min = gp.grid_x_min;
+		out.y_max = gp.grid_y_max;
+		out.step_size = gp.step_size;
+		out.seconds = elapsed.count();
+
+		// Only the fields that fit into the caller's struct are written
+		memcpy(result, &out, get_min_size(result->struct_size, sizeof(ms_result)));
+
+		if (0 != geometry && false == copy_geometry(lsd, g))
+			return MS_ERROR_GEOMETRY_CAPACITY;
+	}
+	catch (const std::bad_alloc&)
+	{
+		return MS_ERROR_OUT_OF_MEMORY;
+	}
+	catch (...)
+	{
+		return MS_ERROR_ANALYSIS;
+	}
+
+	return MS_OK;
+}
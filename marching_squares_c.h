@@ -0,0 +1,162 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+// C interface to the analysis, for use from a shared library
+// (see marching_squares_c.cpp)
+//
+// The caller keeps ownership of every buffer: the pixels are read in place,
+// and the results (and, optionally, the geometry) are written into structs
+// and arrays that the caller provides. The structs begin with their size,
+// so that fields can be added at their ends without breaking callers that
+// were built against an older version of this header: any struct_size that
+// covers the version 1 fields is accepted, missing option fields take their
+// defaults, and only the result fields that fit are written
+
+
+#ifndef MARCHING_SQUARES_C_H
+#define MARCHING_SQUARES_C_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#define MS_API __declspec(dllexport)
+#elif defined(__GNUC__)
+	#define MS_API __attribute__((visibility("default")))
+#else
+	#define MS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define MS_API_VERSION 1
+
+// Pixel formats
+//
+// MS_PIXEL_U8_GRAY: 1 byte per pixel, luma 0 to 255 (read as 0 to 1)
+// MS_PIXEL_RGB24:   3 bytes per pixel, R, G, B, converted to BT.709 luma
+// MS_PIXEL_FLOAT32: 1 native-endian float per pixel, used as is
+#define MS_PIXEL_U8_GRAY 0
+#define MS_PIXEL_RGB24 1
+#define MS_PIXEL_FLOAT32 2
+
+// Border modes, as for --border
+#define MS_BORDER_VIRTUAL 0
+#define MS_BORDER_NONE 1
+
+// Status codes
+#define MS_OK 0
+#define MS_ERROR_ARGUMENT 1
+#define MS_ERROR_IMAGE_SIZE 2
+#define MS_ERROR_GEOMETRY_CAPACITY 3
+#define MS_ERROR_ANALYSIS 4
+#define MS_ERROR_OUT_OF_MEMORY 5
+
+
+// The caller's image; row y starts at pixels + y * stride (in bytes)
+typedef struct ms_image
+{
+	const void* pixels;
+	size_t width;
+	size_t height;
+	size_t stride;
+	int format;
+} ms_image;
+
+typedef struct ms_options
+{
+	size_t struct_size;
+
+	// Pixels at or above the isovalue are inside of the contours
+	double isovalue;
+
+	int border;
+
+	// 0 for all cores
+	size_t num_threads;
+
+	// Non-zero to renumber the geometry along a Z-order curve (--morton)
+	int morton_order;
+} ms_options;
+
+typedef struct ms_result
+{
+	size_t struct_size;
+
+	double curvature;
+	double curvature_standard_deviation;
+	double curvature_dimension;
+	double box_counting_dimension;
+
+	uint64_t box_count;
+	uint64_t num_vertices;
+	uint64_t num_segments;
+	uint64_t num_contours;
+	uint64_t num_open_contours;
+
+	// Pixel (x, y) is at (x_min + step_size * x, y_max - step_size * y) in
+	// the plane of the geometry
+	double x_min;
+	double y_max;
+	double step_size;
+
+	double seconds;
+} ms_result;
+
+// Arrays that the caller provides for the geometry; any of them may be
+// null, in which case it is not written. Each must hold as many elements
+// as it says, for the counts that come back in ms_result
+typedef struct ms_geometry
+{
+	size_t struct_size;
+
+	// vertex_capacity vertices: x, y
+	double* vertices;
+	size_t vertex_capacity;
+
+	// segment_capacity line segments: two vertex indices, a face normal
+	// (x, y) and a curvature for each
+	uint64_t* segments;
+	double* face_normals;
+	double* curvatures;
+	size_t segment_capacity;
+
+	// The contours: contour c is the line segments
+	// contour_segments[contour_offsets[c]] to
+	// contour_segments[contour_offsets[c + 1] - 1], in walk order; there
+	// are contour_capacity + 1 offsets, and segment_capacity line segments
+	uint64_t* contour_offsets;
+	uint64_t* contour_segments;
+	size_t contour_capacity;
+} ms_geometry;
+
+
+// MS_API_VERSION of the library
+MS_API int ms_get_api_version(void);
+
+// Fill in the default options: isovalue 0.5, virtual border, all cores
+MS_API void ms_get_default_options(ms_options* options);
+
+// Analyse the image, and write the results into result
+//
+// options may be null for the defaults, and geometry may be null for no
+// geometry. If the geometry does not fit, the result (with the counts)
+// is still written, and MS_ERROR_GEOMETRY_CAPACITY is returned, so that the
+// caller can grow the arrays and call again
+// Safe to call from several threads at once
+MS_API int ms_analyse(const ms_image* image, const ms_options* options, ms_result* result, ms_geometry* geometry);
+
+// A description of a status code
+MS_API const char* ms_get_status_string(int status);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef MULTI_RADIUS_H
+#define MULTI_RADIUS_H
+
+
+// Curvature over wider neighbourhoods of each line segment
+//
+// The usual curvature of line segment i compares its face normal with those
+// of its two neighbours; at radius r, it compares it with the face normals of
+// the line segments r steps away along the contour, in both directions:
+//
+//   k_r(i) = (1 - (cos(a(i, i - r)) + cos(a(i, i + r))) / 2) / 2
+//
+// where a(i, j) is the angle between the face normals of i and j, which is the
+// sum of the signed turning angles between them. With a prefix sum of the
+// turning angles along each contour, each radius costs O(n), and at radius 1
+// this is the usual curvature. Pixel-scale stair-stepping turns one way and
+// then back, so it cancels out at the larger radii
+//
+// Closed contours wrap around; on an open contour, a neighbour that would be
+// past the end is the end line segment, and the end line segments themselves
+// are one-sided, as for the usual curvature
+
+
+#include "primitives.h"
+#include "pipeline.h"
+
+#include <vector>
+using std::vector;
+
+#include <cmath>
+
+
+// The curvature-based dimension at one radius
+class radius_result
+{
+public:
+
+	radius_result(void)
+	{
+		radius = 0;
+		scale = 0;
+		curvature = curvature_standard_deviation = 0;
+		curvature_dimension = 0;
+	}
+
+	size_t radius;
+
+	// The mean distance, along the contours, from a line segment to the
+	// ones that it is compared with
+	double scale;
+
+	double curvature;
+	double curvature_standard_deviation;
+	double curvature_dimension;
+};
+
+
+// The per-segment curvature at each of the radii; k[r][i] is the curvature of
+// line segment i at radii[r]
+// lsd must have been through process_line_segments()
+template<typename T>
+void get_multi_radius_curvatures(const line_segment_data_t<T>& lsd, const vector<size_t>& radii, vector<vector<T> >& k)
+{
+	stage_timer timer(lsd.stats, "multi-radius");
+
+	k.assign(radii.size(), vector<T>(lsd.line_segments.size(), 0));
+
+	vector<double> turning;
+	vector<double> prefix;
+
+	for (size_t c = 0; c + 1 < lsd.contour_offsets.size(); c++)
+	{
+		const size_t begin = lsd.contour_offsets[c];
+		const size_t n = lsd.contour_offsets[c + 1] - begin;
+		const bool closed = lsd.contour_closed[c];
+
+		// A lone line segment has no curvature
+		if (n < 2)
+			continue;
+
+		// turning[j] is the signed angle from the face normal of j to that of j + 1
+		// (wrapping around on a closed contour)
+		const size_t num_turns = closed ? n : n - 1;
+		turning.resize(num_turns);
+
+		for (size_t j = 0; j < num_turns; j++)
+		{
+			const vertex_2_t<T>& a = lsd.face_normals[lsd.contour_segments[begin + j]];
+			const vertex_2_t<T>& b = lsd.face_normals[lsd.contour_segments[begin + (j + 1) % n]];
+
+			turning[j] = atan2(static_cast<double>(a.x) * b.y - static_cast<double>(a.y) * b.x, static_cast<double>(a.x) * b.x + static_cast<double>(a.y) * b.y);
+		}
+
+		// prefix[j] is the angle from line segment 0 to line segment j
+		prefix.resize(n + 1);
+		prefix[0] = 0;
+
+		for (size_t j = 0; j < num_turns; j++)
+			prefix[j + 1] = prefix[j] + turning[j];
+
+		// The turning all the way around a closed contour
+		const double total = closed ? prefix[n] : 0;
+
+		for (size_t r = 0; r < radii.size(); r++)
+		{
+			const size_t radius = radii[r];
+			vector<T>& kr = k[r];
+
+			for (size_t i = 0; i < n; i++)
+			{
+				double sum = 0;
+				size_t num_neighbours = 0;
+
+				if (closed)
+				{
+					// Angles to i + radius and i - radius, unwrapping the prefix sum
+					const size_t ahead = i + radius;
+					const double ahead_angle = prefix[ahead % n] + total * static_cast<double>(ahead / n) - prefix[i];
+
+					const size_t laps = (radius + n - 1) / n;
+					const size_t behind = i + laps * n - radius;
+					const double behind_angle = prefix[i] - prefix[behind % n] - total * (static_cast<double>(behind / n) - static_cast<double>(laps));
+
+					sum = cos(ahead_angle) + cos(behind_angle);
+					num_neighbours = 2;
+				}
+				else
+				{
+					if (i + 1 < n)
+					{
+						const size_t ahead = (i + radius < n) ? i + radius : n - 1;
+						sum += cos(prefix[ahead] - prefix[i]);
+						num_neighbours++;
+					}
+
+					if (i > 0)
+					{
+						const size_t behind = (i > radius) ? i - radius : 0;
+						sum += cos(prefix[i] - prefix[behind]);
+						num_neighbours++;
+					}
+				}
+
+				kr[lsd.contour_segments[begin + i]] = static_cast<T>((1 - sum / static_cast<double>(num_neighbours)) / 2);
+			}
+		}
+	}
+}
+
+// The curvature-based dimension at each of the radii
+template<typename T>
+void get_multi_radius_dimensions(const line_segment_data_t<T>& lsd, const vector<size_t>& radii, vector<radius_result>& results)
+{
+	vector<vector<T> > k;
+	get_multi_radius_curvatures(lsd, radii, k);
+
+	// The mean line segment length, to turn radii into distances
+	double length = 0;
+
+	for (size_t i = 0; i < lsd.line_segments.size(); i++)
+	{
+		const line_segment_t<T>& ls = lsd.line_segments[i];
+		const double dx = static_cast<double>(ls.vertex[1].x) - ls.vertex[0].x;
+		const double dy = static_cast<double>(ls.vertex[1].y) - ls.vertex[0].y;
+
+		length += sqrt(dx * dx + dy * dy);
+	}
+
+	if (0 < lsd.line_segments.size())
+		length /= static_cast<double>(lsd.line_segments.size());
+
+	results.resize(radii.size());
+
+	for (size_t r = 0; r < radii.size(); r++)
+	{
+		double K = 0;
+
+		for (size_t i = 0; i < k[r].size(); i++)
+			K += k[r][i];
+
+		if (0 < k[r].size())
+			K /= static_cast<double>(k[r].size());
+
+		results[r].radius = radii[r];
+		results[r].scale = length * static_cast<double>(radii[r]);
+		results[r].curvature = K;
+		results[r].curvature_standard_deviation = (0 < k[r].size()) ? standard_deviation(k[r]) : 0;
+		results[r].curvature_dimension = 1.0 + K;
+	}
+}
+
+#endif
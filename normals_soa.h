@@ -0,0 +1,306 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef NORMALS_SOA_H
+#define NORMALS_SOA_H
+
+
+#include <cmath>
+#include <cfloat>
+
+#include <vector>
+using std::vector;
+
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif
+
+
+// Face normal and curvature kernel over ordered contours
+//
+// Each contour is a polyline, closed or open, whose vertices are stored
+// structure-of-arrays in x and y; line segment j runs from vertex j to
+// vertex j + 1
+//
+// The unit normal of line segment j is (dy, -dx) / |d|, where d = v[j + 1] - v[j]
+// The curvature of line segment j is (1 - (n[j].n[j - 1] + n[j].n[j + 1]) / 2) / 2,
+// or (1 - n[j].n[j +/- 1]) / 2 at the ends of an open contour
+//
+// Compile with -mavx2 (or /arch:AVX2) to get the AVX2 kernel; otherwise the
+// scalar kernel is used. The AVX2 kernel uses a reciprocal square root estimate
+// plus Newton-Raphson refinement (one step for float, two for double), so its
+// normal components may differ from the scalar ones by up to
+// get_soa_normal_tolerance<T>(), and its curvatures by up to twice that
+
+
+template<typename T>
+T get_soa_normal_tolerance(void);
+
+template<>
+float get_soa_normal_tolerance<float>(void)
+{
+	return 1e-6f;
+}
+
+template<>
+double get_soa_normal_tolerance<double>(void)
+{
+	return 1e-12;
+}
+
+
+// Normals [begin, end), one at a time
+template<typename T>
+void get_unit_normals_scalar(const T* const dx, const T* const dy, T* const nx, T* const ny, const size_t begin, const size_t end)
+{
+	// Safe to use in place (nx == dx, ny == dy)
+	for (size_t i = begin; i < end; i++)
+	{
+		const T x = dx[i];
+		const T y = dy[i];
+		const T len = sqrt(x * x + y * y);
+
+		if (0 != len)
+		{
+			nx[i] = y / len;
+			ny[i] = -x / len;
+		}
+		else
+		{
+			nx[i] = ny[i] = 0;
+		}
+	}
+}
+
+// Curvatures [begin, end), where every line segment has a line segment on each side
+template<typename T>
+void get_curvatures_scalar(const T* const nx, const T* const ny, T* const k, const size_t begin, const size_t end)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		T d_i = (nx[i] * nx[i - 1] + ny[i] * ny[i - 1]) + (nx[i] * nx[i + 1] + ny[i] * ny[i + 1]);
+		d_i /= 2;
+
+		k[i] = (1 - d_i) / 2;
+	}
+}
+
+
+#ifdef __AVX2__
+
+void get_unit_normals_simd(const float* const dx, const float* const dy, float* const nx, float* const ny, const size_t begin, const size_t end)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 three_halves = _mm256_set1_ps(1.5f);
+	const __m256 smallest = _mm256_set1_ps(FLT_MIN);
+
+	size_t i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		const __m256 x = _mm256_loadu_ps(dx + i);
+		const __m256 y = _mm256_loadu_ps(dy + i);
+		const __m256 len2 = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+
+		// Zero length (or denormal) line segments go the scalar route
+		if (0 != _mm256_movemask_ps(_mm256_cmp_ps(len2, smallest, _CMP_LT_OQ)))
+		{
+			get_unit_normals_scalar(dx, dy, nx, ny, i, i + 8);
+			continue;
+		}
+
+		// r = r * (3/2 - len2/2 * r * r)
+		__m256 r = _mm256_rsqrt_ps(len2);
+		r = _mm256_mul_ps(r, _mm256_sub_ps(three_halves, _mm256_mul_ps(_mm256_mul_ps(half, len2), _mm256_mul_ps(r, r))));
+
+		_mm256_storeu_ps(nx + i, _mm256_mul_ps(y, r));
+		_mm256_storeu_ps(ny + i, _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(x, r)));
+	}
+
+	get_unit_normals_scalar(dx, dy, nx, ny, i, end);
+}
+
+void get_unit_normals_simd(const double* const dx, const double* const dy, double* const nx, double* const ny, const size_t begin, const size_t end)
+{
+	const __m256d half = _mm256_set1_pd(0.5);
+	const __m256d three_halves = _mm256_set1_pd(1.5);
+	const __m256d smallest = _mm256_set1_pd(FLT_MIN);
+	const __m256d largest = _mm256_set1_pd(FLT_MAX);
+
+	size_t i = begin;
+
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m256d x = _mm256_loadu_pd(dx + i);
+		const __m256d y = _mm256_loadu_pd(dy + i);
+		const __m256d len2 = _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+
+		// The estimate is done in single precision, so anything outside of
+		// its range (including zero length line segments) goes the scalar route
+		const __m256d out_of_range = _mm256_or_pd(_mm256_cmp_pd(len2, smallest, _CMP_LT_OQ), _mm256_cmp_pd(len2, largest, _CMP_GT_OQ));
+
+		if (0 != _mm256_movemask_pd(out_of_range))
+		{
+			get_unit_normals_scalar(dx, dy, nx, ny, i, i + 4);
+			continue;
+		}
+
+		__m256d r = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(len2)));
+		const __m256d half_len2 = _mm256_mul_pd(half, len2);
+		r = _mm256_mul_pd(r, _mm256_sub_pd(three_halves, _mm256_mul_pd(half_len2, _mm256_mul_pd(r, r))));
+		r = _mm256_mul_pd(r, _mm256_sub_pd(three_halves, _mm256_mul_pd(half_len2, _mm256_mul_pd(r, r))));
+
+		_mm256_storeu_pd(nx + i, _mm256_mul_pd(y, r));
+		_mm256_storeu_pd(ny + i, _mm256_sub_pd(_mm256_setzero_pd(), _mm256_mul_pd(x, r)));
+	}
+
+	get_unit_normals_scalar(dx, dy, nx, ny, i, end);
+}
+
+void get_curvatures_simd(const float* const nx, const float* const ny, float* const k, const size_t begin, const size_t end)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	size_t i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		const __m256 x = _mm256_loadu_ps(nx + i), y = _mm256_loadu_ps(ny + i);
+		const __m256 prev = _mm256_add_ps(_mm256_mul_ps(x, _mm256_loadu_ps(nx + i - 1)), _mm256_mul_ps(y, _mm256_loadu_ps(ny + i - 1)));
+		const __m256 next = _mm256_add_ps(_mm256_mul_ps(x, _mm256_loadu_ps(nx + i + 1)), _mm256_mul_ps(y, _mm256_loadu_ps(ny + i + 1)));
+		const __m256 d = _mm256_mul_ps(_mm256_add_ps(prev, next), half);
+
+		_mm256_storeu_ps(k + i, _mm256_mul_ps(_mm256_sub_ps(one, d), half));
+	}
+
+	get_curvatures_scalar(nx, ny, k, i, end);
+}
+
+void get_curvatures_simd(const double* const nx, const double* const ny, double* const k, const size_t begin, const size_t end)
+{
+	const __m256d half = _mm256_set1_pd(0.5);
+	const __m256d one = _mm256_set1_pd(1.0);
+
+	size_t i = begin;
+
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m256d x = _mm256_loadu_pd(nx + i), y = _mm256_loadu_pd(ny + i);
+		const __m256d prev = _mm256_add_pd(_mm256_mul_pd(x, _mm256_loadu_pd(nx + i - 1)), _mm256_mul_pd(y, _mm256_loadu_pd(ny + i - 1)));
+		const __m256d next = _mm256_add_pd(_mm256_mul_pd(x, _mm256_loadu_pd(nx + i + 1)), _mm256_mul_pd(y, _mm256_loadu_pd(ny + i + 1)));
+		const __m256d d = _mm256_mul_pd(_mm256_add_pd(prev, next), half);
+
+		_mm256_storeu_pd(k + i, _mm256_mul_pd(_mm256_sub_pd(one, d), half));
+	}
+
+	get_curvatures_scalar(nx, ny, k, i, end);
+}
+
+#else
+
+template<typename T>
+void get_unit_normals_simd(const T* const dx, const T* const dy, T* const nx, T* const ny, const size_t begin, const size_t end)
+{
+	get_unit_normals_scalar(dx, dy, nx, ny, begin, end);
+}
+
+template<typename T>
+void get_curvatures_simd(const T* const nx, const T* const ny, T* const k, const size_t begin, const size_t end)
+{
+	get_curvatures_scalar(nx, ny, k, begin, end);
+}
+
+#endif
+
+
+// Curvature of one line segment from explicit neighbour normals
+template<typename T>
+T get_curvature(const T nx, const T ny, const T prev_nx, const T prev_ny, const T next_nx, const T next_ny)
+{
+	T d_i = (nx * prev_nx + ny * prev_ny) + (nx * next_nx + ny * next_ny);
+	d_i /= 2;
+
+	return (1 - d_i) / 2;
+}
+
+// One-sided curvature, for the end line segments of an open contour
+template<typename T>
+T get_end_curvature(const T nx, const T ny, const T other_nx, const T other_ny)
+{
+	const T d_i = nx * other_nx + ny * other_ny;
+
+	return (1 - d_i) / 2;
+}
+
+// Normals and curvatures for every contour
+//
+// Contour c has offsets[c + 1] - offsets[c] line segments, and one more vertex
+// than that, so its vertices occupy [offsets[c] + c, offsets[c + 1] + c] in
+// x and y; for a closed contour the last vertex repeats the first
+//
+// The end line segments of an open contour get one-sided curvatures
+// nx, ny and k are resized to the total number of line segments
+template<typename T>
+void get_contour_normals_and_curvatures(const vector<T>& x, const vector<T>& y, const vector<size_t>& offsets, const vector<bool>& closed, vector<T>& nx, vector<T>& ny, vector<T>& k)
+{
+	const size_t n = (offsets.empty()) ? 0 : offsets.back();
+
+	nx.resize(n);
+	ny.resize(n);
+	k.resize(n);
+
+	if (0 == n)
+		return;
+
+	// Edge vectors; these are stored in nx and ny, and then normalized in place
+	for (size_t c = 0; c + 1 < offsets.size(); c++)
+	{
+		const T* const cx = &x[offsets[c] + c];
+		const T* const cy = &y[offsets[c] + c];
+		T* const dx = &nx[offsets[c]];
+		T* const dy = &ny[offsets[c]];
+		const size_t count = offsets[c + 1] - offsets[c];
+
+		for (size_t i = 0; i < count; i++)
+		{
+			dx[i] = cx[i + 1] - cx[i];
+			dy[i] = cy[i + 1] - cy[i];
+		}
+	}
+
+	// The kernels read each element before writing it, so this is safe in place
+	get_unit_normals_simd(&nx[0], &ny[0], &nx[0], &ny[0], 0, n);
+
+	for (size_t c = 0; c + 1 < offsets.size(); c++)
+	{
+		const size_t begin = offsets[c];
+		const size_t end = offsets[c + 1];
+
+		if (end - begin < 2)
+		{
+			// A lone line segment has no neighbours
+			for (size_t i = begin; i < end; i++)
+				k[i] = 0;
+
+			continue;
+		}
+
+		if (closed[c])
+		{
+			// The first and last line segments wrap around the contour
+			k[begin] = get_curvature(nx[begin], ny[begin], nx[end - 1], ny[end - 1], nx[begin + 1], ny[begin + 1]);
+			k[end - 1] = get_curvature(nx[end - 1], ny[end - 1], nx[end - 2], ny[end - 2], nx[begin], ny[begin]);
+		}
+		else
+		{
+			k[begin] = get_end_curvature(nx[begin], ny[begin], nx[begin + 1], ny[begin + 1]);
+			k[end - 1] = get_end_curvature(nx[end - 1], ny[end - 1], nx[end - 2], ny[end - 2]);
+		}
+
+		get_curvatures_simd(&nx[0], &ny[0], &k[0], begin + 1, end - 1);
+	}
+}
+
+#endif
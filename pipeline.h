@@ -0,0 +1,934 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+
+#include "image.h"
+#include "primitives.h"
+#include "marching_squares.h"
+#include "stats.h"
+#include "image_source.h"
+
+#include <cmath>
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+using std::thread;
+
+
+// Maps the pixel grid onto the plane
+class grid_parameters
+{
+public:
+
+	double template_width;
+	double template_height;
+	double step_size;
+	double isovalue;
+	double grid_x_min;
+	double grid_y_max;
+
+	// Surround the image with a one pixel border of get_border_value(), supplied
+	// by the march, so that every contour is closed without touching the pixels
+	bool virtual_border;
+
+	grid_parameters(void)
+	{
+		template_width = template_height = step_size = 0;
+		isovalue = grid_x_min = grid_y_max = 0;
+		virtual_border = true;
+	}
+
+	// A value that is always outside of the contours (below the isovalue)
+	float get_border_value(void) const
+	{
+		if (isovalue > 0)
+			return 0;
+
+		return static_cast<float>(isovalue - 1.0);
+	}
+
+	void set(const size_t px, const size_t py, const double src_isovalue)
+	{
+		template_width = 1.0;
+		step_size = template_width / static_cast<double>(px - 1);
+		template_height = step_size * (py - 1); // Assumes square pixels.
+		isovalue = src_isovalue;
+		grid_x_min = -template_width / 2.0;
+		grid_y_max = template_height / 2.0;
+	}
+};
+
+
+// The dimension estimates for one image
+class analysis_result
+{
+public:
+
+	analysis_result(void)
+	{
+		curvature = curvature_standard_deviation = 0;
+		curvature_dimension = box_counting_dimension = 0;
+		box_count = 0;
+		isovalue = 0;
+	}
+
+	double curvature;
+	double curvature_standard_deviation;
+	double curvature_dimension;
+	double box_counting_dimension;
+	size_t box_count;
+
+	// The isovalue that the image was marched at
+	double isovalue;
+};
+
+
+template<typename T>
+double standard_deviation(const vector<T>& src)
+{
+    double mean = 0;
+    double size = static_cast<double>(src.size());
+
+    for (size_t i = 0; i < src.size(); i++)
+        mean += src[i];
+
+    mean /= size;
+
+    double sq_diff = 0;
+
+    for (size_t i = 0; i < src.size(); i++)
+    {
+        double diff = src[i] - mean;
+        sq_diff += diff * diff;
+    }
+
+    sq_diff /= size;
+
+    return sqrt(sq_diff);
+}
+
+
+size_t get_num_threads(const size_t requested)
+{
+	if (0 != requested)
+		return requested;
+
+	size_t n = thread::hardware_concurrency();
+
+	if (0 == n)
+		n = 1;
+
+	return n;
+}
+
+
+// Output of one horizontal band of the march
+template<typename T>
+class march_band_t
+{
+public:
+
+	march_band_t(void)
+	{
+		x_begin = x_end = 0;
+		y_begin = y_end = 0;
+		box_count = 0;
+		occupancy = 0;
+		occupancy_stride = 0;
+
+		for (size_t i = 0; i < 16; i++)
+			case_counts[i] = 0;
+	}
+
+	// Grid squares [x_begin, x_end) of rows [y_begin, y_end)
+	size_t x_begin, x_end;
+	size_t y_begin, y_end;
+	vector<line_segment_t<T> > line_segments;
+	size_t box_count;
+	size_t case_counts[16];
+
+	// If not 0, grid square (x, y) of the box count is marked with a 1 at
+	// occupancy[y * occupancy_stride + x]
+	unsigned int* occupancy;
+	size_t occupancy_stride;
+};
+
+
+// The grid squares that the march generated primitives in (the boxes of the
+// box count), and then their summed-area table (see lacunarity.h)
+class occupancy_table
+{
+public:
+
+	occupancy_table(void)
+	{
+		px = py = 0;
+	}
+
+	// Grid squares per row and column
+	size_t px, py;
+
+	// (px + 1) x (py + 1), with a zero first row and column; entry (x + 1,
+	// y + 1) is 1 where grid square (x, y) is occupied, or after integrate(),
+	// the number of occupied grid squares in [0, x] x [0, y]
+	vector<unsigned int> sums;
+
+	void reset(const size_t src_px, const size_t src_py)
+	{
+		px = src_px;
+		py = src_py;
+		sums.assign((px + 1) * (py + 1), 0);
+	}
+
+	size_t get_stride(void) const
+	{
+		return px + 1;
+	}
+
+	// Grid square (0, 0), for the march to mark; grid square (x, y) is at
+	// y * get_stride() + x
+	unsigned int* get_cells(void)
+	{
+		return &sums[get_stride() + 1];
+	}
+
+	// Turn the occupancy into its summed-area table: the rows are summed on
+	// their own, and then the columns, each split across the threads
+	void integrate(const size_t num_threads)
+	{
+		size_t n = get_num_threads(num_threads);
+
+		if (n > py)
+			n = py;
+
+		if (n < 2)
+		{
+			integrate_rows(1, py + 1);
+			integrate_columns(1, px + 1);
+
+			return;
+		}
+
+		vector<thread> threads;
+
+		for (size_t i = 0; i < n; i++)
+			threads.push_back(thread(&occupancy_table::integrate_rows, this, 1 + py * i / n, 1 + py * (i + 1) / n));
+
+		for (size_t i = 0; i < n; i++)
+			threads[i].join();
+
+		threads.clear();
+
+		for (size_t i = 0; i < n; i++)
+			threads.push_back(thread(&occupancy_table::integrate_columns, this, 1 + px * i / n, 1 + px * (i + 1) / n));
+
+		for (size_t i = 0; i < n; i++)
+			threads[i].join();
+	}
+
+	// The number of occupied grid squares in the r x r box at (x, y)
+	// Only valid after integrate()
+	inline unsigned int get_mass(const size_t x, const size_t y, const size_t r) const
+	{
+		const unsigned int* const top = &sums[y * get_stride() + x];
+		const unsigned int* const bottom = top + r * get_stride();
+
+		return bottom[r] - bottom[0] - top[r] + top[0];
+	}
+
+private:
+
+	void integrate_rows(const size_t y_begin, const size_t y_end)
+	{
+		for (size_t y = y_begin; y < y_end; y++)
+		{
+			unsigned int* const row = &sums[y * get_stride()];
+
+			for (size_t x = 1; x <= px; x++)
+				row[x] += row[x - 1];
+		}
+	}
+
+	void integrate_columns(const size_t x_begin, const size_t x_end)
+	{
+		for (size_t y = 1; y <= py; y++)
+		{
+			const unsigned int* const above = &sums[(y - 1) * get_stride()];
+			unsigned int* const row = &sums[y * get_stride()];
+
+			for (size_t x = x_begin; x < x_end; x++)
+				row[x] += above[x];
+		}
+	}
+};
+
+
+// The value of padded grid column x, where row is 0 for a border row
+template<typename P>
+inline P get_padded_value(const P* const row, const size_t x, const size_t pad, const size_t px, const P border_value)
+{
+	if (0 == row || x < pad || x >= px + pad)
+		return border_value;
+
+	return row[x - pad];
+}
+
+// March over grid squares [band.x_begin, band.x_end) of rows
+// [band.y_begin, band.y_end)
+//
+// rows[y - row_base] is pixel row y - pad, or 0 for a border row, and
+// grid column x is pixel column x - pad; the border is border_value
+//
+// The corner positions come from xs and ys, so that the corners shared
+// by neighbouring grid squares (and bands) are bitwise identical
+template<typename T>
+void march_grid_band(const vector<const float*>& rows, const size_t row_base, const vector<T>& xs, const vector<T>& ys, const T isovalue, const size_t pad, const float border_value, march_band_t<T>& band)
+{
+	const size_t px = xs.size() - 2 * pad;
+
+	for (size_t y = band.y_begin; y < band.y_end; y++)
+	{
+		const float* const row0 = rows[y - row_base];
+		const float* const row1 = rows[y + 1 - row_base];
+
+		for (size_t x = band.x_begin; x < band.x_end; x++)
+		{
+			// Corner vertex order: 03
+			//                      12
+
+			grid_square_t<T> g;
+
+			g.vertex[0] = vertex_2_t<T>(xs[x], ys[y]);
+			g.vertex[1] = vertex_2_t<T>(xs[x], ys[y + 1]);
+			g.vertex[2] = vertex_2_t<T>(xs[x + 1], ys[y + 1]);
+			g.vertex[3] = vertex_2_t<T>(xs[x + 1], ys[y]);
+
+			if (0 == pad)
+			{
+				g.value[0] = row0[x];
+				g.value[1] = row1[x];
+				g.value[2] = row1[x + 1];
+				g.value[3] = row0[x + 1];
+			}
+			else
+			{
+				g.value[0] = get_padded_value(row0, x, pad, px, border_value);
+				g.value[1] = get_padded_value(row1, x, pad, px, border_value);
+				g.value[2] = get_padded_value(row1, x + 1, pad, px, border_value);
+				g.value[3] = get_padded_value(row0, x + 1, pad, px, border_value);
+			}
+
+			// Add line segment primitives to line segment vector
+			//
+			// Box-counting dimension is very simple to calculate
+			// when using Marching Squares -- if primitives were added,
+			// then the boundary is covered by this particular
+			// grid_square (box)
+			if (0 < g.generate_primitives(band.line_segments, isovalue))
+			{
+				band.box_count++;
+
+				if (0 != band.occupancy)
+					band.occupancy[y * band.occupancy_stride + x] = 1;
+			}
+
+			band.case_counts[g.mask]++;
+		}
+	}
+}
+
+// The smallest quantised value that is inside of the contours, for an
+// isovalue that is already scaled by get_quantised_max<P>()
+// Comparing integers against this is the same as comparing T(value) against
+// the isovalue, since the values are whole numbers
+template<typename T>
+unsigned int get_quantised_threshold(const T scaled_isovalue)
+{
+	const double threshold = ceil(static_cast<double>(scaled_isovalue));
+
+	if (threshold <= 0)
+		return 0;
+
+	// Nothing is inside
+	if (threshold > 65536.0)
+		return 65536;
+
+	return static_cast<unsigned int>(threshold);
+}
+
+// As above, for quantised luma, where isovalue is scaled by get_quantised_max<P>()
+//
+// The grid squares are classified with integer comparisons, and only the ones
+// that the contour crosses are converted to T and interpolated
+template<typename T, typename P>
+void march_grid_band(const vector<const P*>& rows, const size_t row_base, const vector<T>& xs, const vector<T>& ys, const T isovalue, const size_t pad, const P border_value, march_band_t<T>& band)
+{
+	const size_t px = xs.size() - 2 * pad;
+	const unsigned int threshold = get_quantised_threshold(isovalue);
+
+	for (size_t y = band.y_begin; y < band.y_end; y++)
+	{
+		const P* const row0 = rows[y - row_base];
+		const P* const row1 = rows[y + 1 - row_base];
+
+		for (size_t x = band.x_begin; x < band.x_end; x++)
+		{
+			// Corner vertex order: 03
+			//                      12
+
+			const P v0 = get_padded_value(row0, x, pad, px, border_value);
+			const P v1 = get_padded_value(row1, x, pad, px, border_value);
+			const P v2 = get_padded_value(row1, x + 1, pad, px, border_value);
+			const P v3 = get_padded_value(row0, x + 1, pad, px, border_value);
+
+			unsigned short int mask = 0;
+
+			if (v0 >= threshold)
+				mask |= 1;
+
+			if (v1 >= threshold)
+				mask |= 2;
+
+			if (v2 >= threshold)
+				mask |= 4;
+
+			if (v3 >= threshold)
+				mask |= 8;
+
+			band.case_counts[mask]++;
+
+			if (0 == mask || 15 == mask)
+				continue;
+
+			grid_square_t<T> g;
+
+			g.vertex[0] = vertex_2_t<T>(xs[x], ys[y]);
+			g.vertex[1] = vertex_2_t<T>(xs[x], ys[y + 1]);
+			g.vertex[2] = vertex_2_t<T>(xs[x + 1], ys[y + 1]);
+			g.vertex[3] = vertex_2_t<T>(xs[x + 1], ys[y]);
+
+			g.value[0] = static_cast<T>(v0);
+			g.value[1] = static_cast<T>(v1);
+			g.value[2] = static_cast<T>(v2);
+			g.value[3] = static_cast<T>(v3);
+
+			if (0 < g.generate_primitives(band.line_segments, isovalue))
+			{
+				band.box_count++;
+
+				if (0 != band.occupancy)
+					band.occupancy[y * band.occupancy_stride + x] = 1;
+			}
+		}
+	}
+}
+
+// March over grid square rows [y_begin, y_end), splitting them into one
+// band per thread, and append the results in row order
+// If occupancy is not 0, the grid squares of the box count are marked in it
+template<typename T, typename P>
+size_t march_grid_rows(const vector<const P*>& rows, const size_t row_base, const size_t y_begin, const size_t y_end, const vector<T>& xs, const vector<T>& ys, const T isovalue, const size_t pad, const P border_value, vector<line_segment_t<T> >& line_segments, pipeline_stats* const stats, const size_t num_threads, occupancy_table* const occupancy = 0)
+{
+	// The float or the quantised band
+	void (*band_function)(const vector<const P*>&, const size_t, const vector<T>&, const vector<T>&, const T, const size_t, const P, march_band_t<T>&) = march_grid_band;
+
+	const size_t num_rows = y_end - y_begin;
+	size_t n = num_threads;
+
+	if (n > num_rows)
+		n = num_rows;
+
+	if (0 == n)
+		return 0;
+
+	vector<march_band_t<T> > bands(n);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		bands[i].x_end = xs.size() - 1;
+		bands[i].y_begin = y_begin + num_rows * i / n;
+		bands[i].y_end = y_begin + num_rows * (i + 1) / n;
+
+		if (0 != occupancy)
+		{
+			bands[i].occupancy = occupancy->get_cells();
+			bands[i].occupancy_stride = occupancy->get_stride();
+		}
+	}
+
+	if (1 == n)
+	{
+		band_function(rows, row_base, xs, ys, isovalue, pad, border_value, bands[0]);
+	}
+	else
+	{
+		vector<thread> threads;
+
+		for (size_t i = 0; i < n; i++)
+			threads.push_back(thread(band_function, std::cref(rows), row_base, std::cref(xs), std::cref(ys), isovalue, pad, border_value, std::ref(bands[i])));
+
+		for (size_t i = 0; i < n; i++)
+			threads[i].join();
+	}
+
+	size_t total_segments = line_segments.size();
+
+	for (size_t i = 0; i < n; i++)
+		total_segments += bands[i].line_segments.size();
+
+	line_segments.reserve(total_segments);
+
+	size_t box_count = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		line_segments.insert(line_segments.end(), bands[i].line_segments.begin(), bands[i].line_segments.end());
+		box_count += bands[i].box_count;
+
+		if (0 != stats)
+			for (size_t j = 0; j < 16; j++)
+				stats->case_counts[j] += bands[i].case_counts[j];
+	}
+
+	return box_count;
+}
+
+// The grid corner positions, including the virtual border if there is one
+template<typename T>
+void get_grid_coordinates(const grid_parameters& gp, const size_t px, const size_t py, vector<T>& xs, vector<T>& ys)
+{
+	const size_t pad = gp.virtual_border ? 1 : 0;
+
+	xs.resize(px + 2 * pad);
+	ys.resize(py + 2 * pad);
+
+	for (size_t x = 0; x < xs.size(); x++)
+		xs[x] = static_cast<T>(gp.grid_x_min + gp.step_size * (static_cast<double>(x) - static_cast<double>(pad)));
+
+	for (size_t y = 0; y < ys.size(); y++)
+		ys[y] = static_cast<T>(gp.grid_y_max - gp.step_size * (static_cast<double>(y) - static_cast<double>(pad)));
+}
+
+// March over the whole plane, consuming the source row by row
+//
+// Sources that are already in memory are marched in place; the others are
+// fetched in blocks of rows, so only one block is ever resident
+// With gp.virtual_border, the grid is one pixel larger on every side
+// The output is identical (including order) for any number of threads
+// If occupancy is not 0, it is reset to the grid, and the grid squares of
+// the box count are marked in it
+// Returns the box count
+template<typename T>
+size_t march_squares(image_source& src, const grid_parameters& gp, vector<line_segment_t<T> >& line_segments, pipeline_stats* const stats, const size_t num_threads, occupancy_table* const occupancy = 0)
+{
+	stage_timer timer(stats, "march");
+
+	line_segments.clear();
+
+	const size_t px = src.get_px();
+	const size_t py = src.get_py();
+	const size_t pad = gp.virtual_border ? 1 : 0;
+	const float border_value = gp.get_border_value();
+
+	// Grid corners
+	const size_t gx = px + 2 * pad;
+	const size_t gy = py + 2 * pad;
+
+	if (0 == px || 0 == py || gx < 2 || gy < 2)
+		return 0;
+
+	if (0 != occupancy)
+		occupancy->reset(gx - 1, gy - 1);
+
+	vector<T> xs, ys;
+	get_grid_coordinates(gp, px, py, xs, ys);
+
+	const T isovalue = static_cast<T>(gp.isovalue);
+
+	const size_t n = get_num_threads(num_threads);
+	size_t box_count = 0;
+
+	if (0 != src.get_row_pointer(0))
+	{
+		vector<const float*> rows(gy, static_cast<const float*>(0));
+
+		for (size_t y = 0; y < py; y++)
+			rows[y + pad] = src.get_row_pointer(y);
+
+		box_count = march_grid_rows(rows, 0, 0, gy - 1, xs, ys, isovalue, pad, border_value, line_segments, stats, n, occupancy);
+	}
+	else
+	{
+		// Roughly 4 million pixels per block, and at least one row per thread
+		size_t block_rows = (static_cast<size_t>(1) << 22) / px;
+
+		if (block_rows < n)
+			block_rows = n;
+
+		// One extra row, which is carried over as the first row of the next block
+		vector<float> block((block_rows + 1) * px);
+		vector<const float*> rows(block_rows + 1, static_cast<const float*>(0));
+
+		if (0 == pad)
+		{
+			if (false == src.get_rows(0, 1, &block[0]))
+				return 0;
+
+			rows[0] = &block[0];
+		}
+
+		for (size_t y = 0; y < gy - 1; y += block_rows)
+		{
+			size_t count = block_rows;
+
+			if (y + count > gy - 1)
+				count = gy - 1 - y;
+
+			// Grid rows y + 1 to y + count, less the bottom border row
+			size_t num_image_rows = count;
+
+			if (y + count >= py + pad)
+				num_image_rows = py + pad - 1 - y;
+
+			if (0 != num_image_rows && false == src.get_rows(y + 1 - pad, num_image_rows, &block[px]))
+				break;
+
+			for (size_t i = 1; i <= count; i++)
+				rows[i] = (i <= num_image_rows) ? &block[i * px] : 0;
+
+			box_count += march_grid_rows(rows, y, y, y + count, xs, ys, isovalue, pad, border_value, line_segments, stats, n, occupancy);
+
+			if (0 != rows[count])
+			{
+				memcpy(&block[0], rows[count], px * sizeof(float));
+				rows[0] = &block[0];
+			}
+			else
+			{
+				rows[0] = 0;
+			}
+		}
+	}
+
+	if (0 != stats)
+	{
+		stats->num_cells += (gx - 1) * (gy - 1);
+		stats->box_count += box_count;
+	}
+
+	return box_count;
+}
+
+template<typename T>
+size_t march_squares(const float_grayscale& luma, const grid_parameters& gp, vector<line_segment_t<T> >& line_segments, pipeline_stats* const stats, const size_t num_threads, occupancy_table* const occupancy = 0)
+{
+	float_grayscale_source src(luma);
+
+	return march_squares(src, gp, line_segments, stats, num_threads, occupancy);
+}
+
+// March over quantised luma, with the isovalue scaled to the integer range
+//
+// The pixels are read in place, from any buffer whose rows are stride bytes
+// apart
+//
+// The vertices differ from those of the float pipeline only by the
+// quantisation of the luma, which is at most 0.5 / get_quantised_max<P>()
+// per pixel (see get_quantised_dimension_tolerance())
+template<typename T, typename P>
+size_t march_squares(const P* const pixels, const size_t px, const size_t py, const size_t stride, const grid_parameters& gp, vector<line_segment_t<T> >& line_segments, pipeline_stats* const stats, const size_t num_threads, occupancy_table* const occupancy = 0)
+{
+	stage_timer timer(stats, "march");
+
+	line_segments.clear();
+
+	const size_t pad = gp.virtual_border ? 1 : 0;
+
+	if (0 == px || 0 == py || px + 2 * pad < 2 || py + 2 * pad < 2)
+		return 0;
+
+	if (0 != occupancy)
+		occupancy->reset(px + 2 * pad - 1, py + 2 * pad - 1);
+
+	vector<T> xs, ys;
+	get_grid_coordinates(gp, px, py, xs, ys);
+
+	const T isovalue = static_cast<T>(gp.isovalue * get_quantised_max<P>());
+
+	// The border has to be outside of the contours; with an isovalue of zero
+	// or less, everything is inside, and there are no contours anyway
+	const P border_value = 0;
+
+	vector<const P*> rows(ys.size(), static_cast<const P*>(0));
+
+	for (size_t y = 0; y < py; y++)
+		rows[y + pad] = reinterpret_cast<const P*>(reinterpret_cast<const unsigned char*>(pixels) + y * stride);
+
+	const size_t box_count = march_grid_rows(rows, 0, 0, ys.size() - 1, xs, ys, isovalue, pad, border_value, line_segments, stats, get_num_threads(num_threads), occupancy);
+
+	if (0 != stats)
+	{
+		stats->num_cells += (xs.size() - 1) * (ys.size() - 1);
+		stats->box_count += box_count;
+	}
+
+	return box_count;
+}
+
+template<typename T, typename P>
+size_t march_squares(const quantised_grayscale<P>& luma, const grid_parameters& gp, vector<line_segment_t<T> >& line_segments, pipeline_stats* const stats, const size_t num_threads, occupancy_table* const occupancy = 0)
+{
+	if (luma.pixel_data.empty())
+	{
+		line_segments.clear();
+		return 0;
+	}
+
+	return march_squares(&luma.pixel_data[0], luma.px, luma.py, luma.px * sizeof(P), gp, line_segments, stats, num_threads, occupancy);
+}
+
+// How far the dimensions of the quantised pipeline may be from those of the
+// float pipeline; the largest differences seen over the sample images and the
+// generated fractals were about 2.5e-4 (uint8) and 2e-7 (uint16)
+template<typename P>
+double get_quantised_dimension_tolerance(void);
+
+template<>
+double get_quantised_dimension_tolerance<unsigned char>(void)
+{
+	return 1e-3;
+}
+
+template<>
+double get_quantised_dimension_tolerance<unsigned short int>(void)
+{
+	return 1e-5;
+}
+
+
+// The curvature of a line segment from its neighbours alone, without the walk
+//
+// neighbours[i] is the line segment that shares ls.vertex[i], or 0 if no line
+// segment (or more than one) does. The dot product of two neighbouring face
+// normals is minus the dot product of the two line segments' directions away
+// from the shared vertex, whichever way the contour is walked, so this is
+// the same as get_reference_curvatures()
+template<typename T>
+T get_local_curvature(const line_segment_t<T>& ls, const line_segment_t<T>* const neighbours[2])
+{
+	T d[2] = { 0, 0 };
+	size_t num_neighbours = 0;
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (0 == neighbours[i])
+			continue;
+
+		const vertex_2_t<T>& v = ls.vertex[i];
+		const vertex_2_t<T>& a = ls.vertex[1 - i];
+		const vertex_2_t<T>& b = (neighbours[i]->vertex[0] == v) ? neighbours[i]->vertex[1] : neighbours[i]->vertex[0];
+
+		vertex_2_t<T> away_a(a.x - v.x, a.y - v.y);
+		vertex_2_t<T> away_b(b.x - v.x, b.y - v.y);
+		away_a.normalize();
+		away_b.normalize();
+
+		d[num_neighbours++] = -away_a.dot(away_b);
+	}
+
+	// A lone line segment has no curvature
+	if (0 == num_neighbours)
+		return 0;
+
+	// The end of an open contour only has the one neighbour
+	if (1 == num_neighbours)
+		return (1 - d[0]) / 2;
+
+	return (1 - (d[0] + d[1]) / 2) / 2;
+}
+
+// Get the per-segment curvature, which is calculated along with the face normals
+// The end line segments of open contours have one-sided curvatures
+template<typename T>
+bool get_curvatures(const line_segment_data_t<T>& lsd, vector<T>& k)
+{
+	stage_timer timer(lsd.stats, "curvature");
+
+	if (lsd.segment_curvatures.size() != lsd.line_segments.size())
+		return false;
+
+	k = lsd.segment_curvatures;
+
+	return true;
+}
+
+// Calculate the per-segment curvature from the given face normals, one line
+// segment at a time with map lookups, as it was before the structure-of-arrays
+// kernel; used to validate that kernel
+// Returns false if any line segment has more than two neighbours
+template<typename T>
+bool get_reference_curvatures(const line_segment_data_t<T>& lsd, const vector<vertex_2_t<T> >& face_normals, vector<T>& k)
+{
+	k.clear();
+	k.reserve(lsd.line_segments.size());
+
+	for (size_t i = 0; i < lsd.line_segments.size(); i++)
+	{
+		map<size_t, vector<size_t> >::const_iterator ci = lsd.line_segment_neighbours.find(i);
+
+		if (ci == lsd.line_segment_neighbours.end() || ci->second.size() > 2)
+			return false;
+
+		vertex_2_t<T> this_normal = face_normals[i];
+
+		// A lone line segment has no curvature
+		if (ci->second.empty())
+		{
+			k.push_back(0);
+			continue;
+		}
+
+		size_t neighbour_0_index = ci->second[0];
+		vertex_2_t<T> neighbour_0_normal = face_normals[neighbour_0_index];
+
+		// The end of an open contour only has the one neighbour
+		if (1 == ci->second.size())
+		{
+			k.push_back((1 - this_normal.dot(neighbour_0_normal)) / 2);
+			continue;
+		}
+
+		size_t neighbour_1_index = ci->second[1];
+		vertex_2_t<T> neighbour_1_normal = face_normals[neighbour_1_index];
+
+		// Get the average dot product
+		T d_i = this_normal.dot(neighbour_0_normal) + this_normal.dot(neighbour_1_normal);
+		d_i /= 2;
+
+		// Normalize the average dot product to get the curvature
+		T k_i = (1 - d_i) / 2;
+
+		k.push_back(k_i);
+	}
+
+	return true;
+}
+
+// Compare the structure-of-arrays normals and curvatures against the reference
+// Returns true if they agree to within get_soa_normal_tolerance<T>()
+template<typename T>
+bool validate_normals(line_segment_data_t<T>& lsd, double& max_normal_difference, double& max_curvature_difference)
+{
+	max_normal_difference = max_curvature_difference = 0;
+
+	vector<vertex_2_t<T> > normals;
+	vector<T> k;
+
+	lsd.get_reference_face_normals(normals);
+
+	if (false == get_reference_curvatures(lsd, normals, k) || k.size() != lsd.segment_curvatures.size())
+		return false;
+
+	for (size_t i = 0; i < normals.size(); i++)
+	{
+		const double dx = fabs(static_cast<double>(normals[i].x) - lsd.face_normals[i].x);
+		const double dy = fabs(static_cast<double>(normals[i].y) - lsd.face_normals[i].y);
+		const double dk = fabs(static_cast<double>(k[i]) - lsd.segment_curvatures[i]);
+
+		if (dx > max_normal_difference)
+			max_normal_difference = dx;
+
+		if (dy > max_normal_difference)
+			max_normal_difference = dy;
+
+		if (dk > max_curvature_difference)
+			max_curvature_difference = dk;
+	}
+
+	const double tolerance = get_soa_normal_tolerance<T>();
+
+	return max_normal_difference <= tolerance && max_curvature_difference <= 2 * tolerance;
+}
+
+// Fill in the dimensions from the curvatures and the box count
+// The sums are always accumulated in double precision
+template<typename T>
+void get_dimensions(const vector<T>& k, const size_t box_count, const grid_parameters& gp, analysis_result& result)
+{
+	double K = 0;
+
+	for (size_t i = 0; i < k.size(); i++)
+		K += k[i];
+
+	// Get the average normalized curvature
+	if (0 < k.size())
+		K /= static_cast<double>(k.size());
+
+	result.curvature = K;
+	result.curvature_standard_deviation = (0 < k.size()) ? standard_deviation(k) : 0;
+	result.curvature_dimension = 1.0 + K;
+	result.box_count = box_count;
+	result.box_counting_dimension = (0 < box_count) ? log(static_cast<double>(box_count)) / log(1.0 / gp.step_size) : 0;
+	result.isovalue = gp.isovalue;
+}
+
+// Run the rest of the pipeline on marched line segments
+// Returns false if the curvatures could not be calculated
+template<typename T>
+bool analyse_line_segments(line_segment_data_t<T>& lsd, const size_t box_count, const grid_parameters& gp, analysis_result& result)
+{
+	// Ultimately, this enumerates the line segment neighbour data,
+	// and uses that to calculate the face normal data
+	lsd.process_line_segments();
+
+	vector<T> k;
+
+	if (false == get_curvatures(lsd, k))
+		return false;
+
+	get_dimensions(k, box_count, gp, result);
+
+	if (0 != lsd.stats)
+	{
+		lsd.stats->num_segments += lsd.line_segments.size();
+		lsd.stats->num_vertices += lsd.vertices.size();
+		lsd.stats->num_objects += lsd.num_objects;
+	}
+
+	return true;
+}
+
+// Run the whole pipeline on an image source
+// Returns false if the curvatures could not be calculated
+template<typename T>
+bool analyse_source(image_source& src, const grid_parameters& gp, line_segment_data_t<T>& lsd, analysis_result& result, const size_t num_threads)
+{
+	const size_t box_count = march_squares(src, gp, lsd.line_segments, lsd.stats, num_threads);
+
+	return analyse_line_segments(lsd, box_count, gp, result);
+}
+
+// Run the whole pipeline on an image that is already in memory
+template<typename T>
+bool analyse_grayscale(const float_grayscale& luma, const grid_parameters& gp, line_segment_data_t<T>& lsd, analysis_result& result, const size_t num_threads)
+{
+	float_grayscale_source src(luma);
+
+	return analyse_source(src, gp, lsd, result, num_threads);
+}
+
+template<typename T, typename P>
+bool analyse_quantised(const quantised_grayscale<P>& luma, const grid_parameters& gp, line_segment_data_t<T>& lsd, analysis_result& result, const size_t num_threads)
+{
+	const size_t box_count = march_squares(luma, gp, lsd.line_segments, lsd.stats, num_threads);
+
+	return analyse_line_segments(lsd, box_count, gp, result);
+}
+
+#endif
@@ -20,6 +20,16 @@ using std::set;
 #include <algorithm>
 using std::sort;
 
+#include <utility>
+using std::pair;
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include "stats.h"
+#include "normals_soa.h"
+
 
 class tri_index
 {
@@ -55,16 +65,17 @@ public:
 
 
 
-class vertex_2
+template<typename T>
+class vertex_2_t
 {
 public:
-	double x;
-	double y;
+	T x;
+	T y;
 	size_t index;
 
 	inline const void normalize(void)
 	{
-		double len = length();
+		T len = length();
 
 		if (0.0 != len)
 		{
@@ -73,14 +84,14 @@ public:
 		}
 	}
 
-	vertex_2(const double src_x = 0, const double src_y = 0)
+	vertex_2_t(const T src_x = 0, const T src_y = 0)
 	{
 		x = src_x;
 		y = src_y;
 		index = 0;
 	}
 
-	inline bool operator==(const vertex_2 &right) const
+	inline bool operator==(const vertex_2_t &right) const
 	{
 		if(right.x == x && right.y == y)
 			return true;
@@ -88,9 +99,9 @@ public:
 			return false;
 	}
 
-	inline const vertex_2& operator*(const float& right) const
+	inline const vertex_2_t& operator*(const T& right) const
 	{
-		static vertex_2 temp;
+		static vertex_2_t temp;
 
 		temp.x = this->x * right;
 		temp.y = this->y * right;
@@ -98,9 +109,9 @@ public:
 		return temp;
 	}
 
-	inline const vertex_2& operator/(const float& right) const
+	inline const vertex_2_t& operator/(const T& right) const
 	{
-		static vertex_2 temp;
+		static vertex_2_t temp;
 
 		temp.x = this->x / right;
 		temp.y = this->y / right;
@@ -108,7 +119,7 @@ public:
 		return temp;
 	}
 
-	inline bool operator<(const vertex_2 &right) const
+	inline bool operator<(const vertex_2_t &right) const
 	{
 		if(right.x > x)
 			return true;
@@ -123,9 +134,9 @@ public:
 		return false;
 	}
 
-	inline const vertex_2& operator+(const vertex_2& right) const
+	inline const vertex_2_t& operator+(const vertex_2_t& right) const
 	{
-		static vertex_2 temp;
+		static vertex_2_t temp;
 
 		temp.x = this->x + right.x;
 		temp.y = this->y + right.y;
@@ -133,9 +144,9 @@ public:
 		return temp;
 	}
 
-	inline const vertex_2& operator-(const vertex_2 &right) const
+	inline const vertex_2_t& operator-(const vertex_2_t &right) const
 	{
-		static vertex_2 temp;
+		static vertex_2_t temp;
 
 		temp.x = this->x - right.x;
 		temp.y = this->y - right.y;
@@ -143,81 +154,279 @@ public:
 		return temp;
 	}
 
-	inline double dot(const vertex_2 &right) const
+	inline T dot(const vertex_2_t &right) const
 	{
 		return x*right.x + y*right.y;
 	}
 
-	inline const double self_dot(void)
+	inline const T self_dot(void)
 	{
 		return x*x + y*y;
 	}
 
-	inline const double length(void)
+	inline const T length(void)
 	{
 		return sqrt(self_dot());
 	}
 };
 
-class line_segment
+template<typename T>
+class line_segment_t
 {
 public:
 
-	vertex_2 vertex[2];
+	vertex_2_t<T> vertex[2];
 
-	double length(void)
+	T length(void)
 	{
-		return sqrt( pow(vertex[0].x - vertex[1].x, 2.0) + pow(vertex[0].y - vertex[1].y, 2.0) );
+		return sqrt( (vertex[0].x - vertex[1].x)*(vertex[0].x - vertex[1].x) + (vertex[0].y - vertex[1].y)*(vertex[0].y - vertex[1].y) );
 	}
 };
 
 
 
+// Spread the bits of x out to the even bits of the result
+inline unsigned long long spread_morton_bits(const unsigned int x)
+{
+	unsigned long long v = x;
+
+	v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+	v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+	v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	v = (v | (v << 2)) & 0x3333333333333333ULL;
+	v = (v | (v << 1)) & 0x5555555555555555ULL;
+
+	return v;
+}
+
+// The position along the Z-order (Morton) curve of a point in
+// [x_min, x_min + extent] x [y_min, y_min + extent]
+template<typename T>
+inline unsigned long long get_morton_code(const T x, const T y, const double x_min, const double y_min, const double extent)
+{
+	const double scale = (extent > 0) ? 4294967295.0 / extent : 0;
+	const unsigned int qx = static_cast<unsigned int>((static_cast<double>(x) - x_min) * scale);
+	const unsigned int qy = static_cast<unsigned int>((static_cast<double>(y) - y_min) * scale);
+
+	return spread_morton_bits(qx) | (spread_morton_bits(qy) << 1);
+}
+
+
 // Marching squares-related geometric primitives
-class line_segment_data
+template<typename T>
+class line_segment_data_t
 {
 public:
-	vector<line_segment> line_segments;
+	vector<line_segment_t<T> > line_segments;
 	map<size_t, vector<size_t> > line_segment_neighbours;
-	vector<vertex_2> face_normals;
-	vector<vertex_2> vertices;
+	vector<vertex_2_t<T> > face_normals;
+	vector<vertex_2_t<T> > vertices;
+	size_t num_objects;
+
+	// The line segments of each contour (object), in walk order, and the
+	// vertex that each of them starts at; contour c occupies
+	// [contour_offsets[c], contour_offsets[c + 1])
+	vector<size_t> contour_segments;
+	vector<size_t> contour_vertices;
+	vector<size_t> contour_offsets;
+
+	// Whether each contour is closed, or is an open polyline
+	vector<bool> contour_closed;
+
+	// Per line segment curvature, calculated along with the face normals
+	vector<T> segment_curvatures;
+
+	// True if every contour is closed (every line segment has exactly
+	// two neighbours)
+	bool closed;
+
+	// Suppresses all progress output
+	bool quiet;
+
+	// Renumber the vertices and line segments along a Z-order curve after
+	// the weld, so that neighbours along the contours are near each other
+	// in memory (see reorder_morton())
+	bool morton_order;
+
+	// Optional; receives the weld, adjacency, walk and normals stage timings
+	pipeline_stats* stats;
+
+	line_segment_data_t(void)
+	{
+		num_objects = 0;
+		closed = false;
+		quiet = false;
+		morton_order = false;
+		stats = 0;
+	}
 
     void process_line_segments(void)
     {
         face_normals.clear();
         vertices.clear();
-
-        if (3 > line_segments.size())
+        num_objects = 0;
+        contour_segments.clear();
+        contour_vertices.clear();
+        contour_offsets.clear();
+        contour_closed.clear();
+        segment_curvatures.clear();
+        closed = true;
+
+        if (line_segments.empty())
             return;
 
+        {
+            stage_timer timer(stats, "weld");
+            weld_vertices();
+        }
+
+        if (morton_order)
+        {
+            stage_timer timer(stats, "reorder");
+            reorder_morton();
+        }
+
+        {
+            stage_timer timer(stats, "adjacency");
+            get_all_line_segment_neighbours();
+        }
+
+        if (!quiet)
+            cout << "Calculating normals" << endl;
+
+        {
+            stage_timer timer(stats, "walk");
+            walk_line_segments();
+        }
+
+        {
+            stage_timer timer(stats, "normals");
+            calculate_face_normals();
+        }
+
+        if (!quiet)
+            cout << "Found " << num_objects << " object(s)." << endl;
+    }
+
+    size_t get_num_contours(void) const
+    {
+        return contour_closed.size();
+    }
+
+    // The vertex that the line segment at contour_segments[i] ends at
+    size_t get_end_vertex_index(const size_t i) const
+    {
+        return get_other_vertex_index(contour_segments[i], contour_vertices[i]);
+    }
+
+    size_t get_num_open_contours(void) const
+    {
+        size_t count = 0;
+
+        for (size_t i = 0; i < contour_closed.size(); i++)
+            if (!contour_closed[i])
+                count++;
+
+        return count;
+    }
+
+    // The face normals, calculated one line segment at a time with map
+    // lookups, as they were before the structure-of-arrays kernel
+    // Used to validate that kernel
+    void get_reference_face_normals(vector<vertex_2_t<T> >& normals)
+    {
+        normals.clear();
+        normals.resize(line_segments.size());
+
+        for (size_t c = 0; c + 1 < contour_offsets.size(); c++)
+        {
+            const size_t begin = contour_offsets[c];
+            const size_t end = contour_offsets[c + 1];
+
+            for (size_t i = begin; i < end; i++)
+            {
+                // The ends of an open contour use their own vertices
+                if (!contour_closed[c] && (i == begin || i + 1 == end))
+                {
+                    const line_segment_t<T>& ls = line_segments[contour_segments[i]];
+                    const size_t start = contour_vertices[i];
+                    const vertex_2_t<T>& v0 = (ls.vertex[0].index == start) ? ls.vertex[0] : ls.vertex[1];
+                    const vertex_2_t<T>& v1 = (ls.vertex[0].index == start) ? ls.vertex[1] : ls.vertex[0];
+
+                    vertex_2_t<T> edge = v0 - v1;
+                    normals[contour_segments[i]] = vertex_2_t<T>(-edge.y, edge.x);
+                    normals[contour_segments[i]].normalize();
+
+                    continue;
+                }
+
+                tri_index t;
+                t.prev_index = contour_segments[(i == begin) ? end - 1 : i - 1];
+                t.curr_index = contour_segments[i];
+                t.next_index = contour_segments[(i + 1 == end) ? begin : i + 1];
+
+                size_t first_vertex_index = 0;
+                size_t last_vertex_index = 0;
+
+                if (line_segment_neighbours[t.prev_index][0] == t.curr_index)
+                    first_vertex_index = 0;
+                else
+                    first_vertex_index = 1;
+
+                if (line_segment_neighbours[t.next_index][0] == t.curr_index)
+                    last_vertex_index = 0;
+                else
+                    last_vertex_index = 1;
+
+                // The neighbour order only follows the vertex order when there are two
+                if (1 == line_segment_neighbours[t.prev_index].size())
+                    first_vertex_index = (line_segments[t.prev_index].vertex[0].index == contour_vertices[i]) ? 0 : 1;
+
+                if (1 == line_segment_neighbours[t.next_index].size())
+                    last_vertex_index = (line_segments[t.next_index].vertex[0].index == contour_vertices[i + 1]) ? 0 : 1;
+
+                // Use the oriented neighbours to get the face normal
+                vertex_2_t<T> edge = line_segments[t.prev_index].vertex[first_vertex_index] - line_segments[t.next_index].vertex[last_vertex_index];
+                normals[t.curr_index] = vertex_2_t<T>(-edge.y, edge.x);
+                normals[t.curr_index].normalize();
+            }
+        }
+    }
+
+protected:
+    void weld_vertices(void)
+    {
         // Sort vertices, to gain some sense of order
         for (size_t i = 0; i < line_segments.size(); i++)
         {
             if (line_segments[i].vertex[1] < line_segments[i].vertex[0])
             {
-                vertex_2 tv = line_segments[i].vertex[0];
+                vertex_2_t<T> tv = line_segments[i].vertex[0];
                 line_segments[i].vertex[0] = line_segments[i].vertex[1];
                 line_segments[i].vertex[1] = tv;
             }
         }
 
-        cout << "Welding vertices" << endl;
+        if (!quiet)
+            cout << "Welding vertices" << endl;
 
         // Insert unique vertices into set
-        set<vertex_2> vertex_set;
+        set<vertex_2_t<T> > vertex_set;
 
-        for (vector<line_segment>::const_iterator i = line_segments.begin(); i != line_segments.end(); i++)
+        for (typename vector<line_segment_t<T> >::const_iterator i = line_segments.begin(); i != line_segments.end(); i++)
         {
             vertex_set.insert(i->vertex[0]);
             vertex_set.insert(i->vertex[1]);
         }
 
-        cout << "Vertices: " << vertex_set.size() << endl;
-
-        cout << "Generating vertex indices" << endl;
+        if (!quiet)
+        {
+            cout << "Vertices: " << vertex_set.size() << endl;
+            cout << "Generating vertex indices" << endl;
+        }
 
         // Add indices to the vertices
-        for (set<vertex_2>::const_iterator i = vertex_set.begin(); i != vertex_set.end(); i++)
+        for (typename set<vertex_2_t<T> >::const_iterator i = vertex_set.begin(); i != vertex_set.end(); i++)
         {
             size_t index = vertices.size();
             vertices.push_back(*i);
@@ -227,15 +436,16 @@ public:
         vertex_set.clear();
 
         // Re-insert modifies vertices into set
-        for (vector<vertex_2>::const_iterator i = vertices.begin(); i != vertices.end(); i++)
+        for (typename vector<vertex_2_t<T> >::const_iterator i = vertices.begin(); i != vertices.end(); i++)
             vertex_set.insert(*i);
 
-        cout << "Assigning vertex indices to line segments" << endl;
+        if (!quiet)
+            cout << "Assigning vertex indices to line segments" << endl;
 
         // Find the two vertices for each line segment, by index
-        set<vertex_2>::iterator find_iter;
+        typename set<vertex_2_t<T> >::iterator find_iter;
 
-        for (vector<line_segment>::iterator i = line_segments.begin(); i != line_segments.end(); i++)
+        for (typename vector<line_segment_t<T> >::iterator i = line_segments.begin(); i != line_segments.end(); i++)
         {
             find_iter = vertex_set.find(i->vertex[0]);
             i->vertex[0].index = find_iter->index;
@@ -243,123 +453,245 @@ public:
             find_iter = vertex_set.find(i->vertex[1]);
             i->vertex[1].index = find_iter->index;
         }
+    }
 
-        vertex_set.clear();
+    // Renumber the welded vertices, and reorder the line segments, along a
+    // Z-order curve over their positions (the line segments by their
+    // midpoints)
+    //
+    // The weld numbers the vertices in x-then-y order, and the march leaves
+    // the line segments in row order, so the two line segments that share a
+    // vertex, and the vertex itself, can be far apart in memory; along the
+    // curve, anything that is close on the plane is mostly close in memory
+    // too. Runs between the weld and the adjacency, which is then built on
+    // the new numbering
+    void reorder_morton(void)
+    {
+        if (vertices.empty())
+            return;
 
-        get_all_line_segment_neighbours();
+        T x_min = vertices[0].x, x_max = vertices[0].x;
+        T y_min = vertices[0].y, y_max = vertices[0].y;
 
-        cout << "Calculating normals" << endl;
-        face_normals.resize(line_segments.size());
+        for (size_t i = 1; i < vertices.size(); i++)
+        {
+            x_min = (vertices[i].x < x_min) ? vertices[i].x : x_min;
+            x_max = (vertices[i].x > x_max) ? vertices[i].x : x_max;
+            y_min = (vertices[i].y < y_min) ? vertices[i].y : y_min;
+            y_max = (vertices[i].y > y_max) ? vertices[i].y : y_max;
+        }
 
-        // Number of disconnected objects 
-        size_t num_objects = 0;
+        const double extent = (x_max - x_min > y_max - y_min) ? static_cast<double>(x_max - x_min) : static_cast<double>(y_max - y_min);
 
-        // Start with the first line segment
-        size_t last_unprocessed_index = 0;
-        
-        // Keep track of which line segments have been processed
-        set<size_t> unprocessed_indices;
+        // The new order of the vertices, by code (then old index, for ties)
+        vector<pair<unsigned long long, size_t> > order(vertices.size());
 
-        for (size_t i = 0; i < line_segments.size(); i++)
-            unprocessed_indices.insert(i);
+        for (size_t i = 0; i < vertices.size(); i++)
+            order[i] = pair<unsigned long long, size_t>(get_morton_code(vertices[i].x, vertices[i].y, x_min, y_min, extent), i);
+
+        sort(order.begin(), order.end());
+
+        vector<size_t> new_index(vertices.size());
+        vector<vertex_2_t<T> > new_vertices(vertices.size());
 
-        // These will be used later for face normal calculation
-        vector<tri_index> tri_indices;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            new_index[order[i].second] = i;
+            new_vertices[i] = vertices[order[i].second];
+            new_vertices[i].index = i;
+        }
+
+        vertices.swap(new_vertices);
 
-        // Get the neighbours for each line segment
-        do
+        // Then the line segments
+        order.resize(line_segments.size());
+
+        for (size_t i = 0; i < line_segments.size(); i++)
         {
-            const size_t first_index = last_unprocessed_index;
+            const line_segment_t<T>& ls = line_segments[i];
+            const T x = (ls.vertex[0].x + ls.vertex[1].x) / 2;
+            const T y = (ls.vertex[0].y + ls.vertex[1].y) / 2;
 
-            size_t prev_index = first_index;
-            size_t curr_index = line_segment_neighbours[first_index][0];
-            size_t next_index = line_segment_neighbours[curr_index][0];
+            order[i] = pair<unsigned long long, size_t>(get_morton_code(x, y, x_min, y_min, extent), i);
+        }
+
+        sort(order.begin(), order.end());
+
+        vector<line_segment_t<T> > new_line_segments(line_segments.size());
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            line_segment_t<T>& ls = new_line_segments[i];
 
-            tri_index t;
-            t.prev_index = prev_index;
-            t.curr_index = curr_index;
-            t.next_index = next_index;
-            tri_indices.push_back(t);
-            unprocessed_indices.erase(unprocessed_indices.find(curr_index));
+            ls = line_segments[order[i].second];
+            ls.vertex[0].index = new_index[ls.vertex[0].index];
+            ls.vertex[1].index = new_index[ls.vertex[1].index];
 
-            // For each disconnected object in the image
-            do
+            // As after the weld, vertex 0 has the lower index, so that the
+            // neighbours come in vertex order
+            if (ls.vertex[1].index < ls.vertex[0].index)
             {
-                size_t index0 = line_segment_neighbours[curr_index][0];
-                size_t index1 = line_segment_neighbours[curr_index][1];
+                const vertex_2_t<T> tv = ls.vertex[0];
+                ls.vertex[0] = ls.vertex[1];
+                ls.vertex[1] = tv;
+            }
+        }
 
-                if (index0 == prev_index)
-                {
-                    prev_index = curr_index;
-                    curr_index = index1;
-                    next_index = line_segment_neighbours[curr_index][1];
+        line_segments.swap(new_line_segments);
+    }
 
-                    if (prev_index == next_index)
-                        next_index = line_segment_neighbours[curr_index][0];
-                }
-                else// if (index1 == prev_index)
-                {
-                    prev_index = curr_index;
-                    curr_index = index0;
-                    next_index = line_segment_neighbours[curr_index][0];
+    // The vertex that line segments a and b share
+    size_t get_shared_vertex_index(const size_t a, const size_t b) const
+    {
+        const size_t a0 = line_segments[a].vertex[0].index;
+
+        if (a0 == line_segments[b].vertex[0].index || a0 == line_segments[b].vertex[1].index)
+            return a0;
+
+        return line_segments[a].vertex[1].index;
+    }
 
-                    if (prev_index == next_index)
-                        next_index = line_segment_neighbours[curr_index][1];
+    // The vertex of line segment a that is not vertex_index
+    size_t get_other_vertex_index(const size_t a, const size_t vertex_index) const
+    {
+        if (line_segments[a].vertex[0].index == vertex_index)
+            return line_segments[a].vertex[1].index;
+
+        return line_segments[a].vertex[0].index;
+    }
+
+    // Follow the neighbours from line segment first, starting at first_vertex_index,
+    // until the contour closes or ends
+    void walk_contour(const size_t first, const size_t first_vertex_index, vector<char>& processed)
+    {
+        size_t curr_index = first;
+        size_t vertex_index = first_vertex_index;
+        bool is_closed = false;
+
+        while (true)
+        {
+            contour_segments.push_back(curr_index);
+            contour_vertices.push_back(vertex_index);
+            processed[curr_index] = 1;
+
+            // The next line segment is the one that shares this line segment's end vertex
+            const size_t end_vertex_index = get_other_vertex_index(curr_index, vertex_index);
+            const vector<size_t>& n = line_segment_neighbours[curr_index];
+            size_t next_index = curr_index;
+
+            for (size_t i = 0; i < n.size(); i++)
+            {
+                if (n[i] != curr_index && get_shared_vertex_index(n[i], curr_index) == end_vertex_index)
+                {
+                    next_index = n[i];
+                    break;
                 }
+            }
 
-                tri_index t;
-                t.prev_index = prev_index;
-                t.curr_index = curr_index;
-                t.next_index = next_index;
-                tri_indices.push_back(t);
-                unprocessed_indices.erase(unprocessed_indices.find(curr_index));
+            if (next_index == first)
+                is_closed = true;
+
+            if (next_index == curr_index || 0 != processed[next_index])
+                break;
 
-            } while (curr_index != first_index);
+            vertex_index = end_vertex_index;
+            curr_index = next_index;
+        }
+
+        contour_offsets.push_back(contour_segments.size());
+        contour_closed.push_back(is_closed);
 
-            // Check to see if .begin() will return a valid iterator
-            // If so, use it
-            // If not, then we're done!
-            if (unprocessed_indices.size() > 0)
-                last_unprocessed_index = (*unprocessed_indices.begin());
+        if (!is_closed)
+            closed = false;
 
-            if (num_objects % 10000 == 0)
-                cout << "Found object " << num_objects + 1 << endl;
+        if (!quiet && num_objects % 10000 == 0)
+            cout << "Found object " << num_objects + 1 << '\n';
 
-            num_objects++;
+        num_objects++;
+    }
+
+    void walk_line_segments(void)
+    {
+        contour_segments.clear();
+        contour_vertices.clear();
+        contour_offsets.clear();
+        contour_closed.clear();
 
-        } while (unprocessed_indices.size() > 0);
+        contour_segments.reserve(line_segments.size());
+        contour_vertices.reserve(line_segments.size());
+        contour_offsets.push_back(0);
 
+        // Keep track of which line segments have been processed
+        vector<char> processed(line_segments.size(), 0);
 
-        // Finally, use the neighbour data to calculate the line segment normals
-        for (size_t i = 0; i < tri_indices.size(); i++)
+        // Open contours first, starting from their ends
+        for (size_t i = 0; i < line_segments.size(); i++)
         {
-            size_t prev_index = tri_indices[i].prev_index;
-            size_t curr_index = tri_indices[i].curr_index;
-            size_t next_index = tri_indices[i].next_index;
-
-            size_t first_vertex_index = 0;
-            size_t last_vertex_index = 0;
-
-            if (line_segment_neighbours[prev_index][0] == curr_index)
-                first_vertex_index = 0;
-            else
-                first_vertex_index = 1;
-
-            if (line_segment_neighbours[next_index][0] == curr_index)
-                last_vertex_index = 0;
-            else
-                last_vertex_index = 1;
-
-            // Use the oriented neighbours to get the face normal
-            vertex_2 edge = line_segments[prev_index].vertex[first_vertex_index] - line_segments[next_index].vertex[last_vertex_index];
-            face_normals[curr_index] = vertex_2(-edge.y, edge.x);
-            face_normals[curr_index].normalize();
+            if (0 != processed[i] || 2 == line_segment_neighbours[i].size())
+                continue;
+
+            // Start at the vertex that has no neighbour
+            size_t start = line_segments[i].vertex[0].index;
+
+            if (1 == line_segment_neighbours[i].size())
+                start = get_other_vertex_index(i, get_shared_vertex_index(i, line_segment_neighbours[i][0]));
+
+            walk_contour(i, start, processed);
         }
 
-        cout << "Found " << num_objects << " object(s)." << endl;
+        // Then the closed contours
+        for (size_t i = 0; i < line_segments.size(); i++)
+        {
+            if (0 != processed[i])
+                continue;
+
+            walk_contour(i, get_shared_vertex_index(i, line_segment_neighbours[i][1]), processed);
+        }
+    }
+
+    // Gather the contours' vertices into structure-of-arrays buffers, and
+    // calculate the normals and curvatures in SIMD batches (see normals_soa.h)
+    void calculate_face_normals(void)
+    {
+        const size_t num_contours = get_num_contours();
+        const size_t n = contour_segments.size();
+
+        // One more vertex than line segments per contour
+        vector<T> x(n + num_contours), y(n + num_contours), nx, ny, k;
+
+        for (size_t c = 0; c < num_contours; c++)
+        {
+            const size_t begin = contour_offsets[c];
+            const size_t end = contour_offsets[c + 1];
+
+            for (size_t i = begin; i < end; i++)
+            {
+                const vertex_2_t<T>& v = vertices[contour_vertices[i]];
+                x[i + c] = v.x;
+                y[i + c] = v.y;
+            }
+
+            size_t last = contour_vertices[begin];
+
+            if (!contour_closed[c])
+                last = get_end_vertex_index(end - 1);
+
+            x[end + c] = vertices[last].x;
+            y[end + c] = vertices[last].y;
+        }
+
+        get_contour_normals_and_curvatures(x, y, contour_offsets, contour_closed, nx, ny, k);
+
+        face_normals.resize(line_segments.size());
+        segment_curvatures.resize(line_segments.size());
+
+        for (size_t i = 0; i < n; i++)
+        {
+            face_normals[contour_segments[i]] = vertex_2_t<T>(nx[i], ny[i]);
+            segment_curvatures[contour_segments[i]] = k[i];
+        }
     }
 
-protected:
     void get_sorted_points_from_line_segment(size_t ls_index, vector<size_t>& points)
     {
         points.resize(2);
@@ -383,14 +715,15 @@ protected:
         for (size_t i = 0; i < line_segments.size(); i++)
             line_segment_neighbours[i] = default_lookup;
 
-        cout << "Enumerating shared faces" << endl;
+        if (!quiet)
+            cout << "Enumerating shared faces" << endl;
 
         map<size_t, vector<size_t> > neighbours;
 
         for (size_t i = 0; i < line_segments.size(); i++)
         {
-            if (i % 10000 == 0)
-                cout << i + 1 << " of " << line_segments.size() << endl;
+            if (!quiet && i % 10000 == 0)
+                cout << i + 1 << " of " << line_segments.size() << '\n';
 
             vector<size_t> points;
             get_sorted_points_from_line_segment(i, points);
@@ -399,21 +732,41 @@ protected:
                 neighbours[points[j]].push_back(i);
         }
 
-        cout << "Processing shared faces" << endl;
+        if (!quiet)
+            cout << "Processing shared faces" << endl;
 
         size_t count = 0;
 
         for (map<size_t, vector<size_t> >::const_iterator ci = neighbours.begin(); ci != neighbours.end(); ci++)
         {
-            if (count % 10000 == 0)
-                cout << count + 1 << " of " << neighbours.size() << endl;
+            if (!quiet && count % 10000 == 0)
+                cout << count + 1 << " of " << neighbours.size() << '\n';
 
             count++;
 
+            // A vertex with one line segment is the end of an open contour
+            if (2 != ci->second.size())
+                continue;
+
             line_segment_neighbours[ci->second[0]].push_back(ci->second[1]);
             line_segment_neighbours[ci->second[1]].push_back(ci->second[0]);
         }
     }
 };
 
+
+// Scalar type of the geometry pipeline
+//
+// Define USE_SINGLE_PRECISION for a float pipeline (less memory, more
+// throughput), or leave it undefined for the double reference pipeline
+#ifdef USE_SINGLE_PRECISION
+typedef float real_type;
+#else
+typedef double real_type;
+#endif
+
+typedef vertex_2_t<real_type> vertex_2;
+typedef line_segment_t<real_type> line_segment;
+typedef line_segment_data_t<real_type> line_segment_data;
+
 #endif
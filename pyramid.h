@@ -0,0 +1,155 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+
+// Coarse-to-fine estimates from a resolution pyramid
+//
+// Each level is half of the size of the one before it, each pixel being the
+// mean of a 2 x 2 block (an odd last row or column is dropped). The levels
+// are all built in one pass down the base image: as soon as two rows of a
+// level are done, the next level's row is made from them, while they are
+// still in the cache
+//
+// The levels are then analysed at the same time, one thread each, except for
+// the base level, which has the rest of the threads for its march. Since the
+// levels shrink geometrically, the whole pyramid costs about 4/3 of the base
+// level alone
+
+
+#include "image.h"
+#include "primitives.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+using std::thread;
+
+#include <chrono>
+
+
+// The results for one level of the pyramid
+class pyramid_level_result
+{
+public:
+
+	pyramid_level_result(void)
+	{
+		px = py = 0;
+		num_segments = 0;
+		seconds = 0;
+		analysed = false;
+	}
+
+	size_t px, py;
+	analysis_result result;
+	size_t num_segments;
+	double seconds;
+	bool analysed;
+	pipeline_stats stats;
+};
+
+
+// Make row y of level l + 1 from rows 2y and 2y + 1 of level l
+void downsample_pyramid_row(const float_grayscale& src, float_grayscale& dst, const size_t y)
+{
+	const float* const row0 = &src.pixel_data[2 * y * src.px];
+	const float* const row1 = row0 + src.px;
+	float* const out = &dst.pixel_data[y * dst.px];
+
+	for (size_t x = 0; x < dst.px; x++)
+		out[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1]) * 0.25f;
+}
+
+// Fill levels[1] onwards from levels[0], for up to num_levels levels in all
+// Levels smaller than 3 x 3 pixels are left out
+void build_pyramid(vector<float_grayscale>& levels, const size_t num_levels)
+{
+	levels.resize(1);
+
+	while (levels.size() < num_levels)
+	{
+		const float_grayscale& prev = levels.back();
+
+		if (prev.px / 2 < 3 || prev.py / 2 < 3)
+			break;
+
+		float_grayscale next;
+		next.px = prev.px / 2;
+		next.py = prev.py / 2;
+		next.pixel_data.resize(static_cast<size_t>(next.px) * next.py);
+
+		levels.push_back(next);
+	}
+
+	// Each new row of a level completes a pair of rows for the next one
+	for (size_t y = 0; y < levels[0].py; y++)
+	{
+		size_t row = y;
+
+		for (size_t l = 1; l < levels.size(); l++)
+		{
+			if (0 == row % 2 || row / 2 >= levels[l].py)
+				break;
+
+			row /= 2;
+			downsample_pyramid_row(levels[l - 1], levels[l], row);
+		}
+	}
+}
+
+void analyse_pyramid_level(const float_grayscale& luma, const double isovalue, const bool virtual_border, const size_t num_threads, pyramid_level_result& level)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	grid_parameters gp;
+	gp.set(luma.px, luma.py, isovalue);
+	gp.virtual_border = virtual_border;
+
+	line_segment_data lsd;
+	lsd.quiet = true;
+	lsd.stats = &level.stats;
+
+	level.px = luma.px;
+	level.py = luma.py;
+	level.analysed = analyse_grayscale(luma, gp, lsd, level.result, num_threads);
+	level.num_segments = lsd.line_segments.size();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	level.seconds = elapsed.count();
+}
+
+// Analyse every level of the pyramid, whose base is levels[0]
+void analyse_pyramid(vector<float_grayscale>& levels, const size_t num_levels, const double isovalue, const bool virtual_border, const size_t num_threads, vector<pyramid_level_result>& results, pipeline_stats* const stats)
+{
+	{
+		stage_timer timer(stats, "pyramid");
+		build_pyramid(levels, num_levels);
+	}
+
+	stage_timer timer(stats, "levels");
+
+	results.clear();
+	results.resize(levels.size());
+
+	const size_t n = get_num_threads(num_threads);
+	const size_t base_threads = (n > levels.size()) ? n - (levels.size() - 1) : 1;
+
+	vector<thread> threads;
+
+	for (size_t l = 1; l < levels.size(); l++)
+		threads.push_back(thread(analyse_pyramid_level, std::cref(levels[l]), isovalue, virtual_border, 1, std::ref(results[l])));
+
+	analyse_pyramid_level(levels[0], isovalue, virtual_border, base_threads, results[0]);
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+#endif
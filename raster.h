@@ -0,0 +1,248 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef RASTER_H
+#define RASTER_H
+
+
+// Headless preview renderer
+//
+// Draws what display_func() in main.h draws -- the dark template quad, the
+// face normals and the contours -- with the same camera, on the CPU, into a
+// tga that can be written out with write_tga()
+//
+// The image is split into one band of rows per thread, and every thread
+// draws all of the primitives, clipped to its own band
+
+
+#include "image.h"
+#include "primitives.h"
+#include "pipeline.h"
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+using std::thread;
+
+#include <cmath>
+
+
+class preview_colour
+{
+public:
+
+	preview_colour(const float r, const float g, const float b)
+	{
+		// TGA pixels are BGR
+		bgr[0] = to_byte(b);
+		bgr[1] = to_byte(g);
+		bgr[2] = to_byte(r);
+	}
+
+	unsigned char bgr[3];
+
+private:
+
+	static unsigned char to_byte(const float f)
+	{
+		return static_cast<unsigned char>(f * 255.0f + 0.5f);
+	}
+};
+
+
+class preview_parameters
+{
+public:
+
+	preview_parameters(void)
+	{
+		// As in main.h
+		px = py = 800;
+		camera_z = 1.25;
+		field_of_view = 45.0;
+		normal_length = 0.01;
+	}
+
+	size_t px, py;
+	double camera_z;
+	double field_of_view; // Vertical, in degrees
+	double normal_length;
+};
+
+
+// Rows [y_begin, y_end) of the preview, where row 0 is the top row
+template<typename T>
+class preview_band_renderer
+{
+public:
+
+	preview_band_renderer(tga& src_t, const size_t src_y_begin, const size_t src_y_end, const double src_scale) : t(src_t)
+	{
+		y_begin = src_y_begin;
+		y_end = src_y_end;
+		scale = src_scale;
+	}
+
+	void fill(const preview_colour& c)
+	{
+		for (size_t y = y_begin; y < y_end; y++)
+			for (size_t x = 0; x < t.px; x++)
+				put_pixel(static_cast<long long>(x), static_cast<long long>(y), c);
+	}
+
+	// Fill the axis-aligned rectangle between two corners, given in plane units
+	void fill_rectangle(const double x0, const double y0, const double x1, const double y1, const preview_colour& c)
+	{
+		const long long left = static_cast<long long>(ceil(to_column(x0) - 0.5));
+		const long long right = static_cast<long long>(floor(to_column(x1) - 0.5));
+		const long long top = static_cast<long long>(ceil(to_row(y0) - 0.5));
+		const long long bottom = static_cast<long long>(floor(to_row(y1) - 0.5));
+
+		for (long long y = top; y <= bottom; y++)
+			for (long long x = left; x <= right; x++)
+				put_pixel(x, y, c);
+	}
+
+	// A line between two points in plane units, width pixels wide
+	void draw_line(const double x0, const double y0, const double x1, const double y1, const preview_colour& c, const size_t width)
+	{
+		const double c0 = to_column(x0), r0 = to_row(y0);
+		const double c1 = to_column(x1), r1 = to_row(y1);
+
+		// Lines that miss this band entirely
+		const double margin = static_cast<double>(width);
+
+		if ((r0 < y_begin - margin && r1 < y_begin - margin) || (r0 > y_end + margin && r1 > y_end + margin))
+			return;
+
+		const double dc = c1 - c0;
+		const double dr = r1 - r0;
+		const bool steep = fabs(dr) > fabs(dc);
+		const double length = steep ? fabs(dr) : fabs(dc);
+		const size_t steps = static_cast<size_t>(ceil(length));
+
+		// Step one pixel at a time along the major axis, and thicken the line
+		// along the minor axis
+		for (size_t i = 0; i <= steps; i++)
+		{
+			const double f = (0 == steps) ? 0.0 : static_cast<double>(i) / static_cast<double>(steps);
+			const long long x = static_cast<long long>(floor(c0 + dc * f));
+			const long long y = static_cast<long long>(floor(r0 + dr * f));
+
+			for (size_t w = 0; w < width; w++)
+			{
+				if (steep)
+					put_pixel(x + static_cast<long long>(w), y, c);
+				else
+					put_pixel(x, y + static_cast<long long>(w), c);
+			}
+		}
+	}
+
+private:
+
+	double to_column(const double x) const
+	{
+		return x * scale + t.px / 2.0;
+	}
+
+	double to_row(const double y) const
+	{
+		return t.py / 2.0 - y * scale;
+	}
+
+	void put_pixel(const long long x, const long long y, const preview_colour& c)
+	{
+		if (x < 0 || y < static_cast<long long>(y_begin) || x >= static_cast<long long>(t.px) || y >= static_cast<long long>(y_end))
+			return;
+
+		// Bottom row first
+		const size_t row = static_cast<size_t>(t.py) - 1 - static_cast<size_t>(y);
+		unsigned char* const p = &t.pixel_data[(row * t.px + static_cast<size_t>(x)) * 3];
+
+		p[0] = c.bgr[0];
+		p[1] = c.bgr[1];
+		p[2] = c.bgr[2];
+	}
+
+	tga& t;
+	size_t y_begin, y_end;
+	double scale; // Pixels per plane unit
+};
+
+
+template<typename T>
+void render_preview_band(tga& t, const size_t y_begin, const size_t y_end, const double scale, const line_segment_data_t<T>& lsd, const grid_parameters& gp, const preview_parameters& pp)
+{
+	preview_band_renderer<T> r(t, y_begin, y_end, scale);
+
+	// Background, and the dark template quad
+	r.fill(preview_colour(0.333333f, 0.333333f, 0.333333f));
+	r.fill_rectangle(-gp.template_width / 2.0, gp.template_height / 2.0, gp.template_width / 2.0, -gp.template_height / 2.0, preview_colour(0, 0, 0));
+
+	// Face normals
+	const preview_colour normal_colour(1, 0.5f, 0);
+
+	for (size_t i = 0; i < lsd.line_segments.size() && i < lsd.face_normals.size(); i++)
+	{
+		const double x = (static_cast<double>(lsd.line_segments[i].vertex[0].x) + lsd.line_segments[i].vertex[1].x) / 2.0;
+		const double y = (static_cast<double>(lsd.line_segments[i].vertex[0].y) + lsd.line_segments[i].vertex[1].y) / 2.0;
+
+		r.draw_line(x, y, x + lsd.face_normals[i].x * pp.normal_length, y + lsd.face_normals[i].y * pp.normal_length, normal_colour, 1);
+	}
+
+	// Image outlines
+	const preview_colour outline_colour(0, 0.5f, 1);
+
+	for (size_t i = 0; i < lsd.line_segments.size(); i++)
+	{
+		const line_segment_t<T>& ls = lsd.line_segments[i];
+		r.draw_line(ls.vertex[0].x, ls.vertex[0].y, ls.vertex[1].x, ls.vertex[1].y, outline_colour, 2);
+	}
+}
+
+// Render the preview into t, on num_threads threads (0 = all cores)
+template<typename T>
+void render_preview(tga& t, const line_segment_data_t<T>& lsd, const grid_parameters& gp, const preview_parameters& pp, const size_t num_threads)
+{
+	t = tga();
+	t.datatypecode = 2;
+	t.bitsperpixel = 24;
+	// The largest image that a TGA can hold
+	t.px = static_cast<unsigned short int>(pp.px < 65535 ? pp.px : 65535);
+	t.py = static_cast<unsigned short int>(pp.py < 65535 ? pp.py : 65535);
+	t.pixel_data.resize(static_cast<size_t>(t.px) * t.py * 3);
+
+	if (0 == t.px || 0 == t.py)
+		return;
+
+	// The plane is at z = 0, and the camera looks straight at it; glScaled()
+	// in display_func() makes the template 1 unit wide, and the field of view
+	// is vertical, so the horizontal extent follows the aspect ratio
+	const double pi = 4.0 * atan(1.0);
+	const double half_extent = pp.camera_z * tan(pp.field_of_view / 2.0 * pi / 180.0) * gp.template_width;
+	const double scale = static_cast<double>(t.py) / (2.0 * half_extent);
+
+	size_t n = get_num_threads(num_threads);
+
+	if (n > t.py)
+		n = t.py;
+
+	if (1 == n)
+	{
+		render_preview_band(t, 0, t.py, scale, lsd, gp, pp);
+		return;
+	}
+
+	vector<thread> threads;
+
+	for (size_t i = 0; i < n; i++)
+		threads.push_back(thread(render_preview_band<T>, std::ref(t), t.py * i / n, t.py * (i + 1) / n, scale, std::cref(lsd), std::cref(gp), std::cref(pp)));
+
+	for (size_t i = 0; i < n; i++)
+		threads[i].join();
+}
+
+#endif
@@ -0,0 +1,605 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+
+// Persistent on-disk cache of analysis results
+//
+// Entries are keyed by a hash of the decoded pixel data plus every parameter
+// that affects the result, and hold the dimensions, the pipeline counters and,
+// optionally, the line segments and face normals
+//
+// Each entry is one file, written to a temporary name and then renamed into
+// place, so other processes only ever see whole entries; entries are also
+// checked against their own hash when read. Hits refresh the entry's
+// modification time, and the least recently used entries are removed once
+// the cache grows past its size limit
+
+
+#include "primitives.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <algorithm>
+using std::sort;
+
+#include <fstream>
+using std::ifstream;
+using std::ofstream;
+
+#include <ios>
+using std::ios;
+
+#include <sstream>
+using std::ostringstream;
+
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <process.h>
+	#include <sys/utime.h>
+	#define getpid _getpid
+#else
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <dirent.h>
+	#include <unistd.h>
+	#include <utime.h>
+#endif
+
+
+inline uint64_t rotate_left(const uint64_t x, const int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read_word(const unsigned char* const p)
+{
+	uint64_t w;
+	memcpy(&w, p, sizeof(w));
+	return w;
+}
+
+// A fast, non-cryptographic 64-bit hash (after xxHash64), that runs four
+// independent lanes over 32 byte stripes
+uint64_t hash_bytes(const void* const data, const size_t size, const uint64_t seed = 0)
+{
+	const uint64_t prime_1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t prime_2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t prime_3 = 0x165667B19E3779F9ULL;
+	const uint64_t prime_4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64_t prime_5 = 0x27D4EB2F165667C5ULL;
+
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* const end = p + size;
+	uint64_t h = 0;
+
+	if (size >= 32)
+	{
+		uint64_t v[4] = { seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1 };
+
+		for (; p + 32 <= end; p += 32)
+			for (size_t i = 0; i < 4; i++)
+				v[i] = rotate_left(v[i] + read_word(p + i * 8) * prime_2, 31) * prime_1;
+
+		h = rotate_left(v[0], 1) + rotate_left(v[1], 7) + rotate_left(v[2], 12) + rotate_left(v[3], 18);
+
+		for (size_t i = 0; i < 4; i++)
+			h = (h ^ (rotate_left(v[i] * prime_2, 31) * prime_1)) * prime_1 + prime_4;
+	}
+	else
+	{
+		h = seed + prime_5;
+	}
+
+	h += static_cast<uint64_t>(size);
+
+	for (; p + 8 <= end; p += 8)
+		h = rotate_left(h ^ (rotate_left(read_word(p) * prime_2, 31) * prime_1), 27) * prime_1 + prime_4;
+
+	for (; p < end; p++)
+		h = rotate_left(h ^ (*p * prime_5), 11) * prime_1;
+
+	h ^= h >> 33;
+	h *= prime_2;
+	h ^= h >> 29;
+	h *= prime_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+
+// Everything that determines a result
+class cache_key
+{
+public:
+
+	cache_key(void)
+	{
+		pixel_hash = 0;
+		px = py = 0;
+		isovalue = 0;
+		black_border = virtual_border = reverse_rows = reverse_pixel_byte_order = false;
+		morton_order = false;
+		pixel_size = 0;
+		scalar_size = 0;
+		crop_x = crop_y = crop_px = 0;
+	}
+
+	uint64_t pixel_hash;
+	uint64_t px, py;
+	double isovalue;
+	bool black_border, virtual_border;
+	bool reverse_rows, reverse_pixel_byte_order;
+	bool morton_order; // The order of the cached line segments
+	uint32_t pixel_size; // Bytes per pixel of the luma; 4 for float
+	uint32_t scalar_size; // sizeof(real_type)
+	uint64_t crop_x, crop_y, crop_px; // All zero for no crop
+
+	void set_pixels(const void* const data, const size_t size)
+	{
+		pixel_hash = hash_bytes(data, size);
+	}
+
+	// A fixed layout, so that keys can be compared byte for byte
+	void get_bytes(vector<char>& bytes) const
+	{
+		bytes.clear();
+		append(bytes, pixel_hash);
+		append(bytes, px);
+		append(bytes, py);
+		append(bytes, isovalue);
+
+		const uint32_t flags = (black_border ? 1u : 0u) | (virtual_border ? 2u : 0u) | (reverse_rows ? 4u : 0u) | (reverse_pixel_byte_order ? 8u : 0u) | (morton_order ? 16u : 0u);
+		append(bytes, flags);
+		append(bytes, pixel_size);
+		append(bytes, scalar_size);
+		append(bytes, crop_x);
+		append(bytes, crop_y);
+		append(bytes, crop_px);
+	}
+
+	string get_name(void) const
+	{
+		vector<char> bytes;
+		get_bytes(bytes);
+
+		char buffer[17];
+		snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash_bytes(&bytes[0], bytes.size())));
+
+		return string(buffer);
+	}
+
+private:
+
+	template<typename V>
+	static void append(vector<char>& bytes, const V& value)
+	{
+		const char* const p = reinterpret_cast<const char*>(&value);
+		bytes.insert(bytes.end(), p, p + sizeof(value));
+	}
+};
+
+
+// What is stored for one key
+template<typename T>
+class cache_entry_t
+{
+public:
+
+	analysis_result result;
+
+	// Counters only; the timings of the original run are not kept
+	size_t case_counts[16];
+	size_t num_cells, box_count, num_segments, num_vertices, num_objects;
+
+	// Empty unless geometry is cached
+	vector<line_segment_t<T> > line_segments;
+	vector<vertex_2_t<T> > face_normals;
+
+	cache_entry_t(void)
+	{
+		for (size_t i = 0; i < 16; i++)
+			case_counts[i] = 0;
+
+		num_cells = box_count = num_segments = num_vertices = num_objects = 0;
+	}
+
+	void set_stats(const pipeline_stats& s)
+	{
+		for (size_t i = 0; i < 16; i++)
+			case_counts[i] = s.case_counts[i];
+
+		num_cells = s.num_cells;
+		box_count = s.box_count;
+		num_segments = s.num_segments;
+		num_vertices = s.num_vertices;
+		num_objects = s.num_objects;
+	}
+
+	void get_stats(pipeline_stats& s) const
+	{
+		for (size_t i = 0; i < 16; i++)
+			s.case_counts[i] = case_counts[i];
+
+		s.num_cells = num_cells;
+		s.box_count = box_count;
+		s.num_segments = num_segments;
+		s.num_vertices = num_vertices;
+		s.num_objects = num_objects;
+	}
+};
+
+
+// Make the cache's directory, if it doesn't exist yet
+// Returns false if it can't be made, or is something other than a directory
+bool create_cache_directory(const string& directory)
+{
+#ifdef _WIN32
+	CreateDirectoryA(directory.c_str(), 0);
+
+	const DWORD attributes = GetFileAttributesA(directory.c_str());
+
+	return INVALID_FILE_ATTRIBUTES != attributes && 0 != (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	mkdir(directory.c_str(), 0777);
+
+	struct stat s;
+
+	return 0 == stat(directory.c_str(), &s) && S_ISDIR(s.st_mode);
+#endif
+}
+
+
+class result_cache
+{
+public:
+
+	result_cache(const string& src_directory, const size_t src_max_bytes)
+	{
+		directory = src_directory;
+		max_bytes = src_max_bytes;
+	}
+
+	template<typename T>
+	bool load(const cache_key& key, cache_entry_t<T>& entry)
+	{
+		const string filename = get_filename(key);
+		ifstream in(filename.c_str(), ios::binary);
+
+		if (!in.is_open())
+			return false;
+
+		vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		in.close();
+
+		vector<char> key_bytes;
+		key.get_bytes(key_bytes);
+
+		// Header: magic, version, payload hash, then the key
+		const size_t header_size = sizeof(magic) + sizeof(uint32_t) + sizeof(uint64_t);
+
+		if (file.size() < header_size + key_bytes.size() || 0 != memcmp(&file[0], magic, sizeof(magic)))
+			return false;
+
+		uint32_t file_version = 0;
+		uint64_t payload_hash = 0;
+		memcpy(&file_version, &file[sizeof(magic)], sizeof(file_version));
+		memcpy(&payload_hash, &file[sizeof(magic) + sizeof(file_version)], sizeof(payload_hash));
+
+		if (version != file_version || payload_hash != hash_bytes(&file[header_size], file.size() - header_size))
+			return false;
+
+		// A different key that has the same name
+		if (0 != memcmp(&file[header_size], &key_bytes[0], key_bytes.size()))
+			return false;
+
+		size_t pos = header_size + key_bytes.size();
+
+		if (false == read_entry(file, pos, entry) || pos != file.size())
+			return false;
+
+		// The isovalue is part of the key, so it isn't stored twice
+		entry.result.isovalue = key.isovalue;
+
+		// Most recently used
+		utime(filename.c_str(), 0);
+
+		return true;
+	}
+
+	template<typename T>
+	bool store(const cache_key& key, const cache_entry_t<T>& entry)
+	{
+		vector<char> payload;
+		key.get_bytes(payload);
+		write_entry(payload, entry);
+
+		const uint64_t payload_hash = hash_bytes(&payload[0], payload.size());
+
+		const string filename = get_filename(key);
+
+		ostringstream temp_name;
+		temp_name << filename << ".tmp." << getpid() << "." << static_cast<unsigned long long>(hash_bytes(&payload_hash, sizeof(payload_hash), static_cast<uint64_t>(clock())));
+
+		{
+			ofstream out(temp_name.str().c_str(), ios::binary);
+
+			if (!out.is_open())
+				return false;
+
+			out.write(magic, sizeof(magic));
+			out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+			out.write(reinterpret_cast<const char*>(&payload_hash), sizeof(payload_hash));
+			out.write(&payload[0], payload.size());
+
+			if (!out.good())
+			{
+				out.close();
+				remove(temp_name.str().c_str());
+				return false;
+			}
+		}
+
+		if (false == replace_file(temp_name.str(), filename))
+		{
+			remove(temp_name.str().c_str());
+			return false;
+		}
+
+		evict();
+
+		return true;
+	}
+
+	// Remove the least recently used entries until the cache fits in max_bytes
+	void evict(void)
+	{
+		vector<file_info> files;
+		get_files(files);
+
+		size_t total = 0;
+
+		for (size_t i = 0; i < files.size(); i++)
+			total += files[i].size;
+
+		if (total <= max_bytes)
+			return;
+
+		sort(files.begin(), files.end());
+
+		// Another process may remove the same files; that's fine
+		for (size_t i = 0; i < files.size() && total > max_bytes; i++)
+		{
+			remove((directory + "/" + files[i].name).c_str());
+			total -= files[i].size;
+		}
+	}
+
+private:
+
+	class file_info
+	{
+	public:
+
+		string name;
+		size_t size;
+		time_t modified;
+
+		bool operator<(const file_info& rhs) const
+		{
+			return modified < rhs.modified;
+		}
+	};
+
+	string get_filename(const cache_key& key) const
+	{
+		return directory + "/" + key.get_name() + extension;
+	}
+
+	template<typename V>
+	static void write_value(vector<char>& bytes, const V& value)
+	{
+		const char* const p = reinterpret_cast<const char*>(&value);
+		bytes.insert(bytes.end(), p, p + sizeof(value));
+	}
+
+	template<typename V>
+	static bool read_value(const vector<char>& bytes, size_t& pos, V& value)
+	{
+		if (pos + sizeof(value) > bytes.size())
+			return false;
+
+		memcpy(&value, &bytes[pos], sizeof(value));
+		pos += sizeof(value);
+
+		return true;
+	}
+
+	template<typename T>
+	static void write_entry(vector<char>& bytes, const cache_entry_t<T>& entry)
+	{
+		write_value(bytes, entry.result.curvature);
+		write_value(bytes, entry.result.curvature_standard_deviation);
+		write_value(bytes, entry.result.curvature_dimension);
+		write_value(bytes, entry.result.box_counting_dimension);
+		write_value(bytes, static_cast<uint64_t>(entry.result.box_count));
+
+		for (size_t i = 0; i < 16; i++)
+			write_value(bytes, static_cast<uint64_t>(entry.case_counts[i]));
+
+		write_value(bytes, static_cast<uint64_t>(entry.num_cells));
+		write_value(bytes, static_cast<uint64_t>(entry.box_count));
+		write_value(bytes, static_cast<uint64_t>(entry.num_segments));
+		write_value(bytes, static_cast<uint64_t>(entry.num_vertices));
+		write_value(bytes, static_cast<uint64_t>(entry.num_objects));
+
+		write_value(bytes, static_cast<uint64_t>(entry.line_segments.size()));
+
+		for (size_t i = 0; i < entry.line_segments.size(); i++)
+		{
+			write_value(bytes, entry.line_segments[i].vertex[0].x);
+			write_value(bytes, entry.line_segments[i].vertex[0].y);
+			write_value(bytes, entry.line_segments[i].vertex[1].x);
+			write_value(bytes, entry.line_segments[i].vertex[1].y);
+		}
+
+		write_value(bytes, static_cast<uint64_t>(entry.face_normals.size()));
+
+		for (size_t i = 0; i < entry.face_normals.size(); i++)
+		{
+			write_value(bytes, entry.face_normals[i].x);
+			write_value(bytes, entry.face_normals[i].y);
+		}
+	}
+
+	template<typename T>
+	static bool read_entry(const vector<char>& bytes, size_t& pos, cache_entry_t<T>& entry)
+	{
+		uint64_t values[22];
+
+		if (false == read_value(bytes, pos, entry.result.curvature) ||
+			false == read_value(bytes, pos, entry.result.curvature_standard_deviation) ||
+			false == read_value(bytes, pos, entry.result.curvature_dimension) ||
+			false == read_value(bytes, pos, entry.result.box_counting_dimension))
+			return false;
+
+		for (size_t i = 0; i < 22; i++)
+			if (false == read_value(bytes, pos, values[i]))
+				return false;
+
+		entry.result.box_count = static_cast<size_t>(values[0]);
+
+		for (size_t i = 0; i < 16; i++)
+			entry.case_counts[i] = static_cast<size_t>(values[1 + i]);
+
+		entry.num_cells = static_cast<size_t>(values[17]);
+		entry.box_count = static_cast<size_t>(values[18]);
+		entry.num_segments = static_cast<size_t>(values[19]);
+		entry.num_vertices = static_cast<size_t>(values[20]);
+		entry.num_objects = static_cast<size_t>(values[21]);
+
+		uint64_t count = 0;
+
+		if (false == read_value(bytes, pos, count) || count > (bytes.size() - pos) / (4 * sizeof(T)))
+			return false;
+
+		entry.line_segments.resize(static_cast<size_t>(count));
+
+		for (size_t i = 0; i < entry.line_segments.size(); i++)
+		{
+			read_value(bytes, pos, entry.line_segments[i].vertex[0].x);
+			read_value(bytes, pos, entry.line_segments[i].vertex[0].y);
+			read_value(bytes, pos, entry.line_segments[i].vertex[1].x);
+			read_value(bytes, pos, entry.line_segments[i].vertex[1].y);
+		}
+
+		if (false == read_value(bytes, pos, count) || count > (bytes.size() - pos) / (2 * sizeof(T)))
+			return false;
+
+		entry.face_normals.resize(static_cast<size_t>(count));
+
+		for (size_t i = 0; i < entry.face_normals.size(); i++)
+		{
+			read_value(bytes, pos, entry.face_normals[i].x);
+			read_value(bytes, pos, entry.face_normals[i].y);
+		}
+
+		return true;
+	}
+
+	// Atomically move src over dst
+	static bool replace_file(const string& src, const string& dst)
+	{
+#ifdef _WIN32
+		return 0 != MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+		return 0 == rename(src.c_str(), dst.c_str());
+#endif
+	}
+
+	// The cache's entries (not any temporary files)
+	void get_files(vector<file_info>& files) const
+	{
+		files.clear();
+
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE h = FindFirstFileA((directory + "/*" + extension).c_str(), &data);
+
+		if (INVALID_HANDLE_VALUE == h)
+			return;
+
+		do
+		{
+			ULARGE_INTEGER size, modified;
+			size.LowPart = data.nFileSizeLow;
+			size.HighPart = data.nFileSizeHigh;
+			modified.LowPart = data.ftLastWriteTime.dwLowDateTime;
+			modified.HighPart = data.ftLastWriteTime.dwHighDateTime;
+
+			file_info f;
+			f.name = data.cFileName;
+			f.size = static_cast<size_t>(size.QuadPart);
+			f.modified = static_cast<time_t>(modified.QuadPart / 10000000ULL);
+			files.push_back(f);
+		}
+		while (FindNextFileA(h, &data));
+
+		FindClose(h);
+#else
+		DIR* const dir = opendir(directory.c_str());
+
+		if (0 == dir)
+			return;
+
+		while (dirent* const d = readdir(dir))
+		{
+			const string name = d->d_name;
+
+			if (name.size() <= strlen(extension) || 0 != name.compare(name.size() - strlen(extension), string::npos, extension))
+				continue;
+
+			struct stat s;
+
+			if (0 != stat((directory + "/" + name).c_str(), &s))
+				continue;
+
+			file_info f;
+			f.name = name;
+			f.size = static_cast<size_t>(s.st_size);
+			f.modified = s.st_mtime;
+			files.push_back(f);
+		}
+
+		closedir(dir);
+#endif
+	}
+
+	string directory;
+	size_t max_bytes;
+
+	static const char magic[8];
+	static const uint32_t version;
+	static const char* const extension;
+};
+
+const char result_cache::magic[8] = { 'M', 'S', 'C', 'A', 'C', 'H', 'E', '\0' };
+const uint32_t result_cache::version = 1;
+const char* const result_cache::extension = ".msr";
+
+#endif
@@ -0,0 +1,656 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+
+// Incremental analysis of an image sequence
+//
+// The grid squares are split into square tiles. Each new frame is compared
+// against the previous one, and only the tiles that touch a changed pixel
+// are marched again; their line segments replace the tile's old ones in the
+// persisted geometry, which is welded through one map from vertex to the
+// line segments that end there
+//
+// The curvature of a line segment only depends on the line segments that
+// share its vertices (see get_local_curvature()), so only the new line
+// segments, and the old ones that they meet, need their curvatures updated,
+// and the walk is not needed at all. The dimensions then come from per-tile
+// sums, at a cost that follows the changed area rather than the image size
+
+
+#include "image.h"
+#include "image_formats.h"
+#include "primitives.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <string>
+using std::string;
+
+#include <algorithm>
+using std::sort;
+using std::unique;
+
+#include <thread>
+using std::thread;
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+
+// A line segment of the persisted geometry
+class segment_reference
+{
+public:
+
+	segment_reference(const size_t src_tile = 0, const size_t src_segment = 0)
+	{
+		tile = src_tile;
+		segment = src_segment;
+	}
+
+	inline bool operator==(const segment_reference& right) const
+	{
+		return tile == right.tile && segment == right.segment;
+	}
+
+	inline bool operator<(const segment_reference& right) const
+	{
+		if (tile != right.tile)
+			return tile < right.tile;
+
+		return segment < right.segment;
+	}
+
+	size_t tile;
+	size_t segment;
+};
+
+
+// One tile of grid squares, and the geometry that was marched from it
+template<typename T>
+class sequence_tile_t
+{
+public:
+
+	sequence_tile_t(void)
+	{
+		x_begin = x_end = y_begin = y_end = 0;
+		box_count = 0;
+		curvature_sum = curvature_square_sum = 0;
+	}
+
+	// Grid squares [x_begin, x_end) of rows [y_begin, y_end)
+	size_t x_begin, x_end;
+	size_t y_begin, y_end;
+
+	vector<line_segment_t<T> > line_segments;
+	vector<T> curvatures;
+	size_t box_count;
+
+	// Sums over curvatures, always in double precision
+	double curvature_sum;
+	double curvature_square_sum;
+};
+
+
+template<typename T>
+class sequence_analyser_t
+{
+public:
+
+	sequence_analyser_t(const size_t src_tile_size, const size_t src_num_threads)
+	{
+		tile_size = src_tile_size;
+		num_threads = get_num_threads(src_num_threads);
+		px = py = 0;
+		tiles_x = tiles_y = 0;
+		num_dirty_tiles = 0;
+
+		if (0 == tile_size)
+			tile_size = 1;
+	}
+
+	// Forget the previous frame; the next one is marched in full
+	void clear(void)
+	{
+		previous.clear();
+		tiles.clear();
+		vertex_segments.clear();
+		px = py = 0;
+		tiles_x = tiles_y = 0;
+		num_dirty_tiles = 0;
+	}
+
+	// Analyse the next frame
+	// Frames of a different size, or with different grid parameters, start over
+	void add_frame(const float_grayscale& luma, const grid_parameters& src_gp, analysis_result& result, pipeline_stats* const stats)
+	{
+		if (luma.px != px || luma.py != py || src_gp.isovalue != gp.isovalue || src_gp.step_size != gp.step_size || src_gp.virtual_border != gp.virtual_border)
+			reset(luma, src_gp);
+
+		vector<size_t> dirty;
+
+		{
+			stage_timer timer(stats, "diff");
+			get_dirty_tiles(luma, dirty);
+		}
+
+		num_dirty_tiles = dirty.size();
+
+		vector<vector<line_segment_t<T> > > segments(dirty.size());
+		vector<size_t> box_counts(dirty.size(), 0);
+
+		{
+			stage_timer timer(stats, "march");
+			march_tiles(luma, dirty, segments, box_counts, stats);
+		}
+
+		vector<segment_reference> affected;
+
+		{
+			stage_timer timer(stats, "splice");
+			splice(dirty, segments, box_counts, affected);
+		}
+
+		{
+			stage_timer timer(stats, "curvature");
+			update_curvatures(affected);
+		}
+
+		get_result(result);
+
+		if (0 != stats)
+		{
+			stats->box_count = result.box_count;
+			stats->num_segments = get_num_line_segments();
+			stats->num_vertices = vertex_segments.size();
+		}
+	}
+
+	size_t get_num_tiles(void) const
+	{
+		return tiles.size();
+	}
+
+	// The number of tiles that the last frame marched
+	size_t get_num_dirty_tiles(void) const
+	{
+		return num_dirty_tiles;
+	}
+
+	size_t get_num_line_segments(void) const
+	{
+		size_t count = 0;
+
+		for (size_t i = 0; i < tiles.size(); i++)
+			count += tiles[i].line_segments.size();
+
+		return count;
+	}
+
+	// The whole of the persisted geometry, tile by tile
+	void get_line_segments(vector<line_segment_t<T> >& line_segments) const
+	{
+		line_segments.clear();
+		line_segments.reserve(get_num_line_segments());
+
+		for (size_t i = 0; i < tiles.size(); i++)
+			line_segments.insert(line_segments.end(), tiles[i].line_segments.begin(), tiles[i].line_segments.end());
+	}
+
+private:
+
+	void reset(const float_grayscale& luma, const grid_parameters& src_gp)
+	{
+		clear();
+
+		gp = src_gp;
+		px = luma.px;
+		py = luma.py;
+
+		pad = gp.virtual_border ? 1 : 0;
+		get_grid_coordinates(gp, px, py, xs, ys);
+
+		// Grid squares
+		const size_t sx = (xs.size() < 2) ? 0 : xs.size() - 1;
+		const size_t sy = (ys.size() < 2) ? 0 : ys.size() - 1;
+
+		tiles_x = (sx + tile_size - 1) / tile_size;
+		tiles_y = (sy + tile_size - 1) / tile_size;
+
+		tiles.resize(tiles_x * tiles_y);
+
+		for (size_t ty = 0; ty < tiles_y; ty++)
+		{
+			for (size_t tx = 0; tx < tiles_x; tx++)
+			{
+				sequence_tile_t<T>& t = tiles[ty * tiles_x + tx];
+				t.x_begin = tx * tile_size;
+				t.x_end = (t.x_begin + tile_size < sx) ? t.x_begin + tile_size : sx;
+				t.y_begin = ty * tile_size;
+				t.y_end = (t.y_begin + tile_size < sy) ? t.y_begin + tile_size : sy;
+			}
+		}
+	}
+
+	// Mark the tiles of the grid squares that have pixels [x0, x1] of row y as
+	// a corner; pixel x is grid corner x + pad, which is shared by grid squares
+	// x + pad - 1 and x + pad
+	void mark_pixels(const size_t x0, const size_t x1, const size_t y, vector<bool>& marked) const
+	{
+		const size_t sx = xs.size() - 1;
+		const size_t sy = ys.size() - 1;
+
+		const size_t square_x0 = (x0 + pad > 0) ? x0 + pad - 1 : 0;
+		const size_t square_x1 = (x1 + pad < sx) ? x1 + pad : sx - 1;
+		const size_t square_y0 = (y + pad > 0) ? y + pad - 1 : 0;
+		const size_t square_y1 = (y + pad < sy) ? y + pad : sy - 1;
+
+		for (size_t ty = square_y0 / tile_size; ty <= square_y1 / tile_size; ty++)
+			for (size_t tx = square_x0 / tile_size; tx <= square_x1 / tile_size; tx++)
+				marked[ty * tiles_x + tx] = true;
+	}
+
+	// Compare the frame against the previous one, tile-wide span by span,
+	// and bring the previous frame up to date
+	void get_dirty_tiles(const float_grayscale& luma, vector<size_t>& dirty)
+	{
+		dirty.clear();
+
+		if (previous.empty())
+		{
+			previous = luma.pixel_data;
+
+			for (size_t i = 0; i < tiles.size(); i++)
+				dirty.push_back(i);
+
+			return;
+		}
+
+		vector<bool> marked(tiles.size(), false);
+
+		for (size_t y = 0; y < py; y++)
+		{
+			const float* const a = &luma.pixel_data[y * px];
+			float* const b = &previous[y * px];
+
+			if (0 == memcmp(a, b, px * sizeof(float)))
+				continue;
+
+			for (size_t begin = 0; begin < px; begin += tile_size)
+			{
+				const size_t end = (begin + tile_size < px) ? begin + tile_size : px;
+
+				if (0 == memcmp(a + begin, b + begin, (end - begin) * sizeof(float)))
+					continue;
+
+				size_t first = end, last = begin;
+
+				for (size_t x = begin; x < end; x++)
+				{
+					if (0 != memcmp(a + x, b + x, sizeof(float)))
+					{
+						if (first == end)
+							first = x;
+
+						last = x;
+					}
+				}
+
+				mark_pixels(first, last, y, marked);
+			}
+
+			memcpy(b, a, px * sizeof(float));
+		}
+
+		for (size_t i = 0; i < marked.size(); i++)
+			if (marked[i])
+				dirty.push_back(i);
+	}
+
+	// March the dirty tiles, which are shared out between the threads
+	void march_tiles(const float_grayscale& luma, const vector<size_t>& dirty, vector<vector<line_segment_t<T> > >& segments, vector<size_t>& box_counts, pipeline_stats* const stats)
+	{
+		if (dirty.empty())
+			return;
+
+		vector<const float*> rows(ys.size(), static_cast<const float*>(0));
+
+		for (size_t y = 0; y < py; y++)
+			rows[y + pad] = &luma.pixel_data[y * px];
+
+		size_t n = num_threads;
+
+		if (n > dirty.size())
+			n = dirty.size();
+
+		vector<size_t> case_counts(16 * n, 0);
+
+		if (1 == n)
+		{
+			march_tile_range(rows, dirty, 0, 1, segments, box_counts, &case_counts[0]);
+		}
+		else
+		{
+			vector<thread> threads;
+
+			for (size_t i = 0; i < n; i++)
+				threads.push_back(thread(&sequence_analyser_t<T>::march_tile_range, this, std::cref(rows), std::cref(dirty), i, n, std::ref(segments), std::ref(box_counts), &case_counts[16 * i]));
+
+			for (size_t i = 0; i < n; i++)
+				threads[i].join();
+		}
+
+		if (0 != stats)
+		{
+			for (size_t i = 0; i < dirty.size(); i++)
+			{
+				const sequence_tile_t<T>& t = tiles[dirty[i]];
+				stats->num_cells += (t.x_end - t.x_begin) * (t.y_end - t.y_begin);
+			}
+
+			for (size_t i = 0; i < case_counts.size(); i++)
+				stats->case_counts[i % 16] += case_counts[i];
+		}
+	}
+
+	// Every n-th dirty tile, from the first-th
+	void march_tile_range(const vector<const float*>& rows, const vector<size_t>& dirty, const size_t first, const size_t n, vector<vector<line_segment_t<T> > >& segments, vector<size_t>& box_counts, size_t* const case_counts) const
+	{
+		const T isovalue = static_cast<T>(gp.isovalue);
+		const float border_value = gp.get_border_value();
+
+		for (size_t i = first; i < dirty.size(); i += n)
+		{
+			const sequence_tile_t<T>& t = tiles[dirty[i]];
+
+			march_band_t<T> band;
+			band.x_begin = t.x_begin;
+			band.x_end = t.x_end;
+			band.y_begin = t.y_begin;
+			band.y_end = t.y_end;
+
+			march_grid_band(rows, 0, xs, ys, isovalue, pad, border_value, band);
+
+			segments[i].swap(band.line_segments);
+			box_counts[i] = band.box_count;
+
+			for (size_t j = 0; j < 16; j++)
+				case_counts[j] += band.case_counts[j];
+		}
+	}
+
+	// Replace the dirty tiles' line segments, and list the line segments whose
+	// curvatures have to be updated
+	void splice(const vector<size_t>& dirty, vector<vector<line_segment_t<T> > >& segments, const vector<size_t>& box_counts, vector<segment_reference>& affected)
+	{
+		affected.clear();
+
+		vector<bool> is_dirty(tiles.size(), false);
+
+		for (size_t i = 0; i < dirty.size(); i++)
+			is_dirty[dirty[i]] = true;
+
+		// Take out the old line segments; the line segments that are left at
+		// their vertices have lost a neighbour
+		vector<vertex_2_t<T> > touched;
+
+		for (size_t i = 0; i < dirty.size(); i++)
+		{
+			const sequence_tile_t<T>& t = tiles[dirty[i]];
+
+			for (size_t j = 0; j < t.line_segments.size(); j++)
+			{
+				for (size_t k = 0; k < 2; k++)
+				{
+					typename map<vertex_2_t<T>, vector<segment_reference> >::iterator vi = vertex_segments.find(t.line_segments[j].vertex[k]);
+
+					if (vi == vertex_segments.end())
+						continue;
+
+					vector<segment_reference>& refs = vi->second;
+					size_t kept = 0;
+
+					for (size_t l = 0; l < refs.size(); l++)
+						if (!is_dirty[refs[l].tile])
+							refs[kept++] = refs[l];
+
+					refs.resize(kept);
+
+					if (refs.empty())
+						vertex_segments.erase(vi);
+					else
+						touched.push_back(vi->first);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < touched.size(); i++)
+		{
+			typename map<vertex_2_t<T>, vector<segment_reference> >::const_iterator vi = vertex_segments.find(touched[i]);
+
+			if (vi != vertex_segments.end())
+				affected.insert(affected.end(), vi->second.begin(), vi->second.end());
+		}
+
+		// Put in the new ones
+		for (size_t i = 0; i < dirty.size(); i++)
+		{
+			sequence_tile_t<T>& t = tiles[dirty[i]];
+
+			t.line_segments.swap(segments[i]);
+			t.curvatures.assign(t.line_segments.size(), 0);
+			t.box_count = box_counts[i];
+
+			for (size_t j = 0; j < t.line_segments.size(); j++)
+				for (size_t k = 0; k < 2; k++)
+					vertex_segments[t.line_segments[j].vertex[k]].push_back(segment_reference(dirty[i], j));
+		}
+
+		// The new line segments, and the old ones that they meet
+		for (size_t i = 0; i < dirty.size(); i++)
+		{
+			const sequence_tile_t<T>& t = tiles[dirty[i]];
+
+			for (size_t j = 0; j < t.line_segments.size(); j++)
+			{
+				for (size_t k = 0; k < 2; k++)
+				{
+					const vector<segment_reference>& refs = vertex_segments.find(t.line_segments[j].vertex[k])->second;
+
+					for (size_t l = 0; l < refs.size(); l++)
+						if (!is_dirty[refs[l].tile])
+							affected.push_back(refs[l]);
+				}
+
+				affected.push_back(segment_reference(dirty[i], j));
+			}
+		}
+
+		sort(affected.begin(), affected.end());
+		affected.erase(unique(affected.begin(), affected.end()), affected.end());
+
+		// Tiles that lost all of their line segments still need their sums cleared
+		for (size_t i = 0; i < dirty.size(); i++)
+			if (tiles[dirty[i]].line_segments.empty())
+				tiles[dirty[i]].curvature_sum = tiles[dirty[i]].curvature_square_sum = 0;
+	}
+
+	// The neighbours are the line segments that share a vertex with this
+	// one, and no other line segment
+	T get_curvature(const segment_reference& r) const
+	{
+		const line_segment_t<T>& ls = tiles[r.tile].line_segments[r.segment];
+		const line_segment_t<T>* neighbours[2] = { 0, 0 };
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			const vector<segment_reference>& refs = vertex_segments.find(ls.vertex[i])->second;
+
+			if (2 != refs.size())
+				continue;
+
+			const segment_reference& o = (refs[0] == r) ? refs[1] : refs[0];
+			neighbours[i] = &tiles[o.tile].line_segments[o.segment];
+		}
+
+		return get_local_curvature(ls, neighbours);
+	}
+
+	void update_curvatures(const vector<segment_reference>& affected)
+	{
+		for (size_t i = 0; i < affected.size(); i++)
+			tiles[affected[i].tile].curvatures[affected[i].segment] = get_curvature(affected[i]);
+
+		// The references are sorted, so the tiles come in runs
+		for (size_t i = 0; i < affected.size(); i++)
+		{
+			if (0 != i && affected[i].tile == affected[i - 1].tile)
+				continue;
+
+			sequence_tile_t<T>& t = tiles[affected[i].tile];
+			t.curvature_sum = t.curvature_square_sum = 0;
+
+			for (size_t j = 0; j < t.curvatures.size(); j++)
+			{
+				t.curvature_sum += t.curvatures[j];
+				t.curvature_square_sum += static_cast<double>(t.curvatures[j]) * t.curvatures[j];
+			}
+		}
+	}
+
+	// As in get_dimensions(), from the per-tile sums
+	void get_result(analysis_result& result) const
+	{
+		double sum = 0, square_sum = 0;
+		size_t count = 0, box_count = 0;
+
+		for (size_t i = 0; i < tiles.size(); i++)
+		{
+			sum += tiles[i].curvature_sum;
+			square_sum += tiles[i].curvature_square_sum;
+			count += tiles[i].line_segments.size();
+			box_count += tiles[i].box_count;
+		}
+
+		double K = 0, variance = 0;
+
+		if (0 < count)
+		{
+			K = sum / static_cast<double>(count);
+			variance = square_sum / static_cast<double>(count) - K * K;
+		}
+
+		result.curvature = K;
+		result.curvature_standard_deviation = (variance > 0) ? sqrt(variance) : 0;
+		result.curvature_dimension = 1.0 + K;
+		result.box_count = box_count;
+		result.box_counting_dimension = (0 < box_count) ? log(static_cast<double>(box_count)) / log(1.0 / gp.step_size) : 0;
+		result.isovalue = gp.isovalue;
+	}
+
+	size_t tile_size;
+	size_t num_threads;
+
+	grid_parameters gp;
+	size_t px, py;
+	size_t pad;
+	vector<T> xs, ys;
+
+	// The last frame's luma
+	vector<float> previous;
+
+	vector<sequence_tile_t<T> > tiles;
+	size_t tiles_x, tiles_y;
+	size_t num_dirty_tiles;
+
+	// The line segments that end at each vertex
+	map<vertex_2_t<T>, vector<segment_reference> > vertex_segments;
+};
+
+typedef sequence_analyser_t<real_type> sequence_analyser;
+
+
+// Analyse the frames in order, printing the dimensions of each
+// A filename of "-" is standard input, which holds any number of frames, one
+// after another; raw_format, if given, is that of headerless frames
+// Returns false if a frame could not be read
+bool run_sequence(const vector<string>& filenames, const pixel_stream_format* const raw_format, const double isovalue, const bool black_border, const bool virtual_border, const size_t tile_size, const size_t num_threads, const bool quiet, pipeline_stats* const stats)
+{
+	sequence_analyser analyser(tile_size, num_threads);
+
+	tga t;
+	float_grayscale luma;
+	size_t frame = 0;
+
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		image_input input;
+
+		if (false == input.open(filenames[i].c_str(), raw_format))
+		{
+			cout << "Error reading " << filenames[i] << endl;
+			return false;
+		}
+
+		do
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			if (false == read_next_image(input, t, luma, black_border, stats))
+			{
+				// Standard input may run out at any frame
+				if (input.at_end() && "-" == filenames[i])
+					break;
+
+				cout << "Error reading " << filenames[i] << endl;
+				return false;
+			}
+
+			if (luma.px < 3 || luma.py < 3 || luma.px != luma.py)
+			{
+				cout << filenames[i] << ": template must be square, and at least 3x3 pixels in size." << endl;
+				return false;
+			}
+
+			grid_parameters gp;
+			gp.set(luma.px, luma.py, isovalue);
+			gp.virtual_border = virtual_border;
+
+			analysis_result result;
+			analyser.add_frame(luma, gp, result, stats);
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			if (!quiet)
+				cout << "Frame " << frame << ": " << filenames[i] << endl;
+
+			cout << frame << ": " << analyser.get_num_dirty_tiles() << " of " << analyser.get_num_tiles() << " tiles"
+				<< ", curvature-based dimension " << result.curvature_dimension
+				<< ", box-counting dimension " << result.box_counting_dimension
+				<< ", " << elapsed.count() << " s" << endl;
+
+			frame++;
+		}
+		while ("-" == filenames[i]);
+	}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,283 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+
+
+// Optional pre-smoothing of the luma, before the march
+//
+// Noise in photographs turns into many tiny contours, and every later stage
+// pays for them. The filter is a separable (Gaussian or box) convolution:
+// each source row is filtered horizontally as it arrives, into a ring of
+// 2 * radius + 1 rows, and each output row is the vertical sum over the
+// ring. So the filter sits between any image_source and the march, in
+// streaming mode too, without a second copy of the image
+//
+// The image is extended by repeating its edge pixels
+//
+// Compile with -mavx2 (or /arch:AVX2) to get the AVX2 loops; they add the
+// taps in the same order as the scalar loops, without fused multiply-adds,
+// so both give bitwise identical results
+
+
+#include "image_source.h"
+#include "stats.h"
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <cmath>
+
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif
+
+
+class smoothing_kernel
+{
+public:
+
+	smoothing_kernel(void)
+	{
+		weights.push_back(1.0f);
+	}
+
+	// Weights out to three standard deviations
+	void set_gaussian(const double sigma)
+	{
+		weights.clear();
+
+		const size_t radius = (sigma > 0) ? static_cast<size_t>(ceil(3.0 * sigma)) : 0;
+		vector<double> w(2 * radius + 1);
+		double sum = 0;
+
+		for (size_t i = 0; i < w.size(); i++)
+		{
+			const double x = static_cast<double>(i) - static_cast<double>(radius);
+			w[i] = (0 == radius) ? 1.0 : exp(-x * x / (2.0 * sigma * sigma));
+			sum += w[i];
+		}
+
+		for (size_t i = 0; i < w.size(); i++)
+			weights.push_back(static_cast<float>(w[i] / sum));
+	}
+
+	void set_box(const size_t radius)
+	{
+		weights.assign(2 * radius + 1, 1.0f / static_cast<float>(2 * radius + 1));
+	}
+
+	// "gaussian" (parameter is sigma) or "box" (parameter is the radius)
+	// Returns false for an unknown filter
+	bool set(const string& name, const double parameter)
+	{
+		if ("gaussian" == name)
+			set_gaussian(parameter);
+		else if ("box" == name)
+			set_box((parameter > 0) ? static_cast<size_t>(parameter) : 0);
+		else
+			return false;
+
+		return true;
+	}
+
+	size_t get_radius(void) const
+	{
+		return weights.size() / 2;
+	}
+
+	vector<float> weights;
+};
+
+
+// dst[x] = sum over k of w[k] * src[x + k - radius], with the edges repeated
+void smooth_row(const float* const src, float* const dst, const size_t px, const vector<float>& w)
+{
+	const size_t radius = w.size() / 2;
+	const size_t n = w.size();
+
+	// Columns whose taps are all inside of the row
+	const size_t inner_begin = (radius < px) ? radius : px;
+	const size_t inner_end = (2 * radius < px) ? px - radius : inner_begin;
+
+	for (size_t x = 0; x < px; x++)
+	{
+		if (x == inner_begin)
+			x = inner_end;
+
+		if (x >= px)
+			break;
+
+		float sum = 0;
+
+		for (size_t k = 0; k < n; k++)
+		{
+			const long long i = static_cast<long long>(x + k) - static_cast<long long>(radius);
+			const size_t clamped = (i < 0) ? 0 : ((i >= static_cast<long long>(px)) ? px - 1 : static_cast<size_t>(i));
+			sum += w[k] * src[clamped];
+		}
+
+		dst[x] = sum;
+	}
+
+	size_t x = inner_begin;
+
+#ifdef __AVX2__
+	for (; x + 8 <= inner_end; x += 8)
+	{
+		const float* const s = src + x - radius;
+		__m256 sum = _mm256_setzero_ps();
+
+		for (size_t k = 0; k < n; k++)
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(s + k)));
+
+		_mm256_storeu_ps(dst + x, sum);
+	}
+#endif
+
+	for (; x < inner_end; x++)
+	{
+		const float* const s = src + x - radius;
+		float sum = 0;
+
+		for (size_t k = 0; k < n; k++)
+			sum += w[k] * s[k];
+
+		dst[x] = sum;
+	}
+}
+
+// dst[x] = sum over k of w[k] * rows[k][x]
+void smooth_column(const float* const* const rows, float* const dst, const size_t px, const vector<float>& w)
+{
+	const size_t n = w.size();
+	size_t x = 0;
+
+#ifdef __AVX2__
+	for (; x + 8 <= px; x += 8)
+	{
+		__m256 sum = _mm256_setzero_ps();
+
+		for (size_t k = 0; k < n; k++)
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(rows[k] + x)));
+
+		_mm256_storeu_ps(dst + x, sum);
+	}
+#endif
+
+	for (; x < px; x++)
+	{
+		float sum = 0;
+
+		for (size_t k = 0; k < n; k++)
+			sum += w[k] * rows[k][x];
+
+		dst[x] = sum;
+	}
+}
+
+
+// Smooths another source, a row at a time
+//
+// Rows are expected in increasing order, as the march asks for them; any
+// other request starts the window over
+class smoothing_source : public image_source
+{
+public:
+
+	smoothing_source(image_source& src, const smoothing_kernel& src_kernel, pipeline_stats* const src_stats = 0) : s(src)
+	{
+		kernel = src_kernel;
+		stats = src_stats;
+		next_input_row = next_output_row = 0;
+
+		ring.resize(kernel.weights.size() * s.get_px());
+	}
+
+	size_t get_px(void) const
+	{
+		return s.get_px();
+	}
+
+	size_t get_py(void) const
+	{
+		return s.get_py();
+	}
+
+	bool get_rows(const size_t y_begin, const size_t count, float* const dst)
+	{
+		const size_t px = s.get_px();
+		const size_t py = s.get_py();
+		const size_t radius = kernel.get_radius();
+		const size_t window = kernel.weights.size();
+
+		if (y_begin + count > py)
+			return false;
+
+		if (0 == count || 0 == px)
+			return true;
+
+		if (y_begin != next_output_row)
+			next_input_row = (y_begin > radius) ? y_begin - radius : 0;
+
+		// Fetch all of the source rows that this block needs at once, unless
+		// they are already in memory
+		const size_t last_input_row = (y_begin + count - 1 + radius < py) ? y_begin + count - 1 + radius : py - 1;
+		const size_t first_input_row = next_input_row;
+		const bool resident = (0 != s.get_row_pointer(0));
+
+		if (!resident && first_input_row <= last_input_row)
+		{
+			input_buffer.resize((last_input_row + 1 - first_input_row) * px);
+
+			if (false == s.get_rows(first_input_row, last_input_row + 1 - first_input_row, &input_buffer[0]))
+				return false;
+		}
+
+		stage_timer timer(stats, "smooth");
+
+		vector<const float*> rows(window);
+
+		for (size_t y = y_begin; y < y_begin + count; y++)
+		{
+			const size_t needed = (y + radius < py) ? y + radius : py - 1;
+
+			for (; next_input_row <= needed; next_input_row++)
+			{
+				const float* const input = resident ? s.get_row_pointer(next_input_row) : &input_buffer[(next_input_row - first_input_row) * px];
+				smooth_row(input, &ring[(next_input_row % window) * px], px, kernel.weights);
+			}
+
+			for (size_t k = 0; k < window; k++)
+			{
+				const long long i = static_cast<long long>(y + k) - static_cast<long long>(radius);
+				const size_t clamped = (i < 0) ? 0 : ((i >= static_cast<long long>(py)) ? py - 1 : static_cast<size_t>(i));
+				rows[k] = &ring[(clamped % window) * px];
+			}
+
+			smooth_column(&rows[0], dst + (y - y_begin) * px, px, kernel.weights);
+		}
+
+		next_output_row = y_begin + count;
+
+		return true;
+	}
+
+private:
+
+	image_source& s;
+	smoothing_kernel kernel;
+	pipeline_stats* stats;
+
+	// Horizontally smoothed source rows; row y is at (y % window) * px
+	vector<float> ring;
+	vector<float> input_buffer;
+	size_t next_input_row, next_output_row;
+};
+
+#endif
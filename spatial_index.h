@@ -0,0 +1,817 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+
+// A uniform grid of buckets over the line segments
+//
+// Each line segment goes into the one cell that holds its midpoint, so no
+// line segment is ever listed twice; a line segment can then reach past its
+// cell by at most half of the longest line segment (the margin), which the
+// queries add to the bounds of every cell. The buckets are stored one after
+// the other, in one array (cell c is cell_segments[cell_offsets[c]] up to
+// cell_segments[cell_offsets[c + 1]])
+//
+// The grid is built with a counting sort, split among the threads; each
+// thread counts and then places its own run of line segments, so the order
+// within every bucket is the same for any number of threads
+//
+// get_nearest() searches down a pyramid of counts over the cells, so that
+// empty space is skipped in large blocks
+//
+// segment_index_t adds the contour that each line segment belongs to, and
+// batches of nearest line segment queries, split among the threads
+
+
+#include "primitives.h"
+#include "pipeline.h"
+
+#include <vector>
+using std::vector;
+
+#include <algorithm>
+using std::sort;
+using std::unique;
+
+#include <thread>
+using std::thread;
+
+#include <queue>
+using std::priority_queue;
+
+#include <functional>
+
+#include <string>
+using std::string;
+
+#include <fstream>
+using std::ifstream;
+
+#include <sstream>
+using std::istringstream;
+
+#include <iostream>
+using std::cout;
+using std::endl;
+
+#include <chrono>
+
+#include <cmath>
+#include <cfloat>
+
+
+// The squared distance from (x, y) to a line segment
+template<typename T>
+inline double get_segment_distance_squared(const line_segment_t<T>& ls, const double x, const double y)
+{
+	const double ax = ls.vertex[0].x, ay = ls.vertex[0].y;
+	const double dx = static_cast<double>(ls.vertex[1].x) - ax;
+	const double dy = static_cast<double>(ls.vertex[1].y) - ay;
+	const double length_squared = dx * dx + dy * dy;
+
+	double t = 0;
+
+	if (length_squared > 0)
+	{
+		t = ((x - ax) * dx + (y - ay) * dy) / length_squared;
+
+		if (t < 0)
+			t = 0;
+		else if (t > 1)
+			t = 1;
+	}
+
+	const double ex = ax + t * dx - x;
+	const double ey = ay + t * dy - y;
+
+	return ex * ex + ey * ey;
+}
+
+
+template<typename T>
+class segment_grid_t
+{
+public:
+
+	segment_grid_t(void)
+	{
+		segments = 0;
+		x_min = y_min = 0;
+		cell_size = 1;
+		margin = 0;
+		cells_x = cells_y = 0;
+	}
+
+	// Bucket the line segments into square cells of the given size
+	// The line segments must outlive the grid
+	void build(const vector<line_segment_t<T> >& src_segments, const double src_cell_size, const size_t num_threads = 1)
+	{
+		segments = &src_segments;
+		cell_size = (src_cell_size > 0) ? src_cell_size : 1;
+		margin = 0;
+		cells_x = cells_y = 0;
+		cell_offsets.assign(1, 0);
+		cell_segments.clear();
+		level_counts.clear();
+
+		if (src_segments.empty())
+			return;
+
+		// Each thread takes a run of the line segments
+		size_t n = get_num_threads(num_threads);
+
+		if (n > src_segments.size())
+			n = src_segments.size();
+
+		vector<size_t> run_begins(n + 1);
+
+		for (size_t t = 0; t <= n; t++)
+			run_begins[t] = src_segments.size() * t / n;
+
+		// The bounds and the margin
+		vector<double> bounds(5 * n);
+		run_threads(n, &segment_grid_t<T>::get_run_bounds, run_begins, bounds);
+
+		double x_max = -DBL_MAX, y_max = -DBL_MAX;
+		x_min = y_min = DBL_MAX;
+
+		for (size_t t = 0; t < n; t++)
+		{
+			x_min = (bounds[5 * t] < x_min) ? bounds[5 * t] : x_min;
+			y_min = (bounds[5 * t + 1] < y_min) ? bounds[5 * t + 1] : y_min;
+			x_max = (bounds[5 * t + 2] > x_max) ? bounds[5 * t + 2] : x_max;
+			y_max = (bounds[5 * t + 3] > y_max) ? bounds[5 * t + 3] : y_max;
+			margin = (bounds[5 * t + 4] > margin) ? bounds[5 * t + 4] : margin;
+		}
+
+		cells_x = static_cast<size_t>((x_max - x_min) / cell_size) + 1;
+		cells_y = static_cast<size_t>((y_max - y_min) / cell_size) + 1;
+
+		const size_t num_cells = cells_x * cells_y;
+
+		// Count each run's line segments per cell, then turn the counts into
+		// where each run's part of each bucket starts
+		segment_cells.resize(src_segments.size());
+		run_offsets.assign(n * num_cells, 0);
+		run_threads(n, &segment_grid_t<T>::count_run, run_begins, bounds);
+
+		cell_offsets.assign(num_cells + 1, 0);
+		size_t offset = 0;
+
+		for (size_t c = 0; c < num_cells; c++)
+		{
+			cell_offsets[c] = offset;
+
+			for (size_t t = 0; t < n; t++)
+			{
+				const size_t count = run_offsets[t * num_cells + c];
+				run_offsets[t * num_cells + c] = offset;
+				offset += count;
+			}
+		}
+
+		cell_offsets[num_cells] = offset;
+		cell_segments.resize(src_segments.size());
+		run_threads(n, &segment_grid_t<T>::place_run, run_begins, bounds);
+
+		vector<size_t>().swap(segment_cells);
+		vector<size_t>().swap(run_offsets);
+
+		build_levels();
+	}
+
+	// The distance from (x, y) to the nearest line segment, whose index goes
+	// into nearest; DBL_MAX if there are no line segments
+	//
+	// A best-first search down the levels: the blocks are visited nearest
+	// first, so the empty space between (x, y) and the contours costs a few
+	// blocks, however large it is
+	double get_nearest(const double x, const double y, size_t& nearest) const
+	{
+		double best = DBL_MAX;
+		nearest = 0;
+
+		if (0 == cells_x)
+			return best;
+
+		const size_t top = level_counts.size() - 1;
+		priority_queue<grid_block, vector<grid_block>, std::greater<grid_block> > blocks;
+
+		for (size_t j = 0; j < level_y[top]; j++)
+			for (size_t i = 0; i < level_x[top]; i++)
+				push_block(blocks, top, i, j, x, y);
+
+		while (!blocks.empty())
+		{
+			const grid_block b = blocks.top();
+			blocks.pop();
+
+			if (b.distance_squared >= best)
+				break;
+
+			if (0 != b.level)
+			{
+				for (size_t j = 2 * b.j; j < 2 * b.j + 2 && j < level_y[b.level - 1]; j++)
+					for (size_t i = 2 * b.i; i < 2 * b.i + 2 && i < level_x[b.level - 1]; i++)
+						push_block(blocks, b.level - 1, i, j, x, y);
+
+				continue;
+			}
+
+			const size_t c = b.j * cells_x + b.i;
+
+			for (size_t k = cell_offsets[c]; k < cell_offsets[c + 1]; k++)
+			{
+				const double d = get_segment_distance_squared((*segments)[cell_segments[k]], x, y);
+
+				if (d < best)
+				{
+					best = d;
+					nearest = cell_segments[k];
+				}
+			}
+		}
+
+		return sqrt(best);
+	}
+
+	// Append the indices of the line segments within radius of (x, y)
+	// The caller may pass the radius of a disc around (x, y) that is known
+	// to hold no line segments, so that the cells inside of it are skipped
+	void get_within(const double x, const double y, const double radius, vector<size_t>& found, const double empty_radius = 0) const
+	{
+		if (0 == cells_x || radius < 0)
+			return;
+
+		const double radius_squared = radius * radius;
+		const double reach = radius + margin;
+
+		const size_t j_begin = get_cell_y(y - reach);
+		const size_t j_end = get_cell_y(y + reach);
+
+		for (size_t j = j_begin; j <= j_end; j++)
+		{
+			const double y0 = y_min + static_cast<double>(j) * cell_size - margin;
+			const double y1 = y0 + cell_size + 2 * margin;
+			const double near_y = (y < y0) ? y0 - y : ((y > y1) ? y - y1 : 0);
+			const double far_y = (fabs(y - y0) > fabs(y - y1)) ? fabs(y - y0) : fabs(y - y1);
+
+			if (near_y > reach)
+				continue;
+
+			const double half_width = sqrt(reach * reach - near_y * near_y);
+			const size_t i_begin = get_cell_x(x - half_width);
+			const size_t i_end = get_cell_x(x + half_width);
+
+			// Cells wholly inside of the empty disc hold nothing
+			double inner = -1;
+
+			if (far_y < empty_radius)
+				inner = sqrt(empty_radius * empty_radius - far_y * far_y);
+
+			for (size_t i = i_begin; i <= i_end; i++)
+			{
+				const double x0 = x_min + static_cast<double>(i) * cell_size - margin;
+				const double x1 = x0 + cell_size + 2 * margin;
+
+				if (x0 > x - inner && x1 < x + inner)
+				{
+					// Jump to the last cell that might be wholly inside of the disc
+					const size_t last_inside = get_cell_x(x + inner - cell_size - margin);
+
+					if (last_inside > i + 1)
+						i = last_inside - 1;
+
+					continue;
+				}
+
+				const size_t c = j * cells_x + i;
+
+				for (size_t k = cell_offsets[c]; k < cell_offsets[c + 1]; k++)
+					if (get_segment_distance_squared((*segments)[cell_segments[k]], x, y) <= radius_squared)
+						found.push_back(cell_segments[k]);
+			}
+		}
+	}
+
+	// Append the indices of the line segments that touch the window
+	// [x0, x1] x [y0, y1]
+	void get_in_window(const double x0, const double y0, const double x1, const double y1, vector<size_t>& found) const
+	{
+		if (0 == cells_x || x1 < x0 || y1 < y0)
+			return;
+
+		if (x1 < x_min - margin || y1 < y_min - margin ||
+			x0 > x_min + static_cast<double>(cells_x) * cell_size + margin ||
+			y0 > y_min + static_cast<double>(cells_y) * cell_size + margin)
+			return;
+
+		const size_t i_begin = get_cell_x(x0 - margin), i_end = get_cell_x(x1 + margin);
+		const size_t j_begin = get_cell_y(y0 - margin), j_end = get_cell_y(y1 + margin);
+
+		for (size_t j = j_begin; j <= j_end; j++)
+		{
+			for (size_t i = i_begin; i <= i_end; i++)
+			{
+				const size_t c = j * cells_x + i;
+
+				for (size_t k = cell_offsets[c]; k < cell_offsets[c + 1]; k++)
+					if (touches_window((*segments)[cell_segments[k]], x0, y0, x1, y1))
+						found.push_back(cell_segments[k]);
+			}
+		}
+	}
+
+	const vector<line_segment_t<T> >* segments;
+
+	double x_min, y_min;
+	double cell_size;
+	double margin;
+	size_t cells_x, cells_y;
+
+	vector<size_t> cell_offsets;
+	vector<size_t> cell_segments;
+
+private:
+
+	// A block of 2^level x 2^level cells, for get_nearest()
+	class grid_block
+	{
+	public:
+
+		inline bool operator>(const grid_block& right) const
+		{
+			return distance_squared > right.distance_squared;
+		}
+
+		double distance_squared;
+		size_t level;
+		size_t i, j;
+	};
+
+	// The line segment count of every block, at every level, up to one
+	// that is at most 4 x 4 blocks
+	void build_levels(void)
+	{
+		level_counts.assign(1, vector<size_t>(cells_x * cells_y));
+		level_x.assign(1, cells_x);
+		level_y.assign(1, cells_y);
+
+		for (size_t c = 0; c < cells_x * cells_y; c++)
+			level_counts[0][c] = cell_offsets[c + 1] - cell_offsets[c];
+
+		while (level_x.back() > 4 || level_y.back() > 4)
+		{
+			const size_t fine_x = level_x.back(), fine_y = level_y.back();
+			const size_t coarse_x = (fine_x + 1) / 2, coarse_y = (fine_y + 1) / 2;
+
+			vector<size_t> coarse(coarse_x * coarse_y, 0);
+			const vector<size_t>& fine = level_counts.back();
+
+			for (size_t j = 0; j < fine_y; j++)
+				for (size_t i = 0; i < fine_x; i++)
+					coarse[(j / 2) * coarse_x + i / 2] += fine[j * fine_x + i];
+
+			level_counts.push_back(coarse);
+			level_x.push_back(coarse_x);
+			level_y.push_back(coarse_y);
+		}
+	}
+
+	void push_block(priority_queue<grid_block, vector<grid_block>, std::greater<grid_block> >& blocks, const size_t level, const size_t i, const size_t j, const double x, const double y) const
+	{
+		if (0 == level_counts[level][j * level_x[level] + i])
+			return;
+
+		const double size = cell_size * static_cast<double>(static_cast<size_t>(1) << level);
+		const double x0 = x_min + static_cast<double>(i) * size - margin;
+		const double y0 = y_min + static_cast<double>(j) * size - margin;
+		const double x1 = x0 + size + 2 * margin;
+		const double y1 = y0 + size + 2 * margin;
+
+		const double dx = (x < x0) ? x0 - x : ((x > x1) ? x - x1 : 0);
+		const double dy = (y < y0) ? y0 - y : ((y > y1) ? y - y1 : 0);
+
+		grid_block b;
+		b.distance_squared = dx * dx + dy * dy;
+		b.level = level;
+		b.i = i;
+		b.j = j;
+
+		blocks.push(b);
+	}
+
+	// Liang-Barsky: clip the line segment to the window, and see if
+	// anything is left
+	static bool touches_window(const line_segment_t<T>& ls, const double x0, const double y0, const double x1, const double y1)
+	{
+		const double ax = ls.vertex[0].x, ay = ls.vertex[0].y;
+		const double dx = static_cast<double>(ls.vertex[1].x) - ax;
+		const double dy = static_cast<double>(ls.vertex[1].y) - ay;
+
+		const double p[4] = { -dx, dx, -dy, dy };
+		const double q[4] = { ax - x0, x1 - ax, ay - y0, y1 - ay };
+
+		double t0 = 0, t1 = 1;
+
+		for (size_t i = 0; i < 4; i++)
+		{
+			if (0 == p[i])
+			{
+				if (q[i] < 0)
+					return false;
+
+				continue;
+			}
+
+			const double t = q[i] / p[i];
+
+			if (p[i] < 0)
+				t0 = (t > t0) ? t : t0;
+			else
+				t1 = (t < t1) ? t : t1;
+
+			if (t0 > t1)
+				return false;
+		}
+
+		return true;
+	}
+
+	void run_threads(const size_t n, void (segment_grid_t<T>::*function)(const vector<size_t>&, const size_t, vector<double>&), const vector<size_t>& run_begins, vector<double>& bounds)
+	{
+		if (1 == n)
+		{
+			(this->*function)(run_begins, 0, bounds);
+			return;
+		}
+
+		vector<thread> threads;
+
+		for (size_t t = 0; t < n; t++)
+			threads.push_back(thread(function, this, std::cref(run_begins), t, std::ref(bounds)));
+
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+	}
+
+	// x_min, y_min, x_max, y_max and the margin of run t
+	void get_run_bounds(const vector<size_t>& run_begins, const size_t t, vector<double>& bounds)
+	{
+		double x0 = DBL_MAX, y0 = DBL_MAX, x1 = -DBL_MAX, y1 = -DBL_MAX, m = 0;
+
+		for (size_t i = run_begins[t]; i < run_begins[t + 1]; i++)
+		{
+			const line_segment_t<T>& ls = (*segments)[i];
+
+			for (size_t j = 0; j < 2; j++)
+			{
+				const double x = ls.vertex[j].x;
+				const double y = ls.vertex[j].y;
+
+				x0 = (x < x0) ? x : x0;
+				y0 = (y < y0) ? y : y0;
+				x1 = (x > x1) ? x : x1;
+				y1 = (y > y1) ? y : y1;
+			}
+
+			const double dx = static_cast<double>(ls.vertex[1].x) - ls.vertex[0].x;
+			const double dy = static_cast<double>(ls.vertex[1].y) - ls.vertex[0].y;
+			const double half_length = sqrt(dx * dx + dy * dy) / 2.0;
+
+			m = (half_length > m) ? half_length : m;
+		}
+
+		bounds[5 * t] = x0;
+		bounds[5 * t + 1] = y0;
+		bounds[5 * t + 2] = x1;
+		bounds[5 * t + 3] = y1;
+		bounds[5 * t + 4] = m;
+	}
+
+	void count_run(const vector<size_t>& run_begins, const size_t t, vector<double>&)
+	{
+		size_t* const counts = &run_offsets[t * cells_x * cells_y];
+
+		for (size_t i = run_begins[t]; i < run_begins[t + 1]; i++)
+		{
+			const line_segment_t<T>& ls = (*segments)[i];
+			const double x = (static_cast<double>(ls.vertex[0].x) + ls.vertex[1].x) / 2.0;
+			const double y = (static_cast<double>(ls.vertex[0].y) + ls.vertex[1].y) / 2.0;
+
+			segment_cells[i] = get_cell_y(y) * cells_x + get_cell_x(x);
+			counts[segment_cells[i]]++;
+		}
+	}
+
+	void place_run(const vector<size_t>& run_begins, const size_t t, vector<double>&)
+	{
+		size_t* const next = &run_offsets[t * cells_x * cells_y];
+
+		for (size_t i = run_begins[t]; i < run_begins[t + 1]; i++)
+			cell_segments[next[segment_cells[i]]++] = i;
+	}
+
+	size_t get_cell_x(const double x) const
+	{
+		const double i = floor((x - x_min) / cell_size);
+
+		if (i < 0)
+			return 0;
+
+		return (i >= static_cast<double>(cells_x)) ? cells_x - 1 : static_cast<size_t>(i);
+	}
+
+	size_t get_cell_y(const double y) const
+	{
+		const double j = floor((y - y_min) / cell_size);
+
+		if (j < 0)
+			return 0;
+
+		return (j >= static_cast<double>(cells_y)) ? cells_y - 1 : static_cast<size_t>(j);
+	}
+
+	// level_counts[l] holds the line segment counts of the blocks of
+	// 2^l x 2^l cells, level_x[l] x level_y[l] of them
+	vector<vector<size_t> > level_counts;
+	vector<size_t> level_x, level_y;
+
+	// Scratch space for build()
+	vector<size_t> segment_cells;
+	vector<size_t> run_offsets;
+};
+
+typedef segment_grid_t<real_type> segment_grid;
+
+
+// The answer to one nearest line segment query
+class nearest_segment
+{
+public:
+
+	nearest_segment(void)
+	{
+		segment = contour = 0;
+		distance = DBL_MAX;
+	}
+
+	// DBL_MAX if there are no line segments
+	double distance;
+
+	size_t segment;
+
+	// segment_index_t::no_contour if the contours are not known
+	size_t contour;
+};
+
+
+// The segment_grid, plus the contour of each line segment
+template<typename T>
+class segment_index_t
+{
+public:
+
+	static const size_t no_contour = static_cast<size_t>(-1);
+
+	// lsd must outlive the index; its contours are used if it has been
+	// through process_line_segments()
+	void build(const line_segment_data_t<T>& lsd, const double cell_size, const size_t num_threads = 1)
+	{
+		grid.build(lsd.line_segments, cell_size, num_threads);
+
+		segment_contours.assign(lsd.line_segments.size(), no_contour);
+
+		for (size_t c = 0; c + 1 < lsd.contour_offsets.size(); c++)
+			for (size_t i = lsd.contour_offsets[c]; i < lsd.contour_offsets[c + 1]; i++)
+				segment_contours[lsd.contour_segments[i]] = c;
+	}
+
+	void get_nearest(const double x, const double y, nearest_segment& nearest) const
+	{
+		nearest.distance = grid.get_nearest(x, y, nearest.segment);
+		nearest.contour = (DBL_MAX == nearest.distance) ? no_contour : segment_contours[nearest.segment];
+	}
+
+	// One query per point, split among the threads
+	void get_nearest(const vector<vertex_2_t<T> >& points, vector<nearest_segment>& nearest, const size_t num_threads = 1) const
+	{
+		nearest.resize(points.size());
+
+		size_t n = get_num_threads(num_threads);
+
+		if (n > points.size())
+			n = points.size();
+
+		if (n <= 1)
+		{
+			get_nearest_range(points, 0, points.size(), nearest);
+			return;
+		}
+
+		vector<thread> threads;
+
+		for (size_t t = 0; t < n; t++)
+			threads.push_back(thread(&segment_index_t<T>::get_nearest_range, this, std::cref(points), points.size() * t / n, points.size() * (t + 1) / n, std::ref(nearest)));
+
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+	}
+
+	// The line segments that touch the window [x0, x1] x [y0, y1], in
+	// increasing order
+	void get_in_window(const double x0, const double y0, const double x1, const double y1, vector<size_t>& found) const
+	{
+		found.clear();
+		grid.get_in_window(x0, y0, x1, y1, found);
+		sort(found.begin(), found.end());
+	}
+
+	// The contours that touch the window, in increasing order
+	void get_contours_in_window(const double x0, const double y0, const double x1, const double y1, vector<size_t>& contours) const
+	{
+		vector<size_t> found;
+		grid.get_in_window(x0, y0, x1, y1, found);
+
+		contours.clear();
+
+		for (size_t i = 0; i < found.size(); i++)
+			if (no_contour != segment_contours[found[i]])
+				contours.push_back(segment_contours[found[i]]);
+
+		sort(contours.begin(), contours.end());
+		contours.erase(unique(contours.begin(), contours.end()), contours.end());
+	}
+
+	size_t get_contour(const size_t segment) const
+	{
+		return segment_contours[segment];
+	}
+
+	segment_grid_t<T> grid;
+
+private:
+
+	void get_nearest_range(const vector<vertex_2_t<T> >& points, const size_t begin, const size_t end, vector<nearest_segment>& nearest) const
+	{
+		for (size_t i = begin; i < end; i++)
+			get_nearest(points[i].x, points[i].y, nearest[i]);
+	}
+
+	vector<size_t> segment_contours;
+};
+
+template<typename T>
+const size_t segment_index_t<T>::no_contour;
+
+typedef segment_index_t<real_type> segment_index;
+
+
+// Answer the queries in a text file, one per line, in pixel coordinates
+// (x to the right, y down from the top row):
+//
+//   x y            the nearest line segment, its contour, and the distance
+//   x0 y0 x1 y1    the line segments and contours that touch the window
+//
+// Blank lines and lines that start with # are skipped. The point queries
+// are answered as one batch, split among the threads
+// Returns false if the file could not be read
+template<typename T>
+bool run_segment_queries(const char* const filename, const line_segment_data_t<T>& lsd, const grid_parameters& gp, const size_t num_threads, pipeline_stats* const stats)
+{
+	ifstream in(filename);
+
+	if (!in.is_open())
+	{
+		cout << "Error reading " << filename << endl;
+		return false;
+	}
+
+	// Each query, in plane coordinates
+	vector<vector<double> > queries;
+	vector<vertex_2_t<T> > points;
+	string line;
+
+	while (std::getline(in, line))
+	{
+		if (line.empty() || '#' == line[0])
+			continue;
+
+		istringstream iss(line);
+		vector<double> q;
+		double v = 0;
+
+		while (iss >> v)
+			q.push_back(v);
+
+		if (2 != q.size() && 4 != q.size())
+		{
+			cout << "Skipping query: " << line << endl;
+			continue;
+		}
+
+		for (size_t i = 0; i < q.size(); i += 2)
+		{
+			q[i] = gp.grid_x_min + gp.step_size * q[i];
+			q[i + 1] = gp.grid_y_max - gp.step_size * q[i + 1];
+		}
+
+		if (2 == q.size())
+			points.push_back(vertex_2_t<T>(static_cast<T>(q[0]), static_cast<T>(q[1])));
+
+		queries.push_back(q);
+	}
+
+	segment_index_t<T> index;
+
+	{
+		stage_timer timer(stats, "index");
+		index.build(lsd, 4.0 * gp.step_size, num_threads);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	vector<nearest_segment> nearest;
+	vector<vector<size_t> > window_segments, window_contours;
+
+	{
+		stage_timer timer(stats, "queries");
+
+		index.get_nearest(points, nearest, num_threads);
+
+		for (size_t i = 0; i < queries.size(); i++)
+		{
+			if (4 != queries[i].size())
+				continue;
+
+			const vector<double>& q = queries[i];
+
+			window_segments.push_back(vector<size_t>());
+			window_contours.push_back(vector<size_t>());
+
+			const double x0 = (q[0] < q[2]) ? q[0] : q[2], x1 = (q[0] < q[2]) ? q[2] : q[0];
+			const double y0 = (q[1] < q[3]) ? q[1] : q[3], y1 = (q[1] < q[3]) ? q[3] : q[1];
+
+			index.get_in_window(x0, y0, x1, y1, window_segments.back());
+			index.get_contours_in_window(x0, y0, x1, y1, window_contours.back());
+		}
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	size_t point = 0, window = 0;
+
+	for (size_t i = 0; i < queries.size(); i++)
+	{
+		const vector<double>& q = queries[i];
+
+		// Back to pixels
+		for (size_t j = 0; j < q.size(); j += 2)
+			cout << ((0 == j) ? "" : " ") << (q[j] - gp.grid_x_min) / gp.step_size << " " << (gp.grid_y_max - q[j + 1]) / gp.step_size;
+
+		if (2 == q.size())
+		{
+			const nearest_segment& n = nearest[point++];
+
+			if (DBL_MAX == n.distance)
+				cout << ": no line segments" << endl;
+			else
+			{
+				cout << ": line segment " << n.segment << ", contour ";
+
+				if (segment_index_t<T>::no_contour == n.contour)
+					cout << "unknown";
+				else
+					cout << n.contour;
+
+				cout << ", distance " << n.distance / gp.step_size << endl;
+			}
+		}
+		else
+		{
+			const vector<size_t>& c = window_contours[window];
+
+			cout << ": " << window_segments[window].size() << " line segment(s), " << c.size() << " contour(s)";
+
+			for (size_t j = 0; j < c.size(); j++)
+				cout << ((0 == j) ? ": " : " ") << c[j];
+
+			cout << endl;
+			window++;
+		}
+	}
+
+	cout << queries.size() << " quer" << (1 == queries.size() ? "y" : "ies") << " in " << elapsed.count() << " s";
+
+	if (!queries.empty())
+		cout << " (" << 1e6 * elapsed.count() / static_cast<double>(queries.size()) << " us each)";
+
+	cout << endl;
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,337 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <utility>
+using std::pair;
+
+#include <ostream>
+using std::ostream;
+
+#include <chrono>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <psapi.h>
+	#pragma comment(lib, "psapi.lib")
+#else
+	#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+	#include <fstream>
+	#include <cstdlib>
+	#include <cstring>
+	#include <unistd.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+
+// Peak resident set size of this process, in bytes (0 if unknown)
+size_t get_peak_resident_memory(void)
+{
+#ifdef __linux__
+	// VmHWM honours reset_peak_resident_memory(), unlike getrusage()
+	std::ifstream status("/proc/self/status");
+	string line;
+
+	while (std::getline(status, line))
+		if (0 == line.compare(0, 6, "VmHWM:"))
+			return static_cast<size_t>(strtoull(line.c_str() + 6, 0, 10)) * 1024; // Kilobytes
+#endif
+
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return static_cast<size_t>(pmc.PeakWorkingSetSize);
+
+	return 0;
+#else
+	struct rusage usage;
+
+	if (0 != getrusage(RUSAGE_SELF, &usage))
+		return 0;
+
+#ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss); // Already in bytes
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024; // Kilobytes
+#endif
+#endif
+}
+
+
+// Restart the peak resident set size from the current resident set size
+// Only supported on Linux; returns false elsewhere
+bool reset_peak_resident_memory(void)
+{
+#ifdef __linux__
+	std::ofstream clear_refs("/proc/self/clear_refs");
+
+	if (!clear_refs.is_open())
+		return false;
+
+	clear_refs << "5";
+
+	return clear_refs.good();
+#else
+	return false;
+#endif
+}
+
+
+// Counts this thread's last level cache misses between start() and stop(),
+// from the hardware counters
+// Only supported on Linux, where the kernel may still refuse (see
+// /proc/sys/kernel/perf_event_paranoid); is_available() says if it worked
+class cache_miss_counter
+{
+public:
+
+	cache_miss_counter(void)
+	{
+		fd = -1;
+
+#ifdef __linux__
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+	}
+
+	~cache_miss_counter(void)
+	{
+#ifdef __linux__
+		if (-1 != fd)
+			close(fd);
+#endif
+	}
+
+	bool is_available(void) const
+	{
+		return -1 != fd;
+	}
+
+	void start(void)
+	{
+#ifdef __linux__
+		if (-1 == fd)
+			return;
+
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	// The misses since start(), or 0 if there is no counter
+	unsigned long long stop(void)
+	{
+		unsigned long long count = 0;
+
+#ifdef __linux__
+		if (-1 == fd)
+			return 0;
+
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+		if (sizeof(count) != read(fd, &count, sizeof(count)))
+			count = 0;
+#endif
+
+		return count;
+	}
+
+private:
+
+	int fd;
+};
+
+
+// Timings and counters gathered over one run of the pipeline
+class pipeline_stats
+{
+public:
+
+	pipeline_stats(void)
+	{
+		clear();
+	}
+
+	void clear(void)
+	{
+		stage_seconds.clear();
+
+		for (size_t i = 0; i < 16; i++)
+			case_counts[i] = 0;
+
+		num_cells = 0;
+		box_count = 0;
+		num_segments = 0;
+		num_vertices = 0;
+		num_objects = 0;
+		peak_resident_memory = 0;
+	}
+
+	// Accumulate the time spent in a named stage
+	// Stages are reported in the order that they are first seen
+	void add_stage_time(const string& name, const double seconds)
+	{
+		for (size_t i = 0; i < stage_seconds.size(); i++)
+		{
+			if (stage_seconds[i].first == name)
+			{
+				stage_seconds[i].second += seconds;
+				return;
+			}
+		}
+
+		stage_seconds.push_back(pair<string, double>(name, seconds));
+	}
+
+	// Accumulate another run's timings and counters, such as a worker's
+	void add(const pipeline_stats& s)
+	{
+		for (size_t i = 0; i < s.stage_seconds.size(); i++)
+			add_stage_time(s.stage_seconds[i].first, s.stage_seconds[i].second);
+
+		for (size_t i = 0; i < 16; i++)
+			case_counts[i] += s.case_counts[i];
+
+		num_cells += s.num_cells;
+		box_count += s.box_count;
+		num_segments += s.num_segments;
+		num_vertices += s.num_vertices;
+		num_objects += s.num_objects;
+	}
+
+	double get_stage_time(const string& name) const
+	{
+		for (size_t i = 0; i < stage_seconds.size(); i++)
+			if (stage_seconds[i].first == name)
+				return stage_seconds[i].second;
+
+		return 0;
+	}
+
+	double get_total_time(void) const
+	{
+		double total = 0;
+
+		for (size_t i = 0; i < stage_seconds.size(); i++)
+			total += stage_seconds[i].second;
+
+		return total;
+	}
+
+	void write_json(ostream& out) const
+	{
+		out << "{" << '\n';
+
+		out << "  \"stages\": {" << '\n';
+
+		for (size_t i = 0; i < stage_seconds.size(); i++)
+		{
+			out << "    \"" << stage_seconds[i].first << "\": " << stage_seconds[i].second;
+
+			if (i + 1 < stage_seconds.size())
+				out << ',';
+
+			out << '\n';
+		}
+
+		out << "  }," << '\n';
+		out << "  \"total_seconds\": " << get_total_time() << ',' << '\n';
+
+		out << "  \"case_counts\": [";
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			out << case_counts[i];
+
+			if (i < 15)
+				out << ", ";
+		}
+
+		out << "]," << '\n';
+
+		out << "  \"cells\": " << num_cells << ',' << '\n';
+		out << "  \"box_count\": " << box_count << ',' << '\n';
+		out << "  \"segments\": " << num_segments << ',' << '\n';
+		out << "  \"vertices\": " << num_vertices << ',' << '\n';
+		out << "  \"objects\": " << num_objects << ',' << '\n';
+		out << "  \"peak_resident_bytes\": " << peak_resident_memory << '\n';
+		out << "}" << '\n';
+	}
+
+	vector<pair<string, double> > stage_seconds;
+
+	// Number of grid squares per Marching Squares case mask
+	size_t case_counts[16];
+
+	size_t num_cells;
+	size_t box_count;
+	size_t num_segments;
+	size_t num_vertices;
+	size_t num_objects;
+	size_t peak_resident_memory;
+};
+
+
+// Adds the time between construction and destruction to a stage
+// A null stats pointer makes this a no-op
+class stage_timer
+{
+public:
+
+	stage_timer(pipeline_stats* const src_stats, const char* const src_name)
+	{
+		stats = src_stats;
+		name = src_name;
+		start = std::chrono::steady_clock::now();
+	}
+
+	~stage_timer(void)
+	{
+		stop();
+	}
+
+	// Ends the timed stage early; later calls do nothing
+	void stop(void)
+	{
+		if (0 == stats)
+			return;
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		stats->add_stage_time(name, elapsed.count());
+		stats = 0;
+	}
+
+private:
+
+	pipeline_stats* stats;
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif
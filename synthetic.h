@@ -0,0 +1,459 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+
+#include "image.h"
+#include "image_source.h"
+
+#include <cmath>
+
+#include <vector>
+using std::vector;
+
+#include <thread>
+using std::thread;
+
+#include <algorithm>
+using std::sort;
+
+#include <random>
+
+
+// Procedurally generated test images
+//
+// Each image is px x px, with values in [0, 1] and a black border, so that
+// the line segment mesh(es) are closed at an isovalue of 0.5
+
+
+// Runs fill_rows(l, y_begin, y_end) over num_threads bands of rows
+template<typename F>
+void fill_rows_in_parallel(float_grayscale& l, F fill_rows, size_t num_threads)
+{
+	if (0 == num_threads)
+		num_threads = thread::hardware_concurrency();
+
+	if (0 == num_threads)
+		num_threads = 1;
+
+	vector<thread> threads;
+
+	for (size_t i = 0; i < num_threads; i++)
+		threads.push_back(thread(fill_rows, std::ref(l), l.py * i / num_threads, l.py * (i + 1) / num_threads));
+
+	for (size_t i = 0; i < num_threads; i++)
+		threads[i].join();
+}
+
+// Escape-time fractal; the value is the smoothed (normalized) iteration
+// count as a fraction of max_iterations, so points inside the set are 1
+// and no pixel lands exactly on the isovalue
+class escape_time_parameters
+{
+public:
+
+	escape_time_parameters(void)
+	{
+		julia = false;
+		c_x = c_y = 0;
+		x_min = -2.0;
+		x_max = 1.0;
+		y_min = -1.5;
+		y_max = 1.5;
+		max_iterations = 64;
+	}
+
+	bool julia;
+	double c_x, c_y;
+	double x_min, x_max, y_min, y_max;
+	size_t max_iterations;
+};
+
+// Number of points that are iterated together; the lanes are written as
+// plain loops over arrays, with selects instead of branches, so that the
+// compiler can vectorize them
+const size_t escape_time_lanes = 8;
+
+// Evaluate escape_time_lanes points along one row
+void get_escape_time_values(const escape_time_parameters& p, const double* const xs, const double y, float* const values)
+{
+	double z_x[escape_time_lanes], z_y[escape_time_lanes];
+	double c_x[escape_time_lanes], c_y[escape_time_lanes];
+	double count[escape_time_lanes];
+
+	for (size_t l = 0; l < escape_time_lanes; l++)
+	{
+		if (p.julia)
+		{
+			z_x[l] = xs[l];
+			z_y[l] = y;
+			c_x[l] = p.c_x;
+			c_y[l] = p.c_y;
+		}
+		else
+		{
+			z_x[l] = z_y[l] = 0;
+			c_x[l] = xs[l];
+			c_y[l] = y;
+		}
+
+		count[l] = 0;
+	}
+
+	for (size_t i = 0; i < p.max_iterations; i++)
+	{
+		size_t num_active = 0;
+
+		for (size_t l = 0; l < escape_time_lanes; l++)
+		{
+			const double z_x2 = z_x[l] * z_x[l];
+			const double z_y2 = z_y[l] * z_y[l];
+
+			// A lane stays frozen once it has escaped, or has
+			// fallen behind the iteration count
+			const bool active = (z_x2 + z_y2 <= 256.0) && (count[l] == static_cast<double>(i));
+
+			const double next_z_y = 2.0 * z_x[l] * z_y[l] + c_y[l];
+			const double next_z_x = z_x2 - z_y2 + c_x[l];
+
+			z_x[l] = active ? next_z_x : z_x[l];
+			z_y[l] = active ? next_z_y : z_y[l];
+			count[l] += active ? 1.0 : 0.0;
+			num_active += active ? 1 : 0;
+		}
+
+		if (0 == num_active)
+			break;
+	}
+
+	for (size_t l = 0; l < escape_time_lanes; l++)
+	{
+		const double mag2 = z_x[l] * z_x[l] + z_y[l] * z_y[l];
+
+		if (mag2 <= 256.0)
+		{
+			// Never escaped
+			values[l] = 1.0f;
+			continue;
+		}
+
+		// http://linas.org/art-gallery/escape/smooth.html
+		double nu = count[l] + 1.0 - log(log(sqrt(mag2))) / log(2.0);
+
+		if (nu < 0)
+			nu = 0;
+
+		if (nu > static_cast<double>(p.max_iterations))
+			nu = static_cast<double>(p.max_iterations);
+
+		values[l] = static_cast<float>(nu / p.max_iterations);
+	}
+}
+
+
+// Escape-time fractal as an image_source, of any size
+//
+// Rows are generated on demand, in parallel, straight into the march's
+// row buffer, so that the image never has to exist as a whole
+class escape_time_source : public image_source
+{
+public:
+
+	escape_time_source(const size_t src_px, const size_t src_py, const escape_time_parameters& src_p, const bool src_black_border, const size_t src_num_threads = 0)
+	{
+		px = src_px;
+		py = src_py;
+		p = src_p;
+		black_border = src_black_border;
+		num_threads = src_num_threads;
+
+		if (0 == num_threads)
+			num_threads = thread::hardware_concurrency();
+
+		if (0 == num_threads)
+			num_threads = 1;
+
+		// Padded out to a whole number of lanes, plus one more, for windows
+		// that start part of the way into a lane
+		xs.resize((px + escape_time_lanes - 1) / escape_time_lanes * escape_time_lanes + escape_time_lanes);
+
+		for (size_t x = 0; x < xs.size(); x++)
+			xs[x] = p.x_min + (p.x_max - p.x_min) * x / (px - 1);
+	}
+
+	size_t get_px(void) const
+	{
+		return px;
+	}
+
+	size_t get_py(void) const
+	{
+		return py;
+	}
+
+	bool get_rows(const size_t y_begin, const size_t count, float* const dst)
+	{
+		if (y_begin + count > py)
+			return false;
+
+		size_t n = num_threads;
+
+		if (n > count)
+			n = count;
+
+		if (1 >= n)
+		{
+			fill_rows(y_begin, y_begin + count, dst);
+		}
+		else
+		{
+			vector<thread> threads;
+
+			// Interleave the rows, since escape time varies a lot from row to row
+			for (size_t i = 0; i < n; i++)
+				threads.push_back(thread(&escape_time_source::fill_interleaved_rows, this, y_begin, count, i, n, dst));
+
+			for (size_t i = 0; i < n; i++)
+				threads[i].join();
+		}
+
+		return true;
+	}
+
+	// Only the window is generated
+	bool get_window(const size_t x, const size_t y, const size_t w, const size_t h, float* const dst)
+	{
+		if (x + w > px || y + h > py)
+			return false;
+
+		for (size_t i = 0; i < h; i++)
+			fill_row(y + i, x, x + w, dst + i * w);
+
+		return true;
+	}
+
+private:
+
+	// Columns [x_begin, x_end) of row y, where row[0] is column x_begin
+	void fill_row(const size_t y, const size_t x_begin, const size_t x_end, float* const row) const
+	{
+		const double pos_y = p.y_max - (p.y_max - p.y_min) * y / (py - 1);
+		float values[escape_time_lanes];
+
+		for (size_t x = x_begin; x < x_end; x += escape_time_lanes)
+		{
+			get_escape_time_values(p, &xs[x], pos_y, values);
+
+			for (size_t l = 0; l < escape_time_lanes && x + l < x_end; l++)
+				row[x + l - x_begin] = values[l];
+		}
+
+		if (black_border)
+		{
+			for (size_t x = x_begin; x < x_end; x++)
+				if (0 == x || px - 1 == x || 0 == y || py - 1 == y)
+					row[x - x_begin] = 0;
+		}
+	}
+
+	void fill_rows(const size_t y_begin, const size_t y_end, float* const dst) const
+	{
+		for (size_t y = y_begin; y < y_end; y++)
+			fill_row(y, 0, px, dst + (y - y_begin) * px);
+	}
+
+	void fill_interleaved_rows(const size_t y_begin, const size_t count, const size_t first, const size_t stride, float* const dst) const
+	{
+		for (size_t i = first; i < count; i += stride)
+			fill_row(y_begin + i, 0, px, dst + i * px);
+	}
+
+	size_t px, py;
+	escape_time_parameters p;
+	bool black_border;
+	size_t num_threads;
+	vector<double> xs;
+};
+
+
+void generate_escape_time(float_grayscale& l, const unsigned short int px, const escape_time_parameters& p, const size_t num_threads = 0)
+{
+	escape_time_source src(px, px, p, true, num_threads);
+	read_image_source(src, l);
+}
+
+void generate_mandelbrot(float_grayscale& l, const unsigned short int px, const size_t num_threads = 0)
+{
+	escape_time_parameters p;
+	generate_escape_time(l, px, p, num_threads);
+}
+
+escape_time_parameters get_julia_parameters(void)
+{
+	escape_time_parameters p;
+	p.julia = true;
+	p.c_x = -0.8;
+	p.c_y = 0.156;
+	p.x_min = p.y_min = -1.6;
+	p.x_max = p.y_max = 1.6;
+
+	return p;
+}
+
+void generate_julia(float_grayscale& l, const unsigned short int px, const size_t num_threads = 0)
+{
+	generate_escape_time(l, px, get_julia_parameters(), num_threads);
+}
+
+
+// Random white disks on a black background
+void generate_random_disks(float_grayscale& l, const unsigned short int px, const size_t num_disks, const unsigned int seed, const size_t num_threads = 0)
+{
+	l.px = l.py = px;
+	l.pixel_data.assign(static_cast<size_t>(px) * px, 0.0f);
+
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<double> pos(0.0, 1.0);
+	std::uniform_real_distribution<double> rad(0.005, 0.05);
+
+	vector<double> disks; // x, y, radius (in pixels)
+
+	for (size_t i = 0; i < num_disks; i++)
+	{
+		disks.push_back(pos(gen) * px);
+		disks.push_back(pos(gen) * px);
+		disks.push_back(rad(gen) * px);
+	}
+
+	fill_rows_in_parallel(l, [&disks](float_grayscale& img, size_t y_begin, size_t y_end)
+	{
+		for (size_t i = 0; i < disks.size(); i += 3)
+		{
+			const double cx = disks[i], cy = disks[i + 1], r = disks[i + 2];
+
+			for (size_t y = y_begin; y < y_end; y++)
+			{
+				const double dy = static_cast<double>(y) - cy;
+
+				if (dy * dy > r * r)
+					continue;
+
+				const double half_width = sqrt(r * r - dy * dy);
+
+				double x_begin = floor(cx - half_width);
+				double x_end = ceil(cx + half_width);
+
+				if (x_begin < 0)
+					x_begin = 0;
+
+				if (x_end > img.px)
+					x_end = img.px;
+
+				for (size_t x = static_cast<size_t>(x_begin); x < static_cast<size_t>(x_end); x++)
+				{
+					const double dx = static_cast<double>(x) - cx;
+
+					if (dx * dx + dy * dy <= r * r)
+						img.pixel_data[y * img.px + x] = 1.0f;
+				}
+			}
+		}
+	}, num_threads);
+
+	make_black_border(l);
+}
+
+
+// Koch snowflake of the given recursion depth, filled white
+void generate_koch_snowflake(float_grayscale& l, const unsigned short int px, const size_t depth, const size_t num_threads = 0)
+{
+	l.px = l.py = px;
+	l.pixel_data.assign(static_cast<size_t>(px) * px, 0.0f);
+
+	// Start with an equilateral triangle, centred in the image
+	const double pi = 3.14159265358979323846;
+	const double r = 0.38 * px;
+	vector<double> poly; // x, y pairs
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		const double a = pi / 2.0 + 2.0 * pi * i / 3.0;
+		poly.push_back(px / 2.0 + r * cos(a));
+		poly.push_back(px / 2.0 - r * sin(a));
+	}
+
+	// Replace each edge with four edges, bumping outwards
+	for (size_t d = 0; d < depth; d++)
+	{
+		vector<double> next;
+		const size_t n = poly.size() / 2;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const double ax = poly[2 * i], ay = poly[2 * i + 1];
+			const double bx = poly[2 * ((i + 1) % n)], by = poly[2 * ((i + 1) % n) + 1];
+			const double dx = (bx - ax) / 3.0, dy = (by - ay) / 3.0;
+
+			const double p1x = ax + dx, p1y = ay + dy;
+			const double p3x = ax + 2 * dx, p3y = ay + 2 * dy;
+
+			// Rotate the middle third by 60 degrees
+			const double c = cos(pi / 3.0), s = sin(pi / 3.0);
+			const double p2x = p1x + dx * c + dy * s;
+			const double p2y = p1y - dx * s + dy * c;
+
+			next.push_back(ax); next.push_back(ay);
+			next.push_back(p1x); next.push_back(p1y);
+			next.push_back(p2x); next.push_back(p2y);
+			next.push_back(p3x); next.push_back(p3y);
+		}
+
+		poly.swap(next);
+	}
+
+	// Even-odd scanline fill, sampling at pixel centres
+	fill_rows_in_parallel(l, [&poly](float_grayscale& img, size_t y_begin, size_t y_end)
+	{
+		const size_t n = poly.size() / 2;
+		vector<double> crossings;
+
+		for (size_t y = y_begin; y < y_end; y++)
+		{
+			const double sy = static_cast<double>(y);
+			crossings.clear();
+
+			for (size_t i = 0; i < n; i++)
+			{
+				const double ax = poly[2 * i], ay = poly[2 * i + 1];
+				const double bx = poly[2 * ((i + 1) % n)], by = poly[2 * ((i + 1) % n) + 1];
+
+				if ((ay <= sy && by > sy) || (by <= sy && ay > sy))
+					crossings.push_back(ax + (sy - ay) / (by - ay) * (bx - ax));
+			}
+
+			sort(crossings.begin(), crossings.end());
+
+			for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+			{
+				double x_begin = ceil(crossings[i]);
+				double x_end = floor(crossings[i + 1]);
+
+				if (x_begin < 0)
+					x_begin = 0;
+
+				if (x_end > img.px - 1)
+					x_end = img.px - 1.0;
+
+				for (double x = x_begin; x <= x_end; x++)
+					img.pixel_data[y * img.px + static_cast<size_t>(x)] = 1.0f;
+			}
+		}
+	}, num_threads);
+
+	make_black_border(l);
+}
+
+#endif
@@ -0,0 +1,218 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef VOLUME_SOURCE_H
+#define VOLUME_SOURCE_H
+
+
+#include "image.h"
+#include "image_source.h"
+
+#include <cmath>
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+
+// A stack of grayscale slices that the cube march consumes slice by slice
+//
+// Each thread of the march asks for the slices of its own slab, in
+// increasing order, so get_slice() may be called from several threads at
+// once (for different slices); a source should not keep the whole volume
+class volume_source
+{
+public:
+
+	virtual ~volume_source(void)
+	{
+	}
+
+	virtual size_t get_px(void) const = 0;
+	virtual size_t get_py(void) const = 0;
+	virtual size_t get_pz(void) const = 0;
+
+	// Write slice z into dst, which holds px*py floats, top row first
+	virtual bool get_slice(const size_t z, float* const dst) = 0;
+};
+
+
+// One 24-bit TGA file per slice, read and converted to luma when the
+// slice is asked for
+class tga_stack_source : public volume_source
+{
+public:
+
+	tga_stack_source(const vector<string>& src_filenames)
+	{
+		filenames = src_filenames;
+		px = py = 0;
+	}
+
+	// Take the size of the slices from the first file
+	bool open(void)
+	{
+		tga t;
+
+		if (filenames.empty() || false == read_tga(filenames[0].c_str(), t, false, true))
+			return false;
+
+		px = t.px;
+		py = t.py;
+
+		return true;
+	}
+
+	size_t get_px(void) const
+	{
+		return px;
+	}
+
+	size_t get_py(void) const
+	{
+		return py;
+	}
+
+	size_t get_pz(void) const
+	{
+		return filenames.size();
+	}
+
+	bool get_slice(const size_t z, float* const dst)
+	{
+		if (z >= filenames.size())
+			return false;
+
+		tga t;
+
+		if (false == read_tga(filenames[z].c_str(), t, false, true))
+			return false;
+
+		if (t.px != px || t.py != py)
+		{
+			cout << filenames[z] << ": the slices must all be the same size" << endl;
+			return false;
+		}
+
+		tga_luma_source src(t, true);
+
+		return src.get_rows(0, py, dst);
+	}
+
+private:
+
+	vector<string> filenames;
+	size_t px, py;
+};
+
+
+// Escape-time quaternion Julia set, z = z^2 + c, over the cube
+// [-extent, extent]^3 of the hyperplane w = 0
+//
+// As for escape_time_source, the value is the smoothed iteration count as a
+// fraction of max_iterations, so points inside the set are 1
+class quaternion_julia_parameters
+{
+public:
+
+	quaternion_julia_parameters(void)
+	{
+		c_x = -0.2;
+		c_y = 0.8;
+		c_z = c_w = 0;
+		extent = 1.5;
+		max_iterations = 16;
+	}
+
+	double c_x, c_y, c_z, c_w;
+	double extent;
+	size_t max_iterations;
+};
+
+class quaternion_julia_source : public volume_source
+{
+public:
+
+	quaternion_julia_source(const size_t src_n, const quaternion_julia_parameters& src_p)
+	{
+		n = src_n;
+		p = src_p;
+	}
+
+	size_t get_px(void) const
+	{
+		return n;
+	}
+
+	size_t get_py(void) const
+	{
+		return n;
+	}
+
+	size_t get_pz(void) const
+	{
+		return n;
+	}
+
+	bool get_slice(const size_t z, float* const dst)
+	{
+		if (z >= n || n < 2)
+			return false;
+
+		const double step = 2.0 * p.extent / static_cast<double>(n - 1);
+		const double qz = p.extent - step * z;
+
+		for (size_t y = 0; y < n; y++)
+		{
+			const double qy = p.extent - step * y;
+
+			for (size_t x = 0; x < n; x++)
+				dst[y * n + x] = get_value(-p.extent + step * x, qy, qz);
+		}
+
+		return true;
+	}
+
+private:
+
+	float get_value(const double x, const double y, const double z) const
+	{
+		double a = x, b = y, c = z, d = 0;
+		double mag2 = a * a + b * b + c * c + d * d;
+		size_t count = 0;
+
+		while (count < p.max_iterations && mag2 <= 256.0)
+		{
+			const double next_a = a * a - b * b - c * c - d * d + p.c_x;
+			b = 2.0 * a * b + p.c_y;
+			c = 2.0 * a * c + p.c_z;
+			d = 2.0 * a * d + p.c_w;
+			a = next_a;
+
+			mag2 = a * a + b * b + c * c + d * d;
+			count++;
+		}
+
+		if (mag2 <= 256.0)
+			return 1.0f;
+
+		// http://linas.org/art-gallery/escape/smooth.html
+		double nu = static_cast<double>(count) + 1.0 - log(log(sqrt(mag2))) / log(2.0);
+
+		if (nu < 0)
+			nu = 0;
+
+		if (nu > static_cast<double>(p.max_iterations))
+			nu = static_cast<double>(p.max_iterations);
+
+		return static_cast<float>(nu / p.max_iterations);
+	}
+
+	size_t n;
+	quaternion_julia_parameters p;
+};
+
+#endif
@@ -0,0 +1,919 @@
+// Code by: Shawn Halayka -- sjhalayka@gmail.com
+// Code is in the public domain
+
+
+#ifndef ZIP_ARCHIVE_H
+#define ZIP_ARCHIVE_H
+
+
+// Members of zip archives, read as they are inflated
+//
+// A member is opened as an istream, so that the image readers take their
+// rows straight from the inflater, a buffer at a time, without the member
+// ever being extracted to disk or held in memory as a whole. Stored and
+// deflated members are supported; encrypted members and zip64 archives
+// (members or archives of 4 GB and up) are not
+
+
+#include <vector>
+using std::vector;
+
+#include <string>
+using std::string;
+
+#include <fstream>
+using std::ifstream;
+
+#include <istream>
+using std::istream;
+
+#include <streambuf>
+
+#include <ios>
+using std::ios;
+
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+#include <cctype>
+#include <cstring>
+
+
+// CRC-32 (IEEE 802.3), as stored for each member
+class crc32_table
+{
+public:
+
+	crc32_table(void)
+	{
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			unsigned int c = i;
+
+			for (size_t j = 0; j < 8; j++)
+				c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+
+			table[i] = c;
+		}
+	}
+
+	unsigned int update(unsigned int crc, const unsigned char* const p, const size_t count) const
+	{
+		crc = ~crc;
+
+		for (size_t i = 0; i < count; i++)
+			crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+
+		return ~crc;
+	}
+
+private:
+
+	unsigned int table[256];
+};
+
+const crc32_table& get_crc32_table(void)
+{
+	static const crc32_table t;
+	return t;
+}
+
+
+// A canonical Huffman code of a DEFLATE block
+//
+// Codes of up to fast_bits bits are decoded with one table lookup; longer
+// ones bit by bit, from the number of codes of each length
+class huffman_code
+{
+public:
+
+	static const size_t max_bits = 15;
+	static const size_t fast_bits = 9;
+
+	// Build the code from the code length of each symbol (0 for unused)
+	// Returns false if the lengths over-subscribe the code
+	bool set(const unsigned char* const lengths, const size_t num_symbols)
+	{
+		for (size_t i = 0; i <= max_bits; i++)
+			count[i] = 0;
+
+		for (size_t i = 0; i < num_symbols; i++)
+			count[lengths[i]]++;
+
+		count[0] = 0;
+
+		// Each length has room for twice the codes left over by the last
+		int left = 1;
+
+		for (size_t i = 1; i <= max_bits; i++)
+		{
+			left = left * 2 - count[i];
+
+			if (left < 0)
+				return false;
+		}
+
+		unsigned short int offsets[max_bits + 1];
+		offsets[1] = 0;
+
+		for (size_t i = 1; i < max_bits; i++)
+			offsets[i + 1] = offsets[i] + count[i];
+
+		symbols.resize(num_symbols);
+
+		for (size_t i = 0; i < num_symbols; i++)
+			if (0 != lengths[i])
+				symbols[offsets[lengths[i]]++] = static_cast<unsigned short int>(i);
+
+		// The codes are packed into the stream starting from their most
+		// significant bit, so the table is indexed by the reversed code
+		for (size_t i = 0; i < (1u << fast_bits); i++)
+			fast[i] = 0;
+
+		unsigned int code = 0;
+		size_t index = 0;
+
+		for (size_t len = 1; len <= max_bits; len++)
+		{
+			for (size_t i = 0; i < count[len]; i++, index++, code++)
+			{
+				if (len > fast_bits)
+					continue;
+
+				unsigned int reversed = 0;
+
+				for (size_t j = 0; j < len; j++)
+					reversed |= ((code >> j) & 1) << (len - 1 - j);
+
+				for (unsigned int fill = reversed; fill < (1u << fast_bits); fill += (1u << len))
+					fast[fill] = static_cast<unsigned short int>((symbols[index] << 4) | len);
+			}
+
+			code <<= 1;
+		}
+
+		return true;
+	}
+
+	unsigned short int count[max_bits + 1];
+	vector<unsigned short int> symbols;
+
+	// Symbol << 4 | code length, or 0 if the code is longer than fast_bits
+	unsigned short int fast[1 << fast_bits];
+};
+
+
+// Raw DEFLATE decoder (RFC 1951), which inflates as much as it is asked
+// for at a time, keeping only the 32 KB window of earlier output
+class inflater
+{
+public:
+
+	inflater(void)
+	{
+		in = 0;
+		window.resize(window_size);
+		reset(0, 0);
+	}
+
+	// Start on the compressed_size bytes at the stream's read position
+	void reset(istream* const src, const unsigned long long int src_compressed_size)
+	{
+		in = src;
+		compressed_remaining = src_compressed_size;
+		input.clear();
+		input_pos = 0;
+		padding = 0;
+		bit_buffer = 0;
+		bit_count = 0;
+		total_out = 0;
+		match_remaining = 0;
+		match_distance = 0;
+		stored_remaining = 0;
+		in_block = false;
+		stored = false;
+		final_block = false;
+		done = false;
+		error = false;
+	}
+
+	// Write up to count bytes into dst
+	// Returns the number of bytes written, which is only short at the end
+	// of the data or on an error
+	size_t read(unsigned char* const dst, const size_t count)
+	{
+		size_t produced = 0;
+
+		while (produced < count && !done && !error)
+		{
+			if (0 != match_remaining)
+			{
+				size_t n = count - produced;
+
+				if (n > match_remaining)
+					n = match_remaining;
+
+				for (size_t i = 0; i < n; i++)
+					put(window[(total_out - match_distance) & window_mask], dst, produced);
+
+				match_remaining -= n;
+			}
+			else if (in_block && stored)
+			{
+				if (0 == stored_remaining)
+				{
+					in_block = false;
+					continue;
+				}
+
+				put(static_cast<unsigned char>(get_bits(8)), dst, produced);
+				stored_remaining--;
+			}
+			else if (in_block)
+			{
+				decode_symbol(dst, produced);
+			}
+			else if (final_block)
+			{
+				done = true;
+			}
+			else
+			{
+				read_block_header();
+			}
+
+			if (padding > 4)
+				fail("zip member data is short.");
+		}
+
+		return produced;
+	}
+
+	bool is_done(void) const
+	{
+		return done;
+	}
+
+	bool failed(void) const
+	{
+		return error;
+	}
+
+private:
+
+	static const size_t window_size = 32768;
+	static const size_t window_mask = window_size - 1;
+	static const size_t input_buffer_size = 65536;
+
+	void fail(const char* const message)
+	{
+		if (!error)
+			cerr << message << endl;
+
+		error = true;
+	}
+
+	void put(const unsigned char b, unsigned char* const dst, size_t& produced)
+	{
+		dst[produced++] = b;
+		window[total_out & window_mask] = b;
+		total_out++;
+	}
+
+	// Fill the bit buffer to at least n bits; past the end of the data, zeros
+	// are fed in, and counted, so that lookahead at the end still works
+	void need(const size_t n)
+	{
+		while (bit_count < n)
+		{
+			if (input_pos == input.size())
+				fill_input();
+
+			unsigned int b = 0;
+
+			if (input_pos < input.size())
+				b = input[input_pos++];
+			else
+				padding++;
+
+			bit_buffer |= static_cast<unsigned long long int>(b) << bit_count;
+			bit_count += 8;
+		}
+	}
+
+	void fill_input(void)
+	{
+		input.clear();
+		input_pos = 0;
+
+		if (0 == in || 0 == compressed_remaining)
+			return;
+
+		size_t n = input_buffer_size;
+
+		if (n > compressed_remaining)
+			n = static_cast<size_t>(compressed_remaining);
+
+		input.resize(n);
+		in->read(reinterpret_cast<char*>(&input[0]), n);
+		input.resize(static_cast<size_t>(in->gcount()));
+		compressed_remaining -= n;
+	}
+
+	unsigned int get_bits(const size_t n)
+	{
+		if (0 == n)
+			return 0;
+
+		need(n);
+
+		const unsigned int bits = static_cast<unsigned int>(bit_buffer & ((1ull << n) - 1));
+		bit_buffer >>= n;
+		bit_count -= n;
+
+		return bits;
+	}
+
+	int decode(const huffman_code& h)
+	{
+		need(huffman_code::fast_bits);
+
+		const unsigned short int entry = h.fast[bit_buffer & ((1u << huffman_code::fast_bits) - 1)];
+
+		if (0 != entry)
+		{
+			const size_t len = entry & 15;
+			bit_buffer >>= len;
+			bit_count -= len;
+
+			return entry >> 4;
+		}
+
+		// http://www.zlib.net/ (contrib/puff)
+		int code = 0, first = 0, index = 0;
+
+		for (size_t len = 1; len <= huffman_code::max_bits; len++)
+		{
+			code |= static_cast<int>(get_bits(1));
+			const int count = h.count[len];
+
+			if (code - count < first)
+				return h.symbols[index + (code - first)];
+
+			index += count;
+			first += count;
+			first <<= 1;
+			code <<= 1;
+		}
+
+		fail("zip member has an invalid Huffman code.");
+		return 0;
+	}
+
+	void decode_symbol(unsigned char* const dst, size_t& produced)
+	{
+		static const unsigned short int length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const unsigned char length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const unsigned short int distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const unsigned char distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		const int symbol = decode(literal_code);
+
+		if (symbol < 256)
+		{
+			put(static_cast<unsigned char>(symbol), dst, produced);
+			return;
+		}
+
+		if (256 == symbol)
+		{
+			in_block = false;
+			return;
+		}
+
+		if (symbol > 285)
+		{
+			fail("zip member has an invalid length code.");
+			return;
+		}
+
+		const size_t length = length_base[symbol - 257] + get_bits(length_extra[symbol - 257]);
+		const int distance_symbol = decode(distance_code);
+
+		if (distance_symbol > 29)
+		{
+			fail("zip member has an invalid distance code.");
+			return;
+		}
+
+		const size_t distance = distance_base[distance_symbol] + get_bits(distance_extra[distance_symbol]);
+
+		if (distance > total_out)
+		{
+			fail("zip member refers back past its start.");
+			return;
+		}
+
+		match_remaining = length;
+		match_distance = distance;
+	}
+
+	void read_block_header(void)
+	{
+		final_block = (1 == get_bits(1));
+		const unsigned int type = get_bits(2);
+
+		in_block = true;
+		stored = false;
+
+		if (0 == type)
+		{
+			// Stored blocks start on a byte boundary
+			get_bits(bit_count & 7);
+
+			const unsigned int length = get_bits(16);
+			const unsigned int complement = get_bits(16);
+
+			if (length != (~complement & 0xFFFF))
+			{
+				fail("zip member has an invalid stored block.");
+				return;
+			}
+
+			stored = true;
+			stored_remaining = length;
+		}
+		else if (1 == type)
+		{
+			unsigned char lengths[288 + 30];
+
+			for (size_t i = 0; i < 288; i++)
+				lengths[i] = (i < 144) ? 8 : ((i < 256) ? 9 : ((i < 280) ? 7 : 8));
+
+			for (size_t i = 0; i < 30; i++)
+				lengths[288 + i] = 5;
+
+			literal_code.set(lengths, 288);
+			distance_code.set(lengths + 288, 30);
+		}
+		else if (2 == type)
+		{
+			read_dynamic_codes();
+		}
+		else
+		{
+			fail("zip member has an invalid block type.");
+		}
+	}
+
+	void read_dynamic_codes(void)
+	{
+		static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		const size_t num_literals = get_bits(5) + 257;
+		const size_t num_distances = get_bits(5) + 1;
+		const size_t num_code_lengths = get_bits(4) + 4;
+
+		if (num_literals > 286 || num_distances > 30)
+		{
+			fail("zip member has too many codes.");
+			return;
+		}
+
+		unsigned char lengths[286 + 30];
+		memset(lengths, 0, sizeof(lengths));
+
+		for (size_t i = 0; i < num_code_lengths; i++)
+			lengths[order[i]] = static_cast<unsigned char>(get_bits(3));
+
+		huffman_code length_code;
+
+		if (false == length_code.set(lengths, 19))
+		{
+			fail("zip member has an invalid code length code.");
+			return;
+		}
+
+		memset(lengths, 0, sizeof(lengths));
+
+		size_t index = 0;
+
+		while (index < num_literals + num_distances && !error)
+		{
+			const int symbol = decode(length_code);
+
+			if (symbol < 16)
+			{
+				lengths[index++] = static_cast<unsigned char>(symbol);
+				continue;
+			}
+
+			unsigned char value = 0;
+			size_t repeat = 0;
+
+			if (16 == symbol)
+			{
+				if (0 == index)
+				{
+					fail("zip member repeats a code length before the first.");
+					return;
+				}
+
+				value = lengths[index - 1];
+				repeat = 3 + get_bits(2);
+			}
+			else if (17 == symbol)
+			{
+				repeat = 3 + get_bits(3);
+			}
+			else
+			{
+				repeat = 11 + get_bits(7);
+			}
+
+			if (index + repeat > num_literals + num_distances)
+			{
+				fail("zip member has too many code lengths.");
+				return;
+			}
+
+			for (size_t i = 0; i < repeat; i++)
+				lengths[index++] = value;
+		}
+
+		if (error)
+			return;
+
+		if (0 == lengths[256])
+		{
+			fail("zip member has no end of block code.");
+			return;
+		}
+
+		if (false == literal_code.set(lengths, num_literals) || false == distance_code.set(lengths + num_literals, num_distances))
+			fail("zip member has an invalid Huffman code.");
+	}
+
+	istream* in;
+	unsigned long long int compressed_remaining;
+	vector<unsigned char> input;
+	size_t input_pos;
+	size_t padding;
+
+	unsigned long long int bit_buffer;
+	size_t bit_count;
+
+	vector<unsigned char> window;
+	unsigned long long int total_out;
+	size_t match_remaining;
+	size_t match_distance;
+	size_t stored_remaining;
+
+	huffman_code literal_code;
+	huffman_code distance_code;
+
+	bool in_block;
+	bool stored;
+	bool final_block;
+	bool done;
+	bool error;
+};
+
+
+// One member of an archive, from its central directory record
+class zip_entry
+{
+public:
+
+	string name;
+	unsigned short int method;
+	unsigned int crc;
+	unsigned long long int compressed_size;
+	unsigned long long int uncompressed_size;
+	unsigned long long int local_header_offset;
+};
+
+
+unsigned int get_le16(const unsigned char* const p)
+{
+	return p[0] | (static_cast<unsigned int>(p[1]) << 8);
+}
+
+unsigned int get_le32(const unsigned char* const p)
+{
+	return get_le16(p) | (get_le16(p + 2) << 16);
+}
+
+
+// The central directory of a zip archive
+//
+// Once open, any number of threads may open members at once; each member
+// has its own file handle
+class zip_archive
+{
+public:
+
+	bool open(const char* const src_filename)
+	{
+		// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+		filename = src_filename;
+		entries.clear();
+
+		ifstream in(src_filename, ios::binary);
+
+		if (!in.is_open())
+		{
+			cerr << "Failed to open zip archive: " << filename << endl;
+			return false;
+		}
+
+		// The end of central directory record is in the last 64 KB + 22
+		// bytes, depending on the length of the archive comment
+		in.seekg(0, ios::end);
+		const unsigned long long int file_size = static_cast<unsigned long long int>(in.tellg());
+		const size_t tail_size = static_cast<size_t>(file_size < 65557 ? file_size : 65557);
+
+		vector<unsigned char> tail(tail_size);
+		in.seekg(static_cast<std::streamoff>(file_size - tail_size));
+
+		if (tail_size < 22 || !in.read(reinterpret_cast<char*>(&tail[0]), tail_size))
+		{
+			cerr << "Not a zip archive: " << filename << endl;
+			return false;
+		}
+
+		size_t end_record = tail_size - 22 + 1;
+
+		while (end_record > 0 && 0x06054b50 != get_le32(&tail[end_record - 1]))
+			end_record--;
+
+		if (0 == end_record)
+		{
+			cerr << "Not a zip archive: " << filename << endl;
+			return false;
+		}
+
+		const unsigned char* const e = &tail[end_record - 1];
+		const size_t num_entries = get_le16(e + 10);
+		const size_t directory_size = get_le32(e + 12);
+		const unsigned long long int directory_offset = get_le32(e + 16);
+
+		if (0xFFFF == num_entries || 0xFFFFFFFF == directory_offset)
+		{
+			cerr << "Zip64 archives are not supported: " << filename << endl;
+			return false;
+		}
+
+		vector<unsigned char> directory(directory_size + 1);
+		in.seekg(static_cast<std::streamoff>(directory_offset));
+
+		if (!in.read(reinterpret_cast<char*>(&directory[0]), directory_size))
+		{
+			cerr << "Zip archive is short: " << filename << endl;
+			return false;
+		}
+
+		size_t pos = 0;
+
+		for (size_t i = 0; i < num_entries; i++)
+		{
+			if (pos + 46 > directory_size || 0x02014b50 != get_le32(&directory[pos]))
+			{
+				cerr << "Zip archive has an invalid central directory: " << filename << endl;
+				return false;
+			}
+
+			const unsigned char* const d = &directory[pos];
+			const size_t name_length = get_le16(d + 28);
+			const size_t record_size = 46 + name_length + get_le16(d + 30) + get_le16(d + 32);
+
+			if (pos + record_size > directory_size)
+			{
+				cerr << "Zip archive has an invalid central directory: " << filename << endl;
+				return false;
+			}
+
+			zip_entry z;
+			z.name.assign(reinterpret_cast<const char*>(d + 46), name_length);
+			z.method = static_cast<unsigned short int>(get_le16(d + 10));
+			z.crc = get_le32(d + 16);
+			z.compressed_size = get_le32(d + 20);
+			z.uncompressed_size = get_le32(d + 24);
+			z.local_header_offset = get_le32(d + 42);
+
+			// Encrypted members can't be read
+			if (0 == (get_le16(d + 8) & 1))
+				entries.push_back(z);
+
+			pos += record_size;
+		}
+
+		return true;
+	}
+
+	const string& get_filename(void) const
+	{
+		return filename;
+	}
+
+	size_t get_num_entries(void) const
+	{
+		return entries.size();
+	}
+
+	const zip_entry& get_entry(const size_t i) const
+	{
+		return entries[i];
+	}
+
+	bool find(const string& name, size_t& index) const
+	{
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (entries[i].name == name)
+			{
+				index = i;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+private:
+
+	string filename;
+	vector<zip_entry> entries;
+};
+
+
+// The bytes of a member, inflated a buffer at a time as they are read;
+// the CRC and size are checked at the end
+class zip_member_buffer : public std::streambuf
+{
+public:
+
+	zip_member_buffer(void)
+	{
+		output.resize(65536);
+		remaining = 0;
+		crc = 0;
+		deflated = false;
+	}
+
+	bool open(const zip_archive& archive, const size_t index)
+	{
+		entry = archive.get_entry(index);
+
+		if (0 != entry.method && 8 != entry.method)
+		{
+			cerr << "Zip member " << entry.name << " uses an unsupported compression method (" << entry.method << ")." << endl;
+			return false;
+		}
+
+		file.open(archive.get_filename().c_str(), ios::binary);
+
+		if (!file.is_open())
+		{
+			cerr << "Failed to open zip archive: " << archive.get_filename() << endl;
+			return false;
+		}
+
+		// The local header's name and extra field can differ in length from
+		// those in the central directory
+		unsigned char local_header[30];
+		file.seekg(static_cast<std::streamoff>(entry.local_header_offset));
+
+		if (!file.read(reinterpret_cast<char*>(local_header), 30) || 0x04034b50 != get_le32(local_header))
+		{
+			cerr << "Zip member " << entry.name << " has an invalid local header." << endl;
+			return false;
+		}
+
+		file.seekg(static_cast<std::streamoff>(get_le16(local_header + 26) + get_le16(local_header + 28)), ios::cur);
+
+		deflated = (8 == entry.method);
+		remaining = entry.uncompressed_size;
+		crc = 0;
+
+		if (deflated)
+			inflate.reset(&file, entry.compressed_size);
+
+		setg(&output[0], &output[0], &output[0]);
+
+		return true;
+	}
+
+protected:
+
+	int_type underflow(void)
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+
+		if (0 == remaining)
+			return traits_type::eof();
+
+		size_t n = output.size();
+
+		if (n > remaining)
+			n = static_cast<size_t>(remaining);
+
+		unsigned char* const dst = reinterpret_cast<unsigned char*>(&output[0]);
+
+		if (deflated)
+		{
+			n = inflate.read(dst, n);
+		}
+		else
+		{
+			file.read(&output[0], n);
+			n = static_cast<size_t>(file.gcount());
+		}
+
+		remaining -= n;
+		crc = get_crc32_table().update(crc, dst, n);
+
+		if (0 == n)
+		{
+			if (!inflate.failed())
+				cerr << "Zip member " << entry.name << " is short or corrupt." << endl;
+
+			remaining = 0;
+			return traits_type::eof();
+		}
+
+		if (0 == remaining && crc != entry.crc)
+		{
+			// Hold back the last buffer, so that the reader sees a short member
+			cerr << "Zip member " << entry.name << " has a bad CRC." << endl;
+			return traits_type::eof();
+		}
+
+		setg(&output[0], &output[0], &output[0] + n);
+
+		return traits_type::to_int_type(*gptr());
+	}
+
+private:
+
+	zip_entry entry;
+	ifstream file;
+	inflater inflate;
+	vector<char> output;
+	unsigned long long int remaining;
+	unsigned int crc;
+	bool deflated;
+};
+
+
+class zip_member_stream : public istream
+{
+public:
+
+	zip_member_stream(void) : istream(0)
+	{
+		rdbuf(&buffer);
+	}
+
+	bool open(const zip_archive& archive, const size_t index)
+	{
+		if (false == buffer.open(archive, index))
+		{
+			setstate(ios::failbit);
+			return false;
+		}
+
+		clear();
+
+		return true;
+	}
+
+private:
+
+	zip_member_buffer buffer;
+};
+
+
+// Split "archive.zip:member" into its two parts
+// Returns false if the path doesn't name a member of a zip archive
+bool split_zip_member_path(const string& path, string& archive, string& member)
+{
+	string lower = path;
+
+	for (size_t i = 0; i < lower.size(); i++)
+		lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(lower[i])));
+
+	const size_t pos = lower.find(".zip:");
+
+	if (string::npos == pos)
+		return false;
+
+	archive = path.substr(0, pos + 4);
+	member = path.substr(pos + 5);
+
+	return true;
+}
+
+#endif